@@ -0,0 +1,269 @@
+// Microbenchmarks of vdb's rendering and logging throughput, written as JSON so that
+// results can be compared across commits:
+//
+//   bench                        run with a window and print the results
+//   bench -o results.json        write the results to a file
+//   bench --headless <dir>       run without a window (see vdbHeadless); <dir> receives
+//                                one image per benchmark. VDB_HEADLESS=<dir> does the same.
+//
+// Each benchmark runs in a break of its own and steps to the next one by itself. Times
+// include glFinish, so they measure the work done by the GPU as well as the submission.
+// Every measurement is repeated and the fastest run is reported.
+//
+// vdb is compiled into this program (instead of linked as a library) so that the
+// benchmarks can drive the framegrab directly, which has no public API. Framegrab
+// reads back the window's back buffer, so it is skipped in headless mode.
+#include "../src/vdb.cpp"
+
+enum { REPEATS = 5 };
+
+static FILE *out;
+static int num_results;
+
+static double Milliseconds(Uint64 t0, Uint64 t1)
+{
+    return 1000.0*(double)(t1 - t0)/(double)SDL_GetPerformanceFrequency();
+}
+
+// Runs f once to warm up, then REPEATS times, and returns the fastest run in milliseconds.
+template <typename F>
+static double Measure(F f)
+{
+    f();
+    glFinish();
+    double best = 1e30;
+    for (int i = 0; i < REPEATS; i++)
+    {
+        Uint64 t0 = SDL_GetPerformanceCounter();
+        f();
+        glFinish();
+        double ms = Milliseconds(t0, SDL_GetPerformanceCounter());
+        if (ms < best)
+            best = ms;
+    }
+    return best;
+}
+
+// rate is work per second, in the given unit
+static void Result(const char *name, double ms, double rate, const char *unit)
+{
+    fprintf(out, "%s\n    {\"name\": \"%s\", \"ms\": %.4f, \"rate\": %.4f, \"unit\": \"%s\"}",
+        num_results > 0 ? "," : "", name, ms, rate, unit);
+    num_results++;
+}
+
+static void Skipped(const char *name, const char *reason)
+{
+    fprintf(out, "%s\n    {\"name\": \"%s\", \"skipped\": \"%s\"}", num_results > 0 ? "," : "", name, reason);
+    num_results++;
+}
+
+static float Random()
+{
+    return (rand() % 1024)/512.0f - 1.0f;
+}
+
+// Submits n vertices of random positions and colors.
+static void Vertices(int n)
+{
+    for (int i = 0; i < n; i++)
+    {
+        vdbColor(0.5f + 0.5f*Random(), 0.5f + 0.5f*Random(), 0.5f + 0.5f*Random());
+        vdbVertex(Random(), Random());
+    }
+}
+
+static void BenchVertexRate()
+{
+    const int n = 1000*1000;
+    const char *names[] = { "vertex_rate/points", "vertex_rate/lines", "vertex_rate/triangles" };
+    for (int prim = 0; prim < 3; prim++)
+    {
+        vdbPointSize(1.0f);
+        vdbLineWidth(1.0f);
+        double ms = Measure([&]() {
+            if      (prim == 0) vdbBeginPoints();
+            else if (prim == 1) vdbBeginLines();
+            else                vdbBeginTriangles();
+            Vertices(n);
+            vdbEnd();
+        });
+        Result(names[prim], ms, n/(ms*1e3), "Mvertices/s");
+    }
+}
+
+static void BenchDrawList()
+{
+    const int n = 300*1000;
+    const int replays = 100;
+    vdbBeginList(0);
+    vdbBeginTriangles();
+    Vertices(n);
+    vdbEnd();
+    double ms = Measure([&]() {
+        for (int i = 0; i < replays; i++)
+            vdbDrawList(0);
+    });
+    Result("draw_list/replay", ms/replays, replays*n/(ms*1e3), "Mvertices/s");
+}
+
+static void BenchLines()
+{
+    const int n = 200*1000;
+    const float widths[] = { 1.0f, 4.0f };
+    const char *names[] = { "lines/thin", "lines/thick" };
+    for (int i = 0; i < 2; i++)
+    {
+        vdbLineWidth(widths[i]);
+        double ms = Measure([&]() {
+            vdbBeginLines();
+            Vertices(n);
+            vdbEnd();
+        });
+        Result(names[i], ms, n/2/(ms*1e3), "Mlines/s");
+    }
+    vdbLineWidth(1.0f);
+}
+
+static void BenchPointSegments()
+{
+    const int n = 100*1000;
+    const int segments[] = { 4, 8, 16, 32, 64 };
+    for (int i = 0; i < 5; i++)
+    {
+        vdbPointSize(4.0f);
+        vdbPointSegments(segments[i]);
+        double ms = Measure([&]() {
+            vdbBeginPoints();
+            Vertices(n);
+            vdbEnd();
+        });
+        char name[64];
+        sprintf(name, "points/segments_%d", segments[i]);
+        Result(name, ms, n/(ms*1e3), "Mpoints/s");
+    }
+    vdbPointSegments(4);
+}
+
+static void BenchLoadImage()
+{
+    const int width = 1024;
+    const int height = 1024;
+    float *data = (float*)calloc(width*height*4, sizeof(float));
+    assert(data);
+    for (int i = 0; i < width*height*4; i++)
+        data[i] = 0.5f + 0.5f*Random();
+    for (int float32 = 0; float32 <= 1; float32++)
+    for (int channels = 1; channels <= 4; channels++)
+    {
+        double ms = Measure([&]() {
+            if (float32) vdbLoadImageFloat32(0, data, width, height, channels);
+            else         vdbLoadImageUint8(0, data, width, height, channels);
+        });
+        double megabytes = (double)width*height*channels*(float32 ? 4 : 1)/(1024.0*1024.0);
+        char name[64];
+        sprintf(name, "load_image/%s_%d", float32 ? "float32" : "uint8", channels);
+        Result(name, ms, megabytes/(ms/1000.0), "MB/s");
+    }
+    free(data);
+}
+
+static void BenchFramegrab()
+{
+    if (headless::active)
+    {
+        Skipped("framegrab/raw", "headless");
+        Skipped("framegrab/raw_lz4", "headless");
+        return;
+    }
+    const int frames = 60;
+    const char *filename = "bench_framegrab.vdbcap";
+    int width = vdbGetFramebufferWidth();
+    int height = vdbGetFramebufferHeight();
+    for (int lz4 = 0; lz4 <= 1; lz4++)
+    {
+        framegrab_options_t opt = {0};
+        opt.filename = filename;
+        opt.video_frame_cap = frames;
+        opt.raw_lz4 = lz4 != 0;
+        opt.raw_capacity_mb = (int)((double)width*height*3*frames/(1024.0*1024.0)) + 16;
+        framegrab::RecordRaw(opt);
+        Uint64 t0 = SDL_GetPerformanceCounter();
+        while (framegrab::active) // stops (and writes all frames) after the last one
+            framegrab::CaptureFrame(width, height);
+        double ms = Milliseconds(t0, SDL_GetPerformanceCounter());
+        remove(filename);
+        Result(lz4 ? "framegrab/raw_lz4" : "framegrab/raw", ms/frames, frames/(ms/1000.0), "frames/s");
+    }
+}
+
+static void BenchLogAppend()
+{
+    const int n = 1000*1000;
+    vdbLogPush("bench");
+    double ms = Measure([&]() {
+        for (int i = 0; i < n; i++)
+            vdbLogScalar("x", (float)i);
+    });
+    vdbLogPop();
+    Result("log/append_scalar", ms, n/(ms*1e3), "Msamples/s");
+}
+
+int main(int argc, char **argv)
+{
+    const char *output = NULL;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+            output = argv[++i];
+        else if (strcmp(argv[i], "--headless") == 0 && i + 1 < argc)
+            vdbHeadless(argv[++i]);
+        else
+        {
+            fprintf(stderr, "usage: %s [-o results.json] [--headless <dir>]\n", argv[0]);
+            return 1;
+        }
+    }
+    out = output ? fopen(output, "w") : stdout;
+    if (!out)
+    {
+        fprintf(stderr, "Failed to open %s\n", output);
+        return 1;
+    }
+
+    struct { const char *label; void (*run)(); } benchmarks[] =
+    {
+        { "vertex_rate", BenchVertexRate },
+        { "draw_list", BenchDrawList },
+        { "lines", BenchLines },
+        { "point_segments", BenchPointSegments },
+        { "load_image", BenchLoadImage },
+        { "framegrab", BenchFramegrab },
+        { "log_append", BenchLogAppend },
+    };
+    int num_benchmarks = sizeof(benchmarks)/sizeof(benchmarks[0]);
+
+    bool first = true;
+    for (int i = 0; i < num_benchmarks; i++)
+    {
+        while (vdbBeginBreak(benchmarks[i].label))
+        {
+            if (first)
+            {
+                fprintf(out, "{\n  \"renderer\": \"%s\",\n  \"headless\": %s,\n  \"width\": %d,\n  \"height\": %d,\n  \"results\": [",
+                    (const char*)glGetString(GL_RENDERER), headless::active ? "true" : "false",
+                    vdbGetFramebufferWidth(), vdbGetFramebufferHeight());
+                first = false;
+            }
+            vdbProjection(NULL); // vertices in [-1,1] cover the window
+            vdbLoadMatrix(NULL);
+            benchmarks[i].run();
+            vdbStepOnce();
+            vdbEndBreak();
+        }
+    }
+    fprintf(out, "\n  ]\n}\n");
+    if (out != stdout)
+        fclose(out);
+    return 0;
+}
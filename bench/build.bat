@@ -0,0 +1,6 @@
+@REM Build for Visual Studio compiler.
+@REM Run your copy of vcvars32.bat or vcvarsall.bat to setup command-line compiler.
+@REM Ensure that the environment variable SDL2_DIR is correct. vdb is compiled into the benchmark.
+set INCLUDES=/I..\include /I..\include\vdb /I..\src\freetype\include /I%SDL2_DIR%\include
+set LIBS=/libpath:%SDL2_DIR%\lib\x86 SDL2.lib SDL2main.lib opengl32.lib
+cl /nologo /EHsc /O2 /MD %INCLUDES% bench.cpp /link %LIBS% /subsystem:console
@@ -148,6 +148,8 @@ int     vdbGetFramebufferWidth();
 int     vdbGetFramebufferHeight();
 int     vdbGetWindowWidth(); // Note: the window size may not be the same as the framebuffer resolution on retina displays.
 int     vdbGetWindowHeight();
+float   vdbGetFrameDelta(); // Seconds since the previous frame (at most 0.1, e.g. after vdb has been idle)
+double  vdbGetTime();       // Seconds since vdb's first frame, measured at the start of this frame
 
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 // § Coordinate system conversions
@@ -257,6 +259,13 @@ void    vdbEndBreak();
 bool    vdbIsFirstFrame();
 bool    vdbIsDifferentLabel();
 void    vdbAutoStep(bool enabled);
+void    vdbWatch(bool enabled); // Call before the first break to make breaks non-blocking: each break is recorded and shown by a separate render thread. See src/watch.h for what can be drawn.
+void    vdbHeadless(const char *output_dir, int width=1280, int height=720); // Call before the first break to run each break once without a window, saving <output_dir>/<number>_<label>.png. Setting the environment variable VDB_HEADLESS=<output_dir> does the same.
+void    vdbRecordToFile(const char *filename); // Write what each break draws (on its first frame) to a .vdbrec file, or stop if NULL. Setting the environment variable VDB_RECORD=<filename> does the same. See src/recorder.h for what can be recorded.
+void    vdbTraceToFile(const char *filename); // Write the time spent in each phase of vdbBeginBreak and vdbEndBreak, and in your block, as a Chrome trace (JSON) for chrome://tracing or ui.perfetto.dev, or stop if NULL. Setting the environment variable VDB_TRACE=<filename> does the same. See src/trace.h.
+bool    vdbPlayRecording(const char *filename); // Show a .vdbrec file, with F10 to step through its frames and a slider to scrub. Returns false if the file can't be read.
+bool    vdbConnect(const char *name); // Call before the first break to show breaks in a separate viewer process (started with vdb-viewer <name>). Breaks are non-blocking, like in watch mode. Setting the environment variable VDB_CONNECT=<name> does the same. See src/remote.h.
+bool    vdbRunViewer(const char *name); // Runs the viewer for clients that connect to <name>. Only returns if it fails to start.
 
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 // § Logging
@@ -267,7 +276,43 @@ void    vdbLogPop();
 void    vdbLogScalar(const char *label, float x);
 void    vdbLogMatrix(const char *label, float *x, int rows, int columns);
 void    vdbLogVector(const char *label, float *x, int elements);
-void    vdbLogDump(const char *filename);
+void    vdbLogDump(const char *filename); // Writes all logs as JSON, or in binary if the filename ends in .vdblog (see src/vdblog.h).
+void    vdbLogStreamToFile(const char *filename); // Keeps writing the logs to a .vdblog file while the program runs (flushed at every break), or stops if NULL.
+bool    vdbLogLoad(const char *filename); // Adds the logs in a .vdblog file to the current logs. Returns false if the file can't be read or is corrupt.
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// § Profiling
+// Zones are shown in Tools > Profiler, for the time between the previous break
+// and the current one. Zones can be recorded from any thread. The name is not
+// copied, so use a string literal (or a string that outlives the next break).
+//
+//   void Step() { VDB_PROFILE("Step"); ... }
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void    vdbProfileBegin(const char *name);
+void    vdbProfileEnd();
+struct  vdbProfileScope { vdbProfileScope(const char *name) { vdbProfileBegin(name); } ~vdbProfileScope() { vdbProfileEnd(); } };
+#define VDB_PROFILE_CONCAT_(a,b) a##b
+#define VDB_PROFILE_CONCAT(a,b) VDB_PROFILE_CONCAT_(a,b)
+#define VDB_PROFILE(name) vdbProfileScope VDB_PROFILE_CONCAT(vdb_profile_scope_, __LINE__)(name)
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// § Frame statistics
+// Work submitted through vdb's drawing functions (vdbEnd, vdbDrawList,
+// vdbDrawImage, vdbEndShader, vdbLoadImage*). vdbGetFrameStats returns the
+// counts so far in the current frame; Tools > Frame stats shows the previous
+// frame as an overlay.
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+struct vdbFrameStats
+{
+    int draw_calls;
+    int vertices;
+    int program_switches; // draws that used a different shader program than the draw before
+    int buffer_reallocations; // vertex buffers that had to grow
+    int texture_uploads;
+    long long buffer_bytes; // uploaded to vertex buffers
+    long long texture_bytes; // uploaded to textures
+};
+vdbFrameStats vdbGetFrameStats();
 
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 // § Row-major versions of matrix functions:
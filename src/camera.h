@@ -1,6 +1,6 @@
 void vdbCamera2D()
 {
-    const float dt = 1.0f/60.0f;
+    const float dt = 1.0f/60.0f; // scales mouse movement per frame, which doesn't depend on the frame rate
 
     GetFrameSettings()->camera.planar.dirty = true;
     // float scroll_sensitivity = settings.camera.scroll_sensitivity; // FIXME: unused
@@ -93,7 +93,7 @@ void vdbCamera2D()
 
 void vdbCameraTrackball()
 {
-    const float dt = 1.0f/60.0f; // todo: expose API vdbGetFrameDelta()
+    const float dt = 1.0f/60.0f; // scales mouse wheel steps, which don't depend on the frame rate
 
     auto &cs = settings.camera;
     GetFrameSettings()->camera.trackball.dirty = true;
@@ -189,7 +189,7 @@ void vdbCameraTrackball()
         if (vdbIsKeyDown(VDB_KEY_SPACE)) y = +move_speed*zoom;
         vdbVec4 in_camera_vel = vdbVec4(x,y,z,0.0f);
         vdbVec4 in_world_vel = vdbMulTranspose4x1(R, in_camera_vel);
-        T = T + in_world_vel*dt;
+        T = T + in_world_vel*vdbGetFrameDelta();
     }
 
     {
@@ -209,7 +209,7 @@ void vdbCameraTurntable()
     float &radius = GetFrameSettings()->camera.turntable.radius;
     bool can_move = GetFrameSettings()->camera.key == VDB_KEY_INVALID ||
                     vdbIsKeyDown(GetFrameSettings()->camera.key);
-    const float dt = 1.0f/60.0f;
+    const float dt = 1.0f/60.0f; // scales mouse movement per frame and wheel steps, which don't depend on the frame rate
 
     // zooming
     radius -= scroll_sensitivity*vdbGetMouseWheel()*radius*dt;
@@ -30,6 +30,71 @@
 // Set to > 0 if you want to use OpenGL depth testing.
 #define VDB_DEPTHBITS          24
 
+// Number of frames between reading back a captured frame (screenshot, video) and
+// writing it out. A delay of 1-2 frames lets the GPU finish the transfer in the
+// background, so recording does not stall rendering. Set to 0 to read synchronously.
+#define VDB_FRAMEGRAB_READBACK_DELAY 2
+
+// Number of threads used to encode screenshots and image sequences (PNG, BMP, QOI).
+// Set to 0 to use one less than the number of CPU cores.
+#define VDB_FRAMEGRAB_ENCODER_THREADS 0
+
+// Maximum number of captured frames waiting to be encoded. When the queue is full,
+// recording either waits for the encoder threads or drops frames (your choice).
+#define VDB_FRAMEGRAB_QUEUE_SIZE 8
+
+// Dynamic resolution (Render scale menu) adjusts the resolution to keep the GPU time
+// spent in your drawing code near this target, in milliseconds. It does not include
+// vdb's own drawing (ImGui, upsampling), so leave some headroom below the frame budget.
+#define VDB_DYNAMIC_RESOLUTION_TARGET_MS 12.0f
+
+// Lowest resolution that dynamic resolution may use, relative to full quality.
+#define VDB_DYNAMIC_RESOLUTION_MIN_SCALE 0.25f
+
+// Size of the images written in headless mode when it's enabled with the VDB_HEADLESS
+// environment variable (see vdbHeadless).
+#define VDB_HEADLESS_WIDTH 1280
+#define VDB_HEADLESS_HEIGHT 720
+
+// When recording breaks to a file (see vdbRecordToFile), vdbBegin/vdbEnd batches and
+// images at least this large (in bytes) are stored once and referenced by hash when
+// they are drawn again. Smaller ones are cheaper to store as they are.
+#define VDB_RECORD_MIN_CHUNK_SIZE 1024
+
+// Size of the write buffer for recordings, in bytes.
+#define VDB_RECORD_BUFFER_SIZE (1024*1024)
+
+// Each scalar log (see vdbLogScalar) keeps at most this many of its newest samples.
+// Must be a power of two.
+#define VDB_LOG_MAX_SAMPLES (1024*1024)
+
+// Size of the buffer that each thread other than the main thread logs into (see
+// log_threads.h), in bytes. Must be a power of two. It is emptied at every break.
+#define VDB_LOG_THREAD_BUFFER_SIZE (4*1024*1024)
+
+// Number of zone events (a start or an end) that each thread can record between two
+// breaks (see vdbProfileBegin). Must be a power of two.
+#define VDB_PROFILE_BUFFER_SIZE (64*1024)
+
+// Number of draws whose GPU time is measured per frame when GPU timing is enabled
+// (Tools menu). Later draws in the same frame are not measured.
+#define VDB_GPU_TIMER_MAX_DRAWS 512
+
+// The frame history (see history.h) keeps at most this many frames per label, and
+// drops the oldest ones while all of them take more than this many megabytes. Every
+// VDB_HISTORY_KEYFRAME_INTERVAL'th frame of a label is stored in full rather than
+// as a delta, so decoding a frame never takes more than that many steps.
+#define VDB_HISTORY_MAX_FRAMES 256
+#define VDB_HISTORY_BUDGET_MB 64
+#define VDB_HISTORY_KEYFRAME_INTERVAL 16
+
+// Size of the shared memory ring buffer between a client and the viewer (see
+// vdbConnect), in bytes. Must be a power of two. A frame that doesn't fit is dropped.
+#define VDB_REMOTE_BUFFER_SIZE (64*1024*1024)
+
+// How often the viewer checks for new frames while it is idle, in milliseconds.
+#define VDB_REMOTE_POLL_MS 5
+
 // The size of the vdb window is remembered between sessions.
 // This path specifies the path (relative to working directory)
 // where the information is stored.
@@ -0,0 +1,45 @@
+// When vdb is idle (the scene has settled and it is waiting for events), the last
+// frame is kept in a framebuffer. If vdb then wakes up from an event that can't have
+// changed anything (see window::IsPassiveEvent), e.g. the window being uncovered or
+// moved, that frame is shown again instead of running the user's drawing code, ImGui
+// and the render scaler all over again.
+namespace frame_cache
+{
+    static framebuffer_t cache;
+    static bool valid;
+
+    // Call at the end of a frame, before swapping buffers.
+    static void Store()
+    {
+        int w = window::framebuffer_width;
+        int h = window::framebuffer_height;
+        if (cache.width != w || cache.height != h)
+        {
+            FreeFramebuffer(&cache);
+            cache = MakeFramebuffer(w, h, GL_NEAREST, GL_NEAREST, true);
+        }
+
+        // also resolves the window's framebuffer if it is multisampled
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, cache.fbo);
+        glBlitFramebuffer(0, 0, w, h, 0, 0, w, h, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        valid = true;
+    }
+
+    // Shows the stored frame. Returns false if it's no longer usable.
+    static bool Present()
+    {
+        if (!valid || cache.width != window::framebuffer_width || cache.height != window::framebuffer_height)
+            return false;
+
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glViewport(0, 0, cache.width, cache.height);
+        glDisable(GL_SCISSOR_TEST);
+        glDisable(GL_BLEND);
+        glDisable(GL_DEPTH_TEST);
+        DrawRenderTargetWithDepth(cache);
+        window::SwapBuffers(settings.frame_rate_cap);
+        return true;
+    }
+}
@@ -0,0 +1,92 @@
+// Counts the work that each frame submits through vdb's drawing functions: draw calls,
+// vertices, bytes uploaded to buffers (vdbEnd) and textures (vdbLoadImage*), program
+// switches between consecutive draws, and vertex buffers that had to be reallocated
+// because a vdbBegin/vdbEnd block or draw list grew. vdbGetFrameStats returns the
+// counts so far in the current frame, so calling it before and after a block gives the
+// work of that block. The overlay (Tools > Frame stats) shows the previous frame.
+namespace frame_stats
+{
+    static vdbFrameStats curr;
+    static vdbFrameStats last; // previous frame
+    static GLuint last_program; // of the previous draw
+    static bool overlay_open;
+
+    static void Draw(GLuint program, int vertices)
+    {
+        curr.draw_calls++;
+        curr.vertices += vertices;
+        if (program != last_program)
+        {
+            curr.program_switches++;
+            last_program = program;
+        }
+    }
+
+    static void BufferUpload(size_t bytes, bool reallocated)
+    {
+        curr.buffer_bytes += (long long)bytes;
+        if (reallocated)
+            curr.buffer_reallocations++;
+    }
+
+    static void TextureUpload(int width, int height, GLenum data_format, GLenum data_type)
+    {
+        int channels = 4;
+        if      (data_format == GL_RED) channels = 1;
+        else if (data_format == GL_RG)  channels = 2;
+        else if (data_format == GL_RGB) channels = 3;
+        int size = 1;
+        if      (data_type == GL_FLOAT)                                  size = 4;
+        else if (data_type == GL_UNSIGNED_SHORT || data_type == GL_SHORT) size = 2;
+        curr.texture_bytes += (long long)width*height*channels*size;
+        curr.texture_uploads++;
+    }
+
+    // Called once per frame, before swapping buffers.
+    static void EndFrame()
+    {
+        last = curr;
+        memset(&curr, 0, sizeof(curr));
+        last_program = 0;
+    }
+
+    static const char *FormatBytes(char *text, long long bytes)
+    {
+        if      (bytes >= 1024*1024) sprintf(text, "%.1f MB", bytes/(1024.0*1024.0));
+        else if (bytes >= 1024)      sprintf(text, "%.1f KB", bytes/1024.0);
+        else                         sprintf(text, "%d B", (int)bytes);
+        return text;
+    }
+
+    static void Overlay()
+    {
+        if (!overlay_open)
+            return;
+        const float pad = 8.0f;
+        ImVec2 display_size = ImGui::GetIO().DisplaySize;
+        ImGui::SetNextWindowPos(ImVec2(display_size.x - pad, ImGui::GetFrameHeight() + pad), ImGuiCond_Always, ImVec2(1.0f, 0.0f));
+        ImGui::SetNextWindowBgAlpha(0.5f);
+        ImGuiWindowFlags flags =
+            ImGuiWindowFlags_NoDecoration |
+            ImGuiWindowFlags_AlwaysAutoResize |
+            ImGuiWindowFlags_NoSavedSettings |
+            ImGuiWindowFlags_NoFocusOnAppearing |
+            ImGuiWindowFlags_NoNav;
+        if (ImGui::Begin("##frame_stats", NULL, flags))
+        {
+            char text[64];
+            ImGui::Text("Draw calls: %d", last.draw_calls);
+            ImGui::Text("Vertices: %d", last.vertices);
+            ImGui::Text("Program switches: %d", last.program_switches);
+            ImGui::Text("Buffer uploads: %s", FormatBytes(text, last.buffer_bytes));
+            ImGui::Text("Buffer reallocations: %d", last.buffer_reallocations);
+            ImGui::Text("Texture uploads: %s (%d)", FormatBytes(text, last.texture_bytes), last.texture_uploads);
+        }
+        ImGui::End();
+    }
+}
+
+vdbFrameStats vdbGetFrameStats()
+{
+    return frame_stats::curr;
+}
@@ -11,10 +11,12 @@ struct framebuffer_t
 
 static framebuffer_t *current_framebuffer = NULL;
 
+static void GetViewport(GLint viewport[4]); // as set by the user (see transform.h)
+
 static void EnableFramebuffer(framebuffer_t *fb)
 {
     fb->last_framebuffer = current_framebuffer;
-    glGetIntegerv(GL_VIEWPORT, fb->last_viewport);
+    GetViewport(fb->last_viewport);
     glBindFramebuffer(GL_FRAMEBUFFER, fb->fbo);
     vdbViewporti(0, 0, fb->width, fb->height);
     current_framebuffer = fb;
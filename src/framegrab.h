@@ -1,3 +1,24 @@
+// Video codecs and encoder presets for recording with ffmpeg. All of these are
+// software encoders that ship with standard ffmpeg builds. Zero is the default.
+enum ffmpeg_codec_
+{
+    FFMPEG_H264 = 0, // libx264 (.mp4, .mkv)
+    FFMPEG_H265,     // libx265 (.mp4, .mkv)
+    FFMPEG_VP9,      // libvpx-vp9 (.webm, .mkv)
+    FFMPEG_MPEG4,    // mpeg4 part 2 (.mp4, .avi). Fast to encode, larger files.
+    FFMPEG_FFV1,     // lossless, keeps the alpha channel (.mkv)
+    FFMPEG_NUM_CODECS
+};
+enum ffmpeg_preset_
+{
+    FFMPEG_PRESET_FAST = 0,
+    FFMPEG_PRESET_VERYFAST,
+    FFMPEG_PRESET_ULTRAFAST, // Cheapest to encode, largest files
+    FFMPEG_PRESET_MEDIUM,
+    FFMPEG_PRESET_SLOW,
+    FFMPEG_NUM_PRESETS
+};
+
 struct framegrab_options_t
 {
     const char *filename; // If no extension is provided, file will be saved as .bmp.
@@ -12,7 +33,12 @@ struct framegrab_options_t
 
     float ffmpeg_fps;
     int ffmpeg_crf; // Quality (lower is better)
+    int ffmpeg_codec; // FFMPEG_H264, etc.
+    int ffmpeg_preset; // FFMPEG_PRESET_FAST, etc. (speed vs. file size)
     int video_frame_cap; // Stop after capturing this number of frames (0 -> no limit, call StopRecording to stop)
+    bool drop_frames; // Skip frames instead of waiting when the encoder threads (or ffmpeg) can't keep up
+    bool raw_lz4; // Compress frames in raw capture mode
+    int raw_capacity_mb; // Size of the preallocated raw capture file (frame data only)
 };
 
 #ifdef _MSC_VER
@@ -20,9 +46,26 @@ struct framegrab_options_t
 #define pclose _pclose
 #endif
 
+#ifdef _WIN32
+#define VDB_POPEN_WRITE_MODE "wb" // Windows pipes are text-mode unless 'b' is given
+#else
+#define VDB_POPEN_WRITE_MODE "w" // POSIX popen only accepts "r" or "w"
+#include <signal.h>
+#include <pthread.h>
+#endif
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 namespace framegrab
 {
-    enum framegrab_mode_t { MODE_SCREENSHOT, MODE_SEQUENCE, MODE_FFMPEG };
+    enum framegrab_mode_t { MODE_SCREENSHOT, MODE_SEQUENCE, MODE_FFMPEG, MODE_RAW };
     static framegrab_options_t options;
     static framegrab_mode_t mode;
     static bool active;
@@ -30,6 +73,14 @@ namespace framegrab
     static int suffix_counter;
     static bool should_stop;
 
+    // Statistics for the current (or most recent) recording
+    // Counted by the encoder threads as well, and read by the UI while recording
+    static SDL_atomic_t frames_written;
+    static SDL_atomic_t frames_dropped; // Frames skipped because the encoder queue was full (see drop_frames)
+    static SDL_atomic_t frames_stalled; // Frames where rendering had to wait for the encoder queue
+    static SDL_atomic_t frames_failed; // Image files that could not be written
+    static Uint64 start_ticks; // Performance counter at the start of the recording
+
     static void StopRecording()
     {
         should_stop = true;
@@ -41,6 +92,11 @@ namespace framegrab
         if (options.reset_counter)
             suffix_counter = options.start_from;
         num_frames = 0;
+        SDL_AtomicSet(&frames_written, 0);
+        SDL_AtomicSet(&frames_dropped, 0);
+        SDL_AtomicSet(&frames_stalled, 0);
+        SDL_AtomicSet(&frames_failed, 0);
+        start_ticks = SDL_GetPerformanceCounter();
         active = true;
         should_stop = false;
     }
@@ -61,111 +117,833 @@ namespace framegrab
 
     static void RecordFFmpeg(framegrab_options_t _options)
     // Pipe the back framebuffer of the current and each subsequent frame to ffmpeg.
-    // The function uses _popen to open a pipe, and assumes that the ffmpeg executable is present on the
+    // The function uses popen to open a pipe, and assumes that the ffmpeg executable is present on the
     // terminal that the application ran from (in the PATH variable). If you're on Windows, you will want
     // to change your PATH environment variable to point to the folder holding the ffmpeg executable.
+    // Frames are written to the pipe from a separate thread, so a slow encoder doesn't block rendering.
     {
         mode = MODE_FFMPEG;
         StartFramegrab(_options);
     }
 
-    static void SaveFrame(unsigned char *data,
-                          int width,
-                          int height,
-                          int channels,
-                          GLenum format)
+    static void RecordRaw(framegrab_options_t _options)
+    // Store the back framebuffer of the current and each subsequent frame, uncompressed or
+    // LZ4-compressed, in a single preallocated .vdbcap file (see vdbcap.h). This is the
+    // fastest way to record: use it for short high-framerate bursts and convert the file
+    // afterwards with tools/vdbcap. Recording stops when the file is full.
     {
-        if (mode == MODE_FFMPEG)
+        mode = MODE_RAW;
+        StartFramegrab(_options);
+    }
+
+    // Frames are handed between the readback and the encoder in buffers from this pool,
+    // instead of malloc'ing and free'ing a full framebuffer's worth of memory every frame.
+    // All pooled buffers have the same size; if the frame size changes, the pool is emptied.
+    // Buffers are released by the encoder threads, so the pool is protected by a mutex.
+    enum { MAX_POOLED_FRAMES = 32 };
+    static unsigned char *pooled_frames[MAX_POOLED_FRAMES];
+    static int num_pooled_frames;
+    static size_t pooled_frame_size;
+    static SDL_mutex *pool_mutex;
+
+    static void FreePooledFrames()
+    {
+        for (int i = 0; i < num_pooled_frames; i++)
+            free(pooled_frames[i]);
+        num_pooled_frames = 0;
+    }
+
+    static unsigned char *AllocateFrame(size_t size)
+    {
+        if (!pool_mutex)
+            pool_mutex = SDL_CreateMutex();
+        assert(pool_mutex);
+        SDL_LockMutex(pool_mutex);
+        if (size != pooled_frame_size)
+        {
+            FreePooledFrames();
+            pooled_frame_size = size;
+        }
+        unsigned char *data = NULL;
+        if (num_pooled_frames > 0)
+            data = pooled_frames[--num_pooled_frames];
+        SDL_UnlockMutex(pool_mutex);
+        if (!data)
+            data = (unsigned char*)malloc(size);
+        assert(data && "Ran out of memory allocating framegrab buffer");
+        return data;
+    }
+
+    static void ReleaseFrame(unsigned char *data, size_t size)
+    {
+        SDL_LockMutex(pool_mutex);
+        if (size == pooled_frame_size && num_pooled_frames < MAX_POOLED_FRAMES)
+        {
+            pooled_frames[num_pooled_frames++] = data;
+            data = NULL;
+        }
+        SDL_UnlockMutex(pool_mutex);
+        free(data);
+    }
+
+    enum image_format_t { FORMAT_BMP, FORMAT_PNG, FORMAT_QOI, FORMAT_RAW_CAPTURE };
+
+    struct encode_job_t
+    {
+        unsigned char *data; // bottom-to-top rows, as read from OpenGL
+        size_t size;
+        int width;
+        int height;
+        int channels;
+        image_format_t format;
+        char filename[1024];
+        int frame_index; // FORMAT_RAW_CAPTURE only
+        double time; // FORMAT_RAW_CAPTURE only
+    };
+
+    // Raw capture writes into a file that is preallocated and memory-mapped when the first
+    // frame arrives. Encoder threads reserve space for a frame by bumping data_end under a
+    // mutex, and copy (or compress) into the mapping in parallel. Each frame's index entry
+    // is only touched by the thread that writes that frame.
+    namespace capture
+    {
+        static unsigned char *base; // start of the mapped file
+        static size_t mapped_size;
+        static vdbcap_header_t *header;
+        static vdbcap_frame_t *index;
+        static SDL_mutex *mutex; // protects header->data_end
+        static SDL_atomic_t is_full;
+        static SDL_atomic_t frames_lost; // frames that didn't fit after they were queued
+        static int next_frame; // render thread only
+        #ifdef _WIN32
+        static HANDLE file = INVALID_HANDLE_VALUE;
+        static HANDLE mapping;
+        #else
+        static int fd = -1;
+        #endif
+
+        static bool Open(const char *filename, int width, int height, int channels, bool lz4, size_t capacity)
         {
-            static FILE *ffmpeg = 0;
-            if (!ffmpeg)
+            assert(!base);
+            size_t frame_size = (size_t)width*height*channels;
+            size_t max_frames = capacity/frame_size + 1;
+            if (lz4)
+                max_frames *= 8; // leave room in the index for frames that compress well
+            size_t data_offset = sizeof(vdbcap_header_t) + max_frames*sizeof(vdbcap_frame_t);
+            mapped_size = data_offset + capacity;
+
+            #ifdef _WIN32
+            file = CreateFileA(filename, GENERIC_READ|GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+            if (file == INVALID_HANDLE_VALUE)
+                return false;
+            mapping = CreateFileMappingA(file, NULL, PAGE_READWRITE, (DWORD)((uint64_t)mapped_size >> 32), (DWORD)mapped_size, NULL);
+            if (mapping)
+                base = (unsigned char*)MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, mapped_size);
+            if (!base)
+            {
+                if (mapping) CloseHandle(mapping);
+                CloseHandle(file);
+                mapping = NULL;
+                file = INVALID_HANDLE_VALUE;
+                return false;
+            }
+            #else
+            fd = open(filename, O_RDWR|O_CREAT|O_TRUNC, 0644);
+            if (fd < 0)
+                return false;
+            // Allocate the blocks up front: running out of disk space while writing
+            // through the mapping would raise SIGBUS instead of returning an error.
+            #ifdef __linux__
+            bool allocated = posix_fallocate(fd, 0, (off_t)mapped_size) == 0;
+            #else
+            bool allocated = ftruncate(fd, (off_t)mapped_size) == 0;
+            #endif
+            void *p = allocated ? mmap(NULL, mapped_size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+            if (p == MAP_FAILED)
             {
-                // todo: linux/osx
-                char cmd[1024];
-                sprintf(cmd, "ffmpeg -r %f -f rawvideo -pix_fmt %s -s %dx%d -i - "
-                              "-threads 0 -preset fast -y -pix_fmt yuv420p -crf %d -vf vflip %s",
-                              options.ffmpeg_fps, // -r
-                              options.alpha_channel ? "rgba" : "rgb24", // -pix_fmt
-                              width, height, // -s
-                              options.ffmpeg_crf, // -crf
-                              options.filename);
-                ffmpeg = popen(cmd, "wb");
+                close(fd);
+                fd = -1;
+                return false;
             }
+            base = (unsigned char*)p;
+            #endif
 
-            fwrite(data, width*height*channels, 1, ffmpeg);
+            if (!mutex)
+                mutex = SDL_CreateMutex();
+            assert(mutex);
+            header = (vdbcap_header_t*)base;
+            index = (vdbcap_frame_t*)(base + sizeof(vdbcap_header_t));
+            memset(base, 0, data_offset);
+            memcpy(header->magic, VDBCAP_MAGIC, sizeof(header->magic));
+            header->version = VDBCAP_VERSION;
+            header->width = width;
+            header->height = height;
+            header->channels = channels;
+            header->max_frames = (uint32_t)max_frames;
+            header->num_frames = 0;
+            header->data_offset = data_offset;
+            header->data_end = data_offset;
+            next_frame = 0;
+            SDL_AtomicSet(&is_full, 0);
+            SDL_AtomicSet(&frames_lost, 0);
+            return true;
+        }
 
-            num_frames++;
-            if (options.video_frame_cap && num_frames == options.video_frame_cap)
+        static void Append(encode_job_t *job) // called from encoder threads
+        {
+            assert(base);
+            assert(job->frame_index < (int)header->max_frames);
+            const unsigned char *src = job->data;
+            size_t size = job->size;
+            uint32_t compression = VDBCAP_UNCOMPRESSED;
+            unsigned char *compressed = NULL;
+            if (options.raw_lz4)
             {
-                StopRecording();
+                compressed = (unsigned char*)malloc(lz4::CompressBound((int)job->size));
+                int compressed_size = compressed ? lz4::Compress(job->data, (int)job->size, compressed) : 0;
+                if (compressed_size > 0 && (size_t)compressed_size < job->size)
+                {
+                    src = compressed;
+                    size = (size_t)compressed_size;
+                    compression = VDBCAP_LZ4;
+                }
             }
-            if (should_stop)
+
+            SDL_LockMutex(mutex);
+            uint64_t offset = header->data_end;
+            bool fits = offset + size <= mapped_size;
+            if (fits)
+                header->data_end += size;
+            SDL_UnlockMutex(mutex);
+
+            if (fits)
             {
-                active = false;
-                pclose(ffmpeg);
-                ffmpeg = 0;
+                memcpy(base + offset, src, size);
+                vdbcap_frame_t *frame = index + job->frame_index;
+                frame->offset = offset;
+                frame->size = (uint32_t)size;
+                frame->compression = compression;
+                frame->time = job->time;
             }
+            else
+            {
+                SDL_AtomicSet(&is_full, 1);
+                SDL_AtomicAdd(&frames_lost, 1);
+            }
+            free(compressed);
         }
-        else
+
+        static void Close() // after the encoder threads are done
         {
-            bool save_as_bmp = false;
-            bool save_as_png = false;
+            if (!base)
+                return;
+            header->num_frames = (uint32_t)next_frame;
+            uint64_t file_size = header->data_end;
+            int lost = SDL_AtomicGet(&frames_lost);
+            SDL_AtomicAdd(&frames_written, -lost);
+            SDL_AtomicAdd(&frames_dropped, lost);
+            #ifdef _WIN32
+            FlushViewOfFile(base, 0);
+            UnmapViewOfFile(base);
+            CloseHandle(mapping);
+            LARGE_INTEGER end;
+            end.QuadPart = (LONGLONG)file_size;
+            SetFilePointerEx(file, end, NULL, FILE_BEGIN);
+            SetEndOfFile(file);
+            CloseHandle(file);
+            mapping = NULL;
+            file = INVALID_HANDLE_VALUE;
+            #else
+            munmap(base, mapped_size);
+            if (ftruncate(fd, (off_t)file_size) != 0)
+                fprintf(stderr, "Failed to trim raw capture file\n");
+            close(fd);
+            fd = -1;
+            #endif
+            base = NULL;
+            header = NULL;
+            index = NULL;
+            printf("Saved %d frames (%.1f MB) to %s\n", SDL_AtomicGet(&frames_written), file_size/(1024.0*1024.0), options.filename);
+        }
+    }
+
+    static bool WriteQOI(const char *filename, int width, int height, int channels, const unsigned char *data)
+    // Writes a QOI image (https://qoiformat.org). QOI compresses about as well as PNG for
+    // typical vdb output, but encodes an order of magnitude faster, so it's a good choice for
+    // recording long image sequences. Rows are flipped since OpenGL stores them bottom-up.
+    {
+        enum { OP_INDEX = 0x00, OP_DIFF = 0x40, OP_LUMA = 0x80, OP_RUN = 0xc0, OP_RGB = 0xfe, OP_RGBA = 0xff };
+        size_t max_size = 14 + (size_t)width*height*(channels + 1) + 8;
+        unsigned char *out = (unsigned char*)malloc(max_size);
+        if (!out)
+            return false;
+
+        size_t n = 0;
+        out[n++] = 'q'; out[n++] = 'o'; out[n++] = 'i'; out[n++] = 'f';
+        out[n++] = (unsigned char)(width >> 24); out[n++] = (unsigned char)(width >> 16);
+        out[n++] = (unsigned char)(width >> 8);  out[n++] = (unsigned char)(width);
+        out[n++] = (unsigned char)(height >> 24); out[n++] = (unsigned char)(height >> 16);
+        out[n++] = (unsigned char)(height >> 8);  out[n++] = (unsigned char)(height);
+        out[n++] = (unsigned char)channels;
+        out[n++] = 0; // sRGB with linear alpha
 
-            if (strstr(options.filename, ".png"))
+        unsigned char index[64][4] = {{0}};
+        unsigned char prev[4] = { 0, 0, 0, 255 };
+        int run = 0;
+        int stride = width*channels;
+        for (int y = height-1; y >= 0; y--)
+        for (int x = 0; x < width; x++)
+        {
+            const unsigned char *p = data + y*stride + x*channels;
+            unsigned char px[4] = { p[0], p[1], p[2], channels == 4 ? p[3] : (unsigned char)255 };
+            bool last_pixel = (y == 0 && x == width-1);
+            if (px[0] == prev[0] && px[1] == prev[1] && px[2] == prev[2] && px[3] == prev[3])
+            {
+                run++;
+                if (run == 62 || last_pixel)
+                {
+                    out[n++] = (unsigned char)(OP_RUN | (run - 1));
+                    run = 0;
+                }
+                continue;
+            }
+            if (run > 0)
             {
-                save_as_png = true;
-                save_as_bmp = false;
+                out[n++] = (unsigned char)(OP_RUN | (run - 1));
+                run = 0;
             }
-            else if (strstr(options.filename, ".bmp"))
+
+            int hash = (px[0]*3 + px[1]*5 + px[2]*7 + px[3]*11) % 64;
+            if (index[hash][0] == px[0] && index[hash][1] == px[1] && index[hash][2] == px[2] && index[hash][3] == px[3])
             {
-                save_as_bmp = true;
-                save_as_png = false;
+                out[n++] = (unsigned char)(OP_INDEX | hash);
             }
             else
             {
-                save_as_bmp = false;
-                save_as_png = false;
-                // did user specify any extension at all?
+                index[hash][0] = px[0]; index[hash][1] = px[1]; index[hash][2] = px[2]; index[hash][3] = px[3];
+                if (px[3] == prev[3])
+                {
+                    signed char vr = (signed char)(px[0] - prev[0]);
+                    signed char vg = (signed char)(px[1] - prev[1]);
+                    signed char vb = (signed char)(px[2] - prev[2]);
+                    signed char vg_r = (signed char)(vr - vg);
+                    signed char vg_b = (signed char)(vb - vg);
+                    if (vr > -3 && vr < 2 && vg > -3 && vg < 2 && vb > -3 && vb < 2)
+                    {
+                        out[n++] = (unsigned char)(OP_DIFF | (vr + 2) << 4 | (vg + 2) << 2 | (vb + 2));
+                    }
+                    else if (vg_r > -9 && vg_r < 8 && vg > -33 && vg < 32 && vg_b > -9 && vg_b < 8)
+                    {
+                        out[n++] = (unsigned char)(OP_LUMA | (vg + 32));
+                        out[n++] = (unsigned char)((vg_r + 8) << 4 | (vg_b + 8));
+                    }
+                    else
+                    {
+                        out[n++] = OP_RGB;
+                        out[n++] = px[0]; out[n++] = px[1]; out[n++] = px[2];
+                    }
+                }
+                else
+                {
+                    out[n++] = OP_RGBA;
+                    out[n++] = px[0]; out[n++] = px[1]; out[n++] = px[2]; out[n++] = px[3];
+                }
             }
+            prev[0] = px[0]; prev[1] = px[1]; prev[2] = px[2]; prev[3] = px[3];
+        }
+        for (int i = 0; i < 7; i++)
+            out[n++] = 0;
+        out[n++] = 1;
 
-            // todo: what happens if filename doesn't contain a %d?
-            char filename[1024];
-            sprintf(filename, options.filename, suffix_counter);
-            suffix_counter++;
+        bool ok = false;
+        FILE *f = fopen(filename, "wb");
+        if (f)
+        {
+            ok = fwrite(out, 1, n, f) == n;
+            fclose(f);
+        }
+        free(out);
+        return ok;
+    }
 
-            if (save_as_bmp)
+    // Returns false if the image file could not be written. Frames that don't fit in a
+    // raw capture are counted by capture::Close instead.
+    static bool WriteImage(encode_job_t *job)
+    {
+        int width = job->width;
+        int height = job->height;
+        int channels = job->channels;
+        unsigned char *data = job->data;
+        if (job->format == FORMAT_RAW_CAPTURE)
+        {
+            capture::Append(job);
+            return true;
+        }
+        bool ok;
+        if (job->format == FORMAT_PNG)
+        {
+            int stride = width*channels;
+            ok = stbi_write_png(job->filename, width, height, channels, data+stride*(height-1), -stride) != 0;
+        }
+        else if (job->format == FORMAT_QOI)
+        {
+            ok = WriteQOI(job->filename, width, height, channels, data);
+        }
+        else
+        {
+            ok = stbi_write_bmp(job->filename, width, height, channels, data) != 0;
+        }
+        if (!ok)
+            fprintf(stderr, "Failed to write %s\n", job->filename);
+        else if (job->format == FORMAT_BMP && !strstr(job->filename, ".bmp"))
+            printf("Saved %s (bmp)...\n", job->filename);
+        else
+            printf("Saved %s...\n", job->filename);
+        return ok;
+    }
+
+    // Image files are encoded by a pool of worker threads, so that e.g. PNG compression does
+    // not hold up rendering. Frames are passed through a bounded queue: when it is full the
+    // render thread either waits for a free slot or drops the frame (see drop_frames).
+    // Filenames are assigned when a frame is queued, so they stay in order regardless of
+    // which thread finishes first.
+    namespace encoder
+    {
+        enum { MAX_THREADS = 16 };
+        enum { QUEUE_SIZE = VDB_FRAMEGRAB_QUEUE_SIZE };
+        static SDL_Thread *threads[MAX_THREADS];
+        static int num_threads;
+        static SDL_mutex *mutex;
+        static SDL_cond *job_queued;
+        static SDL_cond *job_taken;
+        static SDL_cond *all_done;
+        static encode_job_t queue[QUEUE_SIZE];
+        static int queue_first;
+        static int queue_count;
+        static int num_busy;
+        static bool should_quit;
+
+        static int ThreadMain(void*)
+        {
+            for (;;)
             {
-                stbi_write_bmp(filename, width, height, channels, data);
-                printf("Saved %s...\n", filename);
+                SDL_LockMutex(mutex);
+                while (queue_count == 0 && !should_quit)
+                    SDL_CondWait(job_queued, mutex);
+                if (queue_count == 0)
+                {
+                    SDL_UnlockMutex(mutex);
+                    return 0;
+                }
+                encode_job_t job = queue[queue_first];
+                queue_first = (queue_first + 1) % QUEUE_SIZE;
+                queue_count--;
+                num_busy++;
+                SDL_CondSignal(job_taken);
+                SDL_UnlockMutex(mutex);
+
+                bool written = WriteImage(&job);
+                ReleaseFrame(job.data, job.size);
+
+                SDL_LockMutex(mutex);
+                num_busy--;
+                SDL_AtomicAdd(written ? &frames_written : &frames_failed, 1);
+                if (queue_count == 0 && num_busy == 0)
+                    SDL_CondBroadcast(all_done);
+                SDL_UnlockMutex(mutex);
             }
-            else if (save_as_png)
+        }
+
+        static void Start()
+        {
+            if (num_threads > 0)
+                return;
+            mutex = SDL_CreateMutex();
+            job_queued = SDL_CreateCond();
+            job_taken = SDL_CreateCond();
+            all_done = SDL_CreateCond();
+            assert(mutex && job_queued && job_taken && all_done);
+            should_quit = false;
+
+            int n = VDB_FRAMEGRAB_ENCODER_THREADS;
+            if (n <= 0)
+                n = SDL_GetCPUCount() - 1;
+            if (n < 1) n = 1;
+            if (n > MAX_THREADS) n = MAX_THREADS;
+            for (int i = 0; i < n; i++)
             {
-                int stride = width*channels;
-                stbi_write_png(filename, width, height, channels, data+stride*(height-1), -stride);
-                printf("Saved %s...\n", filename);
+                threads[i] = SDL_CreateThread(ThreadMain, "vdb framegrab encoder", NULL);
+                assert(threads[i] && "Failed to create framegrab encoder thread");
             }
-            else
+            num_threads = n;
+        }
+
+        static void Enqueue(encode_job_t *job, bool drop_if_full)
+        {
+            Start();
+            SDL_LockMutex(mutex);
+            if (queue_count == QUEUE_SIZE)
+            {
+                if (drop_if_full)
+                {
+                    SDL_AtomicAdd(&frames_dropped, 1);
+                    SDL_UnlockMutex(mutex);
+                    ReleaseFrame(job->data, job->size);
+                    return;
+                }
+                SDL_AtomicAdd(&frames_stalled, 1);
+                while (queue_count == QUEUE_SIZE)
+                    SDL_CondWait(job_taken, mutex);
+            }
+            queue[(queue_first + queue_count) % QUEUE_SIZE] = *job;
+            queue_count++;
+            SDL_CondSignal(job_queued);
+            SDL_UnlockMutex(mutex);
+        }
+
+        static void WaitUntilDone()
+        {
+            if (num_threads == 0)
+                return;
+            SDL_LockMutex(mutex);
+            while (queue_count > 0 || num_busy > 0)
+                SDL_CondWait(all_done, mutex);
+            SDL_UnlockMutex(mutex);
+        }
+    }
+
+    // Raw frames are piped to ffmpeg by a dedicated writer thread. The render thread and the
+    // writer communicate through a single-producer single-consumer ring buffer: each index is
+    // only ever written by one side, so pushing and popping frames takes no locks. The two
+    // semaphores are only used to sleep when the queue is empty (writer) or full (renderer).
+    namespace writer
+    {
+        enum { QUEUE_SIZE = VDB_FRAMEGRAB_QUEUE_SIZE };
+        struct frame_t
+        {
+            unsigned char *data; // NULL marks the end of the stream
+            size_t size;
+        };
+        static frame_t queue[QUEUE_SIZE];
+        static SDL_atomic_t read_index; // written by the writer thread
+        static SDL_atomic_t write_index; // written by the render thread
+        static SDL_sem *frames_queued;
+        static SDL_sem *slots_free;
+        static SDL_Thread *thread;
+        static SDL_atomic_t frames_piped;
+        static SDL_atomic_t pipe_broken;
+        static FILE *pipe;
+
+        static int ThreadMain(void*)
+        {
+            #ifndef _WIN32
+            // If ffmpeg exits early (e.g. bad arguments) writing to the pipe raises SIGPIPE,
+            // which would kill the whole application. With the signal blocked in this thread
+            // fwrite fails with EPIPE instead, which we can report.
+            sigset_t sigpipe;
+            sigemptyset(&sigpipe);
+            sigaddset(&sigpipe, SIGPIPE);
+            pthread_sigmask(SIG_BLOCK, &sigpipe, NULL);
+            #endif
+
+            for (;;)
             {
-                stbi_write_bmp(filename, width, height, channels, data);
-                printf("Saved %s (bmp)...\n", filename);
+                SDL_SemWait(frames_queued);
+                int i = SDL_AtomicGet(&read_index);
+                frame_t frame = queue[i];
+                SDL_AtomicSet(&read_index, (i + 1) % QUEUE_SIZE);
+                SDL_SemPost(slots_free);
+
+                if (!frame.data)
+                    return 0;
+
+                if (!SDL_AtomicGet(&pipe_broken))
+                {
+                    if (fwrite(frame.data, 1, frame.size, pipe) == frame.size)
+                        SDL_AtomicAdd(&frames_piped, 1);
+                    else
+                        SDL_AtomicSet(&pipe_broken, 1);
+                }
+                ReleaseFrame(frame.data, frame.size);
             }
+        }
+
+        static void Push(unsigned char *data, size_t size, bool drop_if_full)
+        {
+            if (SDL_SemTryWait(slots_free) != 0)
+            {
+                if (drop_if_full && data)
+                {
+                    SDL_AtomicAdd(&frames_dropped, 1);
+                    ReleaseFrame(data, size);
+                    return;
+                }
+                SDL_AtomicAdd(&frames_stalled, 1);
+                SDL_SemWait(slots_free);
+            }
+            int i = SDL_AtomicGet(&write_index);
+            queue[i].data = data;
+            queue[i].size = size;
+            SDL_AtomicSet(&write_index, (i + 1) % QUEUE_SIZE);
+            SDL_SemPost(frames_queued);
+        }
+
+        static bool Open(const char *cmd)
+        {
+            assert(!pipe);
+            pipe = popen(cmd, VDB_POPEN_WRITE_MODE);
+            if (!pipe)
+            {
+                fprintf(stderr, "Failed to start ffmpeg: %s\n", cmd);
+                return false;
+            }
+            if (!frames_queued)
+            {
+                frames_queued = SDL_CreateSemaphore(0);
+                slots_free = SDL_CreateSemaphore(QUEUE_SIZE);
+                assert(frames_queued && slots_free);
+            }
+            SDL_AtomicSet(&read_index, 0);
+            SDL_AtomicSet(&write_index, 0);
+            SDL_AtomicSet(&frames_piped, 0);
+            SDL_AtomicSet(&pipe_broken, 0);
+            thread = SDL_CreateThread(ThreadMain, "vdb ffmpeg writer", NULL);
+            assert(thread && "Failed to create ffmpeg writer thread");
+            return true;
+        }
+
+        static void Close()
+        {
+            if (!pipe)
+                return;
+            Push(NULL, 0, false);
+            SDL_WaitThread(thread, NULL);
+            thread = NULL;
+            pclose(pipe);
+            pipe = NULL;
+            SDL_AtomicSet(&frames_written, SDL_AtomicGet(&frames_piped));
+            if (SDL_AtomicGet(&pipe_broken))
+                fprintf(stderr, "ffmpeg stopped accepting frames (see its output above). Is it installed and in your PATH?\n");
+        }
+    }
+
+    static void FormatFFmpegCommand(char *cmd, size_t cmd_size, int width, int height)
+    {
+        static const char *presets[FFMPEG_NUM_PRESETS] = { "fast", "veryfast", "ultrafast", "medium", "slow" };
+        static const int vp9_cpu_used[FFMPEG_NUM_PRESETS] = { 5, 6, 8, 4, 2 };
+        int preset = options.ffmpeg_preset;
+        if (preset < 0 || preset >= FFMPEG_NUM_PRESETS)
+            preset = FFMPEG_PRESET_FAST;
+
+        char codec[256];
+        if (options.ffmpeg_codec == FFMPEG_H265)
+            snprintf(codec, sizeof(codec), "-c:v libx265 -preset %s -crf %d -pix_fmt yuv420p", presets[preset], options.ffmpeg_crf);
+        else if (options.ffmpeg_codec == FFMPEG_VP9)
+            snprintf(codec, sizeof(codec), "-c:v libvpx-vp9 -deadline realtime -cpu-used %d -row-mt 1 -crf %d -b:v 0 -pix_fmt yuv420p", vp9_cpu_used[preset], options.ffmpeg_crf);
+        else if (options.ffmpeg_codec == FFMPEG_MPEG4)
+            snprintf(codec, sizeof(codec), "-c:v mpeg4 -q:v %d -pix_fmt yuv420p", 1 + options.ffmpeg_crf*30/51); // map crf [0,51] to qscale [1,31]
+        else if (options.ffmpeg_codec == FFMPEG_FFV1)
+            snprintf(codec, sizeof(codec), "-c:v ffv1 -level 3 -slices 16"); // keeps input pixel format
+        else
+            snprintf(codec, sizeof(codec), "-c:v libx264 -preset %s -crf %d -pix_fmt yuv420p", presets[preset], options.ffmpeg_crf);
 
-            if (mode == MODE_SEQUENCE)
+        snprintf(cmd, cmd_size, "ffmpeg -r %f -f rawvideo -pix_fmt %s -s %dx%d -i - "
+                                "-threads 0 -y %s -vf vflip \"%s\"",
+                                options.ffmpeg_fps, // -r
+                                options.alpha_channel ? "rgba" : "rgb24", // -pix_fmt
+                                width, height, // -s
+                                codec,
+                                options.filename);
+    }
+
+    static void SaveFrame(unsigned char *data,
+                          int width,
+                          int height,
+                          int channels)
+    // Takes ownership of data (a buffer from AllocateFrame).
+    {
+        if (mode == MODE_FFMPEG)
+        {
+            size_t size = (size_t)width*height*channels;
+            if (!writer::pipe)
             {
-                num_frames++;
-                if (options.video_frame_cap > 0 && num_frames == options.video_frame_cap)
+                char cmd[2048];
+                FormatFFmpegCommand(cmd, sizeof(cmd), width, height);
+                if (!writer::Open(cmd))
                 {
+                    ReleaseFrame(data, size);
                     StopRecording();
+                    return;
                 }
-                if (should_stop)
+            }
+            if (SDL_AtomicGet(&writer::pipe_broken))
+            {
+                ReleaseFrame(data, size);
+                StopRecording();
+                return;
+            }
+            writer::Push(data, size, options.drop_frames);
+        }
+        else if (mode == MODE_RAW)
+        {
+            size_t size = (size_t)width*height*channels;
+            if (!capture::base)
+            {
+                size_t capacity = (size_t)(options.raw_capacity_mb > 0 ? options.raw_capacity_mb : 1024)*1024*1024;
+                if (!capture::Open(options.filename, width, height, channels, options.raw_lz4, capacity))
                 {
-                    active = false;
+                    fprintf(stderr, "Failed to create raw capture file %s (is there enough disk space?)\n", options.filename);
+                    ReleaseFrame(data, size);
+                    StopRecording();
+                    return;
                 }
             }
-            else
+            bool size_changed = (uint32_t)width != capture::header->width || (uint32_t)height != capture::header->height;
+            if (size_changed || SDL_AtomicGet(&capture::is_full) || capture::next_frame == (int)capture::header->max_frames)
             {
-                active = false;
+                // the container holds frames of one size only, so stop if the window was resized
+                ReleaseFrame(data, size);
+                StopRecording();
+                return;
             }
+
+            encode_job_t job;
+            job.data = data;
+            job.size = size;
+            job.width = width;
+            job.height = height;
+            job.channels = channels;
+            job.format = FORMAT_RAW_CAPTURE;
+            job.filename[0] = 0;
+            job.frame_index = capture::next_frame++;
+            job.time = (double)(SDL_GetPerformanceCounter() - start_ticks)/SDL_GetPerformanceFrequency();
+            encoder::Enqueue(&job, options.drop_frames);
         }
+        else
+        {
+            encode_job_t job;
+            job.data = data;
+            job.size = (size_t)width*height*channels;
+            job.width = width;
+            job.height = height;
+            job.channels = channels;
+
+            if      (strstr(options.filename, ".png")) job.format = FORMAT_PNG;
+            else if (strstr(options.filename, ".qoi")) job.format = FORMAT_QOI;
+            else                                       job.format = FORMAT_BMP; // also if user didn't specify any extension
+
+            // todo: what happens if filename doesn't contain a %d?
+            snprintf(job.filename, sizeof(job.filename), options.filename, suffix_counter);
+            suffix_counter++;
+
+            // Only drop frames of an image sequence; a screenshot should always be saved
+            encoder::Enqueue(&job, mode == MODE_SEQUENCE && options.drop_frames);
+        }
+    }
+
+    // Reading the back buffer straight into client memory with glReadPixels forces the CPU
+    // to wait for the GPU to finish rendering the frame. Instead we read each frame into a
+    // pixel-pack buffer (the read returns immediately), and only map that buffer when its
+    // slot in the ring comes around again, VDB_FRAMEGRAB_READBACK_DELAY frames later. By
+    // then the transfer has long completed and mapping it does not stall. With a delay of
+    // 0 the buffer is mapped right after the read, which waits for the GPU.
+    struct readback_t
+    {
+        GLuint pbo;
+        size_t pbo_size;
+        bool pending;
+        int width;
+        int height;
+        int channels;
+    };
+    enum { NUM_READBACKS = VDB_FRAMEGRAB_READBACK_DELAY > 0 ? VDB_FRAMEGRAB_READBACK_DELAY : 1 };
+    static readback_t readbacks[NUM_READBACKS];
+    static int readback_index;
+
+    static void CompleteReadback(readback_t *rb)
+    {
+        assert(rb->pending);
+        size_t size = rb->width*rb->height*rb->channels;
+        unsigned char *data = AllocateFrame(size);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, rb->pbo);
+        void *mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT);
+        assert(mapped && "Failed to map framegrab pixel buffer");
+        // We copy out of the mapped buffer so that it can be unmapped (and reused by the GPU)
+        // right away, instead of staying mapped for as long as the frame takes to encode.
+        memcpy(data, mapped, size);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        rb->pending = false;
+
+        SaveFrame(data, rb->width, rb->height, rb->channels);
+    }
+
+    static void FinishFramegrab()
+    // Write out all frames still in flight and close the output.
+    {
+        for (int i = 0; i < NUM_READBACKS; i++)
+        {
+            readback_t *rb = readbacks + (readback_index + i) % NUM_READBACKS;
+            if (rb->pending)
+                CompleteReadback(rb);
+        }
+        writer::Close();
+        encoder::WaitUntilDone();
+        capture::Close();
+        SDL_LockMutex(pool_mutex);
+        FreePooledFrames();
+        SDL_UnlockMutex(pool_mutex);
+        int written = SDL_AtomicGet(&frames_written);
+        int dropped = SDL_AtomicGet(&frames_dropped);
+        int stalled = SDL_AtomicGet(&frames_stalled);
+        int failed = SDL_AtomicGet(&frames_failed);
+        if (dropped > 0 || stalled > 0)
+            printf("Framegrab: %d frames written, %d dropped, %d waited for the encoder\n", written, dropped, stalled);
+        if (failed > 0)
+            fprintf(stderr, "Framegrab: %d frames could not be written\n", failed);
+        active = false;
+    }
+
+    static void CaptureFrame(int width, int height)
+    // Queue a readback of the back framebuffer of the current frame. The oldest queued
+    // frame is written out as its slot is reused.
+    {
+        int channels = options.alpha_channel ? 4 : 3;
+        GLenum format = options.alpha_channel ? GL_RGBA : GL_RGB;
+        size_t size = width*height*channels;
+
+        readback_t *rb = readbacks + readback_index;
+        if (rb->pending)
+            CompleteReadback(rb);
+
+        if (!rb->pbo)
+            glGenBuffers(1, &rb->pbo);
+        assert(rb->pbo);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, rb->pbo);
+        if (rb->pbo_size != size)
+        {
+            glBufferData(GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ);
+            rb->pbo_size = size;
+        }
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadBuffer(GL_BACK);
+        glReadPixels(0, 0, width, height, format, GL_UNSIGNED_BYTE, 0);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        rb->pending = true;
+        rb->width = width;
+        rb->height = height;
+        rb->channels = channels;
+        readback_index = (readback_index + 1) % NUM_READBACKS;
+        if (VDB_FRAMEGRAB_READBACK_DELAY == 0)
+            CompleteReadback(rb);
+
+        num_frames++;
+        if (mode == MODE_SCREENSHOT)
+            StopRecording();
+        else if (options.video_frame_cap > 0 && num_frames == options.video_frame_cap)
+            StopRecording();
+
+        if (should_stop)
+            FinishFramegrab();
     }
 }
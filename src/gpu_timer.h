@@ -0,0 +1,168 @@
+// GPU time per draw category, shown in the main menu when GPU timing is enabled (Tools
+// menu). Each draw that vdb makes on behalf of the user (vdbEnd, vdbDrawList, vdbDrawImage,
+// vdbEndShader), the render scaler's composite pass and the ImGui overlay is wrapped in
+// a pair of timestamp queries. The results are read back a few frames later, when the
+// GPU has finished with them, so that measuring doesn't stall the pipeline.
+//
+// Timestamps are used rather than GL_TIME_ELAPSED queries because elapsed-time queries
+// can't overlap, and the render scaler already has one running around the user's
+// drawing (see render_scaler.h). Draws made inside another measured draw (e.g. log plots,
+// which are drawn from within ImGui) count towards the outer one.
+enum gpu_timer_category_t
+{
+    GPU_TIMER_POINTS = 0,
+    GPU_TIMER_LINES_THIN,
+    GPU_TIMER_LINES_THICK,
+    GPU_TIMER_TRIANGLES,
+    GPU_TIMER_IMAGES,
+    GPU_TIMER_SHADERS,
+    GPU_TIMER_COMPOSITE,
+    GPU_TIMER_IMGUI,
+    NUM_GPU_TIMER_CATEGORIES
+};
+
+struct gpu_timer_frame_t
+{
+    GLuint queries[2*VDB_GPU_TIMER_MAX_DRAWS]; // begin and end timestamp of each draw
+    uint8_t category[VDB_GPU_TIMER_MAX_DRAWS];
+    int count;
+    bool pending; // waiting for the GPU to finish
+    bool overflow; // more draws than VDB_GPU_TIMER_MAX_DRAWS were made
+};
+
+namespace gpu_timer
+{
+    enum { NUM_FRAMES = 4 };
+    static const char *category_names[NUM_GPU_TIMER_CATEGORIES] =
+    {
+        "Points", "Thin lines", "Thick lines", "Triangles",
+        "Images", "Shaders", "Render scale composite", "ImGui"
+    };
+    static bool enabled;
+    static int supported = -1; // -1: not checked yet
+    static gpu_timer_frame_t frames[NUM_FRAMES];
+    static int curr; // frame being measured
+    static bool measuring; // false while frames[curr] is still pending
+    static int depth; // of nested Begin/End pairs
+
+    // last frame read back
+    static float ms[NUM_GPU_TIMER_CATEGORIES];
+    static float total_ms;
+    static bool overflow;
+
+    static bool Supported()
+    {
+        if (supported < 0)
+        {
+            supported = timer_query::Supported() ? 1 : 0;
+            if (supported)
+            {
+                for (int i = 0; i < NUM_FRAMES; i++)
+                    glGenQueries(2*VDB_GPU_TIMER_MAX_DRAWS, frames[i].queries);
+            }
+            else
+                fprintf(stderr, "vdb: GPU timing needs GL_ARB_timer_query, which your OpenGL driver doesn't support.\n");
+        }
+        return supported == 1;
+    }
+
+    // Returns the draw to pass to End, or -1 if it is not measured.
+    static int Begin(gpu_timer_category_t category)
+    {
+        depth++;
+        if (!measuring || depth > 1)
+            return -1;
+        gpu_timer_frame_t *f = &frames[curr];
+        if (f->count == VDB_GPU_TIMER_MAX_DRAWS)
+        {
+            f->overflow = true;
+            return -1;
+        }
+        int i = f->count++;
+        f->category[i] = (uint8_t)category;
+        timer_query::QueryCounter(f->queries[2*i], GL_TIMESTAMP);
+        return i;
+    }
+
+    static void End(int i)
+    {
+        assert(depth > 0 && "Mismatched gpu_timer::Begin/End pair");
+        depth--;
+        if (i >= 0)
+            timer_query::QueryCounter(frames[curr].queries[2*i + 1], GL_TIMESTAMP);
+    }
+
+    static void ReadBack(gpu_timer_frame_t *f)
+    {
+        for (int c = 0; c < NUM_GPU_TIMER_CATEGORIES; c++)
+            ms[c] = 0.0f;
+        total_ms = 0.0f;
+        for (int i = 0; i < f->count; i++)
+        {
+            GLuint64 t0 = 0, t1 = 0;
+            timer_query::GetQueryObjectui64v(f->queries[2*i], GL_QUERY_RESULT, &t0);
+            timer_query::GetQueryObjectui64v(f->queries[2*i + 1], GL_QUERY_RESULT, &t1);
+            float dt = t1 > t0 ? (float)((t1 - t0)/1e6) : 0.0f;
+            ms[f->category[i]] += dt;
+            total_ms += dt;
+        }
+        overflow = f->overflow;
+        f->pending = false;
+    }
+
+    // Called once per frame, before swapping buffers.
+    static void EndFrame()
+    {
+        if (measuring)
+        {
+            frames[curr].pending = true;
+            curr = (curr + 1) % NUM_FRAMES;
+        }
+
+        // read back finished frames, oldest first; the newest one is shown
+        for (int k = 0; k < NUM_FRAMES; k++)
+        {
+            gpu_timer_frame_t *f = &frames[(curr + k) % NUM_FRAMES];
+            if (!f->pending)
+                continue;
+            if (f->count > 0)
+            {
+                GLuint available = 0;
+                glGetQueryObjectuiv(f->queries[2*f->count - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+                if (!available)
+                    break;
+            }
+            ReadBack(f);
+        }
+
+        // if the GPU is more than NUM_FRAMES behind, skip measuring a frame
+        measuring = enabled && Supported() && !frames[curr].pending;
+        if (measuring)
+        {
+            frames[curr].count = 0;
+            frames[curr].overflow = false;
+        }
+    }
+
+    static void Menu()
+    {
+        if (!enabled)
+            return;
+        char label[64];
+        sprintf(label, "GPU %.1f ms%s###gpu_timer", total_ms, overflow ? "+" : "");
+        if (ImGui::BeginMenu(label))
+        {
+            if (!Supported())
+                ImGui::TextDisabled("Not supported by your OpenGL driver");
+            for (int c = 0; c < NUM_GPU_TIMER_CATEGORIES; c++)
+            {
+                ImGui::Text("%s", category_names[c]);
+                ImGui::SameLine(ImGui::GetFontSize()*12.0f);
+                ImGui::Text("%6.2f ms", ms[c]);
+            }
+            if (overflow)
+                ImGui::TextDisabled("Only the first %d draws were measured", VDB_GPU_TIMER_MAX_DRAWS);
+            ImGui::EndMenu();
+        }
+    }
+}
@@ -0,0 +1,85 @@
+// In headless mode (see vdbHeadless), vdb never shows a window or waits for events.
+// Every break runs exactly once, drawing into an offscreen framebuffer of a fixed
+// size, which is then written to <output_dir>/<number>_<label>.png. This is meant for
+// batch jobs on machines without a display: window.h asks SDL for its "offscreen"
+// video driver (EGL, which works with Mesa's llvmpipe), and falls back to a hidden
+// window on the default driver.
+//
+// The output has no multisampling. The built-in render scaler is skipped, and ImGui
+// windows (vdb's or the user's) are not drawn, since both need several frames to settle.
+namespace headless
+{
+    static bool active;
+    static char output_dir[1024];
+    static int width;
+    static int height;
+    static framebuffer_t target;
+    static const char *label;
+    static int frame_number;
+    static bool frame_done; // the current break has been rendered and saved
+
+    // Lets batch jobs enable headless mode without changing code.
+    static void CheckEnvironment()
+    {
+        const char *dir = getenv("VDB_HEADLESS");
+        if (!active && dir && *dir)
+            vdbHeadless(dir, VDB_HEADLESS_WIDTH, VDB_HEADLESS_HEIGHT);
+    }
+
+    static void BeginFrame(const char *_label)
+    {
+        label = _label;
+        if (target.width != width || target.height != height)
+        {
+            FreeFramebuffer(&target);
+            target = MakeFramebuffer(width, height, GL_LINEAR, GL_LINEAR, true);
+        }
+
+        // the offscreen framebuffer stands in for the window for everything drawn this frame
+        window::framebuffer_width = window::window_width = width;
+        window::framebuffer_height = window::window_height = height;
+        EnableFramebuffer(&target);
+    }
+
+    static void EndFrame()
+    {
+        int channels = 3;
+        int stride = width*channels;
+        unsigned char *data = (unsigned char*)malloc(stride*height);
+        assert(data);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, data);
+        DisableFramebuffer(&target);
+
+        // labels are often file:line strings; keep only characters that are safe in filenames
+        char name[256];
+        int n = 0;
+        for (const char *c = label; c && *c && n < (int)sizeof(name) - 1; c++)
+        {
+            bool ok = (*c >= 'a' && *c <= 'z') || (*c >= 'A' && *c <= 'Z') || (*c >= '0' && *c <= '9') || *c == '-' || *c == '.';
+            name[n++] = ok ? *c : '_';
+        }
+        name[n] = '\0';
+
+        char filename[2048];
+        snprintf(filename, sizeof(filename), "%s/%05d_%s.png", output_dir, frame_number, name);
+        if (stbi_write_png(filename, width, height, channels, data+stride*(height-1), -stride))
+            printf("Saved %s...\n", filename);
+        else
+            fprintf(stderr, "vdb: failed to write %s\n", filename);
+        free(data);
+
+        frame_number++;
+        frame_done = true;
+    }
+}
+
+void vdbHeadless(const char *output_dir, int width, int height)
+{
+    assert(output_dir && "Specify a directory for the images");
+    assert(width > 0 && height > 0);
+    headless::active = true;
+    strncpy(headless::output_dir, output_dir, sizeof(headless::output_dir) - 1);
+    headless::width = width;
+    headless::height = height;
+}
@@ -0,0 +1,226 @@
+// The frame history keeps what recent breaks drew, so that you can go back to an
+// earlier iteration of a loop after stepping past it, without running it again.
+// The first frame of each visit to a break is recorded like in recorder.h, and its
+// command stream (see watch.h) is kept per label: XOR'ed with the previous frame of
+// the same label and LZ4-compressed, which makes unchanged parts almost free. Every
+// VDB_HISTORY_KEYFRAME_INTERVAL'th frame is stored without the delta, to bound the
+// work needed to decode any one frame. At most VDB_HISTORY_MAX_FRAMES are kept per
+// label, and while the history exceeds VDB_HISTORY_BUDGET_MB, the oldest frame of
+// the label with the most frames is dropped.
+//
+// While an older frame is shown, the calls made by the block are recorded and thrown
+// away instead of drawn (widgets still run as usual), and the older frame is replayed
+// in their place. Note that lists built by the block are
+// replaced by the older frame's lists until the next step.
+struct history_entry_t
+{
+    unsigned char *data; // LZ4 compressed
+    int size; // of data
+    int raw_size; // of the command stream
+    bool is_keyframe; // otherwise XOR'ed with the previous entry
+};
+
+struct history_label_t
+{
+    const char *label;
+    history_entry_t entries[VDB_HISTORY_MAX_FRAMES]; // oldest first
+    int count;
+    int since_keyframe;
+    watch_snapshot_t last; // the newest command stream (base for the next delta)
+};
+
+namespace history
+{
+    enum { MAX_LABELS = 64 };
+    static history_label_t labels[MAX_LABELS];
+    static int num_labels;
+    static size_t total_bytes; // compressed data in all entries
+    static history_label_t *current; // the label of the current break
+    static int viewing = -1; // index into current->entries, or -1 for the live frame
+    static bool swallowing; // recording the block's calls only to discard them
+    static watch_snapshot_t discard;
+    static watch_snapshot_t decoded; // the frame being viewed
+    static int decoded_index = -1;
+    static history_label_t *decoded_label;
+    static watch_snapshot_t temp;
+
+    static bool Enabled()
+    {
+        return settings.history && !headless::active && !watch::active && !remote::connected;
+    }
+
+    static history_label_t *Find(const char *label, bool add)
+    {
+        for (int i = 0; i < num_labels; i++)
+            if (strcmp(labels[i].label, label) == 0)
+                return labels + i;
+        if (!add || num_labels == MAX_LABELS)
+            return NULL;
+        history_label_t *h = labels + (num_labels++);
+        h->label = strdup(label);
+        return h;
+    }
+
+    static void Encode(history_entry_t *e, const unsigned char *data, int raw_size, const watch_snapshot_t *base)
+    {
+        const unsigned char *src = data;
+        if (base)
+        {
+            temp.used = 0;
+            unsigned char *delta = watch::Reserve(raw_size, &temp);
+            memcpy(delta, data, raw_size);
+            int n = raw_size < (int)base->used ? raw_size : (int)base->used;
+            for (int i = 0; i < n; i++)
+                delta[i] ^= base->data[i];
+            src = delta;
+        }
+        e->data = (unsigned char*)malloc(lz4::CompressBound(raw_size));
+        assert(e->data && "Ran out of memory for frame history");
+        e->size = lz4::Compress(src, raw_size, e->data);
+        e->raw_size = raw_size;
+        e->is_keyframe = base == NULL;
+        total_bytes += e->size;
+    }
+
+    // Decodes entries[index] into result.
+    static void Decode(history_label_t *h, int index, watch_snapshot_t *result)
+    {
+        int first = index;
+        while (first > 0 && !h->entries[first].is_keyframe)
+            first--;
+        for (int i = first; i <= index; i++)
+        {
+            history_entry_t *e = h->entries + i;
+            temp.used = 0;
+            unsigned char *raw = watch::Reserve(e->raw_size, &temp);
+            int n = lz4::Decompress(e->data, e->size, raw, e->raw_size);
+            assert(n == e->raw_size && "Corrupt frame history");
+            (void)n;
+            if (!e->is_keyframe)
+            {
+                int m = e->raw_size < (int)result->used ? e->raw_size : (int)result->used;
+                for (int j = 0; j < m; j++)
+                    raw[j] ^= result->data[j];
+            }
+            result->used = 0;
+            memcpy(watch::Reserve(e->raw_size, result), raw, e->raw_size);
+        }
+    }
+
+    static void DropOldest(history_label_t *h)
+    {
+        if (h->count > 1 && !h->entries[1].is_keyframe)
+        {
+            // the next entry becomes the oldest, so it must no longer depend on this one
+            watch_snapshot_t raw = {0};
+            Decode(h, 1, &raw);
+            total_bytes -= h->entries[1].size;
+            free(h->entries[1].data);
+            Encode(h->entries + 1, raw.data, (int)raw.used, NULL);
+            free(raw.data);
+        }
+        total_bytes -= h->entries[0].size;
+        free(h->entries[0].data);
+        memmove(h->entries, h->entries + 1, (h->count - 1)*sizeof(history_entry_t));
+        h->count--;
+        if (decoded_label == h)
+            decoded_index = -1;
+        if (current == h && viewing >= 0)
+            viewing = viewing > 0 ? viewing - 1 : -1;
+    }
+
+    static void Clear()
+    {
+        for (int i = 0; i < num_labels; i++)
+            while (labels[i].count > 0)
+                DropOldest(labels + i);
+        viewing = -1;
+    }
+
+    // Adds the first frame of a break, recorded by the recorder.
+    static void Push(const watch_snapshot_t *frame)
+    {
+        history_label_t *h = Find(frame->label ? frame->label : "", true);
+        if (!h)
+            return;
+        if (h->count == VDB_HISTORY_MAX_FRAMES)
+            DropOldest(h);
+
+        bool keyframe = h->count == 0 || h->since_keyframe + 1 >= VDB_HISTORY_KEYFRAME_INTERVAL;
+        Encode(h->entries + h->count, frame->data, (int)frame->used, keyframe ? NULL : &h->last);
+        h->count++;
+        h->since_keyframe = keyframe ? 0 : h->since_keyframe + 1;
+        h->last.used = 0;
+        memcpy(watch::Reserve(frame->used, &h->last), frame->data, frame->used);
+
+        // stay within the budget by dropping the oldest frames, but keep one per label
+        while (total_bytes > (size_t)VDB_HISTORY_BUDGET_MB*1024*1024)
+        {
+            history_label_t *oldest = NULL;
+            for (int i = 0; i < num_labels; i++)
+                if (labels[i].count > 1 && (!oldest || labels[i].count > oldest->count))
+                    oldest = labels + i;
+            if (!oldest)
+                break;
+            DropOldest(oldest);
+        }
+    }
+
+    // Called at the end of vdbBeginBreak.
+    static void BeginFrame(const char *label, bool is_first_frame)
+    {
+        current = Enabled() ? Find(label, false) : NULL;
+        if (is_first_frame || !current)
+            viewing = -1;
+        if (viewing >= 0)
+        {
+            discard.used = 0;
+            watch::destination = &discard;
+            watch::recording = true;
+            watch::passthrough = false;
+            swallowing = true;
+        }
+    }
+
+    // Called at the start of vdbEndBreak: draws the frame being viewed instead.
+    static void EndFrame()
+    {
+        watch::recording = false;
+        swallowing = false;
+        if (decoded_label != current || decoded_index != viewing)
+        {
+            decoded.used = 0;
+            Decode(current, viewing, &decoded);
+            decoded_label = current;
+            decoded_index = viewing;
+        }
+        watch::Replay(&decoded);
+    }
+
+    static void Timeline()
+    {
+        if (!current || current->count < 2)
+            return;
+        ImGuiIO &io = ImGui::GetIO();
+        ImGui::SetNextWindowPos(ImVec2(io.DisplaySize.x*0.5f, io.DisplaySize.y - 10.0f), ImGuiCond_Always, ImVec2(0.5f, 1.0f));
+        ImGui::SetNextWindowBgAlpha(0.5f);
+        ImGuiWindowFlags flags =
+            ImGuiWindowFlags_NoTitleBar |
+            ImGuiWindowFlags_NoResize |
+            ImGuiWindowFlags_NoMove |
+            ImGuiWindowFlags_NoSavedSettings |
+            ImGuiWindowFlags_AlwaysAutoResize;
+        ImGui::Begin("History##vdb", NULL, flags);
+        int live = current->count - 1;
+        int index = viewing >= 0 ? viewing : live;
+        ImGui::PushItemWidth(300.0f);
+        const char *format = index == live ? "Live" : "%d";
+        if (ImGui::SliderInt("History", &index, 0, live, format))
+            viewing = index == live ? -1 : index;
+        ImGui::PopItemWidth();
+        if (ImGui::IsItemHovered())
+            ImGui::SetTooltip("Earlier frames of this break (%d kept, %.1f MB total).\nStepping returns to the live frame.",
+                current->count, total_bytes/(1024.0*1024.0));
+        ImGui::End();
+    }
+}
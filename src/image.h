@@ -130,11 +130,13 @@ void vdbLoadImage(int slot,
                  data_type,
                  data);
     glBindTexture(GL_TEXTURE_2D, 0);
+    frame_stats::TextureUpload(width, height, data_format, data_type);
 }
 
 void vdbLoadImageUint8(int slot, const void *data, int width, int height, int channels)
 {
     assert(channels >= 1 && channels <= 4 && "'channels' must be 1,2,3 or 4");
+    if (watch::recording && watch::RecordImage(slot, data, width, height, channels, false)) return;
     if      (channels == 1) vdbLoadImage(slot, data, width, height, GL_RED, GL_UNSIGNED_BYTE);
     else if (channels == 2) vdbLoadImage(slot, data, width, height, GL_RG, GL_UNSIGNED_BYTE);
     else if (channels == 3) vdbLoadImage(slot, data, width, height, GL_RGB, GL_UNSIGNED_BYTE);
@@ -145,6 +147,7 @@ void vdbLoadImageUint8(int slot, const void *data, int width, int height, int ch
 void vdbLoadImageFloat32(int slot, const void *data, int width, int height, int channels)
 {
     assert(channels >= 1 && channels <= 4 && "'channels' must be 1,2,3 or 4");
+    if (watch::recording && watch::RecordImage(slot, data, width, height, channels, true)) return;
     if      (channels == 1) vdbLoadImage(slot, data, width, height, GL_RED, GL_FLOAT);
     else if (channels == 2) vdbLoadImage(slot, data, width, height, GL_RG, GL_FLOAT);
     else if (channels == 3) vdbLoadImage(slot, data, width, height, GL_RGB, GL_FLOAT);
@@ -152,6 +155,15 @@ void vdbLoadImageFloat32(int slot, const void *data, int width, int height, int
     GetImage(slot)->channels = channels;
 }
 
+static void BindImage(int slot, vdbTextureFilter filter, vdbTextureWrap wrap, vdbVec4 v_min, vdbVec4 v_max)
+{
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, GetImage(slot)->handle);
+    vdbSetTextureParameters(filter, wrap);
+    GetImage(slot)->v_min = v_min;
+    GetImage(slot)->v_max = v_max;
+}
+
 void vdbDrawImage(int slot,
     float x, float y,
     float w, float h,
@@ -160,6 +172,19 @@ void vdbDrawImage(int slot,
     vdbVec4 v_min,
     vdbVec4 v_max)
 {
+    if (watch::recording)
+    {
+        unsigned char args[5*4 + 2*4 + 2*sizeof(vdbVec4)];
+        float rect[] = { x, y, w, h };
+        memcpy(args + 0, &slot, 4);
+        memcpy(args + 4, rect, sizeof(rect));
+        memcpy(args + 20, &filter, 4);
+        memcpy(args + 24, &wrap, 4);
+        memcpy(args + 28, &v_min, sizeof(vdbVec4));
+        memcpy(args + 28 + sizeof(vdbVec4), &v_max, sizeof(vdbVec4));
+        if (watch::Record(WATCH_DRAW_IMAGE, args, sizeof(args))) return;
+    }
+
     static GLuint program = LoadShaderFromMemory(shader_image_vs, shader_image_fs);
     assert(program);
     static GLint attrib_quad_pos  = glGetAttribLocation(program, "quad_pos");
@@ -188,7 +213,7 @@ void vdbDrawImage(int slot,
 
     // primary texture
     // glActiveTexture(GL_TEXTURE0);
-    vdbBindImage(slot, filter, wrap, v_min, v_max);
+    BindImage(slot, filter, wrap, v_min, v_max);
     glUniform1i(uniform_sampler0, 0);
 
     // colormap texture
@@ -226,7 +251,10 @@ void vdbDrawImage(int slot,
     glBindBuffer(GL_ARRAY_BUFFER, vbo);
     glEnableVertexAttribArray(attrib_quad_pos);
     glVertexAttribPointer(attrib_quad_pos, 2, GL_FLOAT, GL_FALSE, 0, 0);
+    frame_stats::Draw(program, 6);
+    int timer = gpu_timer::Begin(GPU_TIMER_IMAGES);
     glDrawArrays(GL_TRIANGLES, 0, 6);
+    gpu_timer::End(timer);
 
     // cleanup
     glDisableVertexAttribArray(attrib_quad_pos);
@@ -239,14 +267,21 @@ void vdbDrawImage(int slot,
 
 void vdbBindImage(int slot, vdbTextureFilter filter, vdbTextureWrap wrap, vdbVec4 v_min, vdbVec4 v_max)
 {
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, GetImage(slot)->handle);
-    vdbSetTextureParameters(filter, wrap);
-    GetImage(slot)->v_min = v_min;
-    GetImage(slot)->v_max = v_max;
+    if (watch::recording)
+    {
+        unsigned char args[3*4 + 2*sizeof(vdbVec4)];
+        memcpy(args + 0, &slot, 4);
+        memcpy(args + 4, &filter, 4);
+        memcpy(args + 8, &wrap, 4);
+        memcpy(args + 12, &v_min, sizeof(vdbVec4));
+        memcpy(args + 12 + sizeof(vdbVec4), &v_max, sizeof(vdbVec4));
+        if (watch::Record(WATCH_BIND_IMAGE, args, sizeof(args))) return;
+    }
+    BindImage(slot, filter, wrap, v_min, v_max);
 }
 
 void vdbUnbindImage()
 {
+    if (watch::recording && watch::Record(WATCH_UNBIND_IMAGE)) return;
     glBindTexture(GL_TEXTURE_2D, 0);
 }
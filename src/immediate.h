@@ -239,7 +239,8 @@ static void DrawImmediatePoints(imm_list_t list)
 
     // set uniforms
     {
-        UniformMat4(uniform_projection, 1, transform::projection);
+        vdbMat4 projection = transform::TiledProjection();
+        UniformMat4(uniform_projection, 1, projection);
         UniformMat4(uniform_model_to_view, 1, transform::view_model);
         glUniform1i(uniform_sampler0, 0); // We assume any user-bound texture is bound to GL_TEXTURE0
         if (!list.texel_specified)
@@ -300,6 +301,7 @@ static void DrawImmediatePoints(imm_list_t list)
             {
                 glBindBuffer(GL_ARRAY_BUFFER, point_geometry_vbo);
                 glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(quad), quad);
+                frame_stats::BufferUpload(sizeof(quad), false);
                 glBindBuffer(GL_ARRAY_BUFFER, 0);
                 rasterization_mode = GL_TRIANGLES;
                 rasterization_count = 6;
@@ -314,6 +316,7 @@ static void DrawImmediatePoints(imm_list_t list)
                 }
                 glBindBuffer(GL_ARRAY_BUFFER, point_geometry_vbo);
                 glBufferSubData(GL_ARRAY_BUFFER, 0, (imm.state.point_segments+2)*sizeof(vdbVec2), circle);
+                frame_stats::BufferUpload((imm.state.point_segments+2)*sizeof(vdbVec2), false);
                 glBindBuffer(GL_ARRAY_BUFFER, 0);
                 rasterization_mode = GL_TRIANGLE_FAN;
                 rasterization_count = imm.state.point_segments+2;
@@ -344,7 +347,10 @@ static void DrawImmediatePoints(imm_list_t list)
     glEnableVertexAttribArray(attrib_in_position);
     glVertexAttribPointer(attrib_in_position, 2, GL_FLOAT, GL_FALSE, 0, (const void*)(0));
 
+    frame_stats::Draw(program, list.count);
+    int timer = gpu_timer::Begin(GPU_TIMER_POINTS);
     glDrawArraysInstanced(rasterization_mode, 0, (GLsizei)rasterization_count, (GLsizei)list.count);
+    gpu_timer::End(timer);
 
     glDisableVertexAttribArray(attrib_in_position);
     glDisableVertexAttribArray(attrib_instance_position);
@@ -381,7 +387,10 @@ static void DrawImmediateLinesThin(imm_list_t list)
     glVertexAttribPointer(attrib_position, 4, GL_FLOAT, GL_FALSE, sizeof(imm_vertex_t), (const void*)(0));
     glVertexAttribPointer(attrib_texel,    2, GL_FLOAT, GL_FALSE, sizeof(imm_vertex_t), (const void*)(4*sizeof(float)));
     glVertexAttribPointer(attrib_color,    4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(imm_vertex_t), (const void*)(6*sizeof(float)));
+    frame_stats::Draw(program, list.count);
+    int timer = gpu_timer::Begin(GPU_TIMER_LINES_THIN);
     glDrawArrays(GL_LINES, 0, (GLsizei)list.count);
+    gpu_timer::End(timer);
     glDisableVertexAttribArray(attrib_position);
     glDisableVertexAttribArray(attrib_texel);
     glDisableVertexAttribArray(attrib_color);
@@ -422,7 +431,8 @@ static void DrawImmediateLinesThick(imm_list_t list)
 
     // set uniforms
     {
-        UniformMat4(uniform_projection, 1, transform::projection);
+        vdbMat4 projection = transform::TiledProjection();
+        UniformMat4(uniform_projection, 1, projection);
         UniformMat4(uniform_model_to_view, 1, transform::view_model);
         glUniform1i(uniform_sampler0, 0); // We assume any user-bound texture is bound to GL_TEXTURE0
         if (!list.texel_specified)
@@ -505,7 +515,10 @@ static void DrawImmediateLinesThick(imm_list_t list)
     glEnableVertexAttribArray(attrib_in_position);
     glVertexAttribPointer(attrib_in_position, 2, GL_FLOAT, GL_FALSE, 0, (const void*)(0));
 
+    frame_stats::Draw(program, list.count);
+    int timer = gpu_timer::Begin(GPU_TIMER_LINES_THICK);
     glDrawArraysInstanced(rasterization_mode, 0, (GLsizei)rasterization_count, (GLsizei)list.count/2);
+    gpu_timer::End(timer);
 
     glDisableVertexAttribArray(attrib_in_position);
 
@@ -572,7 +585,10 @@ static void DrawImmediateTriangles(imm_list_t list)
     glVertexAttribPointer(attrib_position, 4, GL_FLOAT, GL_FALSE, sizeof(imm_vertex_t), (const void*)(0));
     glVertexAttribPointer(attrib_texel,    2, GL_FLOAT, GL_FALSE, sizeof(imm_vertex_t), (const void*)(4*sizeof(float)));
     glVertexAttribPointer(attrib_color,    4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(imm_vertex_t), (const void*)(6*sizeof(float)));
+    frame_stats::Draw(program, list.count);
+    int timer = gpu_timer::Begin(GPU_TIMER_TRIANGLES);
     glDrawArrays(GL_TRIANGLES, 0, (GLsizei)list.count);
+    gpu_timer::End(timer);
     glDisableVertexAttribArray(attrib_position);
     glDisableVertexAttribArray(attrib_texel);
     glDisableVertexAttribArray(attrib_color);
@@ -593,6 +609,7 @@ static void DrawImmediate(imm_list_t list)
 
 void vdbEnd()
 {
+    if (watch::recording && watch::Record(WATCH_END)) return;
     assert(imm.initialized);
     assert(imm.inside_begin_end && "Missing vdbBegin before vdbEnd");
 
@@ -619,12 +636,14 @@ void vdbEnd()
     if (list->vbo_capacity >= imm.count)
     {
         glBufferSubData(GL_ARRAY_BUFFER, 0, imm.count*sizeof(imm_vertex_t), (const GLvoid*)imm.buffer);
+        frame_stats::BufferUpload(imm.count*sizeof(imm_vertex_t), false);
     }
     else
     {
         // We don't need to call glDeleteBuffers as per spec: "BufferData deletes any existing data store"
         glBufferData(GL_ARRAY_BUFFER, imm.count*sizeof(imm_vertex_t), (const GLvoid*)imm.buffer, vbo_mode);
         list->vbo_capacity = imm.count;
+        frame_stats::BufferUpload(imm.count*sizeof(imm_vertex_t), true);
     }
     glBindBuffer(GL_ARRAY_BUFFER, 0);
     list->texel_specified = imm.texel_specified;
@@ -640,6 +659,7 @@ void vdbEnd()
 
 void vdbBeginList(int slot)
 {
+    if (watch::recording && watch::Record(WATCH_BEGIN_LIST, &slot, sizeof(slot))) return;
     assert(slot >= 0 && slot < IMM_MAX_LISTS);
     assert(imm.current_list == NULL);
     imm.current_list = imm.user_lists + slot;
@@ -647,12 +667,14 @@ void vdbBeginList(int slot)
 
 void vdbDrawList(int slot)
 {
+    if (watch::recording && watch::Record(WATCH_DRAW_LIST, &slot, sizeof(slot))) return;
     assert(slot >= 0 && slot < IMM_MAX_LISTS);
     DrawImmediate(imm.user_lists[slot]);
 }
 
 void vdbTexel(float u, float v)
 {
+    if (watch::recording) { float args[] = {u,v}; if (watch::Record(WATCH_TEXEL, args, sizeof(args))) return; }
     assert(imm.inside_begin_end && "vdbTexel cannot be called outside vdbBegin/vdbEnd block");
     imm.texel_specified = true;
     imm.vertex.texel[0] = u;
@@ -661,6 +683,7 @@ void vdbTexel(float u, float v)
 
 void vdbColor4ub(unsigned char r, unsigned char g, unsigned char b, unsigned char a)
 {
+    if (watch::recording) { unsigned char args[] = {r,g,b,a}; if (watch::Record(WATCH_COLOR, args, sizeof(args))) return; }
     imm.vertex.color[0] = (GLubyte)(r);
     imm.vertex.color[1] = (GLubyte)(g);
     imm.vertex.color[2] = (GLubyte)(b);
@@ -669,6 +692,7 @@ void vdbColor4ub(unsigned char r, unsigned char g, unsigned char b, unsigned cha
 
 void vdbColor(float r, float g, float b, float a)
 {
+    if (watch::recording) { vdbColor4ub((GLubyte)(255*r), (GLubyte)(255*g), (GLubyte)(255*b), (GLubyte)(255*a)); return; }
     imm.vertex.color[0] = (GLubyte)(255*r);
     imm.vertex.color[1] = (GLubyte)(255*g);
     imm.vertex.color[2] = (GLubyte)(255*b);
@@ -677,6 +701,7 @@ void vdbColor(float r, float g, float b, float a)
 
 void vdbVertex(float x, float y, float z, float w)
 {
+    if (watch::recording) { float args[] = {x,y,z,w}; if (watch::Record(WATCH_VERTEX, args, sizeof(args))) return; }
     assert(imm.inside_begin_end && "vdbVertex cannot be called outside vdbBegin/vdbEnd block");
     assert(imm.count < imm.buffer_capacity);
     imm.vertex.position[0] = x;
@@ -698,14 +723,14 @@ void vdbVertex(float x, float y, float z, float w)
     }
 }
 
-void vdbLineWidth(float width)                       { imm.state.line_width = width; imm.state.line_width_is_3D = false; }
-void vdbLineWidth3D(float width)                     { imm.state.line_width = width; imm.state.line_width_is_3D = true; }
-void vdbPointSize(float size)                        { imm.state.point_size = size; imm.state.point_size_is_3D = false; }
-void vdbPointSize3D(float size)                      { imm.state.point_size = size; imm.state.point_size_is_3D = true; }
-void vdbPointSegments(int segments)                  { assert(segments >= 3); imm.state.point_segments = segments; }
-void vdbBeginTriangles()                             { BeginImmediate(IMM_PRIM_TRIANGLES); }
-void vdbBeginLines()                                 { BeginImmediate(IMM_PRIM_LINES); }
-void vdbBeginPoints()                                { BeginImmediate(IMM_PRIM_POINTS); }
+void vdbLineWidth(float width)                       { if (watch::recording && watch::RecordSize(WATCH_LINE_WIDTH, width, false)) return; imm.state.line_width = width; imm.state.line_width_is_3D = false; }
+void vdbLineWidth3D(float width)                     { if (watch::recording && watch::RecordSize(WATCH_LINE_WIDTH, width, true)) return; imm.state.line_width = width; imm.state.line_width_is_3D = true; }
+void vdbPointSize(float size)                        { if (watch::recording && watch::RecordSize(WATCH_POINT_SIZE, size, false)) return; imm.state.point_size = size; imm.state.point_size_is_3D = false; }
+void vdbPointSize3D(float size)                      { if (watch::recording && watch::RecordSize(WATCH_POINT_SIZE, size, true)) return; imm.state.point_size = size; imm.state.point_size_is_3D = true; }
+void vdbPointSegments(int segments)                  { assert(segments >= 3); if (watch::recording && watch::Record(WATCH_POINT_SEGMENTS, &segments, sizeof(segments))) return; imm.state.point_segments = segments; }
+void vdbBeginTriangles()                             { if (watch::recording && watch::Record(WATCH_BEGIN_TRIANGLES)) return; BeginImmediate(IMM_PRIM_TRIANGLES); }
+void vdbBeginLines()                                 { if (watch::recording && watch::Record(WATCH_BEGIN_LINES)) return; BeginImmediate(IMM_PRIM_LINES); }
+void vdbBeginPoints()                                { if (watch::recording && watch::Record(WATCH_BEGIN_POINTS)) return; BeginImmediate(IMM_PRIM_POINTS); }
 
 // convenience functions
 static void vdbVertex(vdbVec3 v, float w)            { vdbVertex(v.x, v.y, v.z, w); }
@@ -722,6 +747,7 @@ void vdbColor3fv(float *v, float a)                  { vdbColor(v[0], v[1], v[2]
 
 void vdbInverseColor(bool enable)
 {
+    if (watch::recording) { int args = enable; if (watch::Record(WATCH_INVERSE_COLOR, &args, sizeof(args))) return; }
     if (enable)
     {
         glLogicOp(GL_XOR);
@@ -736,6 +762,7 @@ void vdbInverseColor(bool enable)
 
 void vdbClearColor(float r, float g, float b, float a)
 {
+    if (watch::recording) { float args[] = {r,g,b,a}; if (watch::Record(WATCH_CLEAR_COLOR, args, sizeof(args))) return; }
     if (!current_framebuffer)
     {
         immediate::clear_color_was_set = true;
@@ -747,46 +774,53 @@ void vdbClearColor(float r, float g, float b, float a)
 
 void vdbClearDepth(float d)
 {
+    if (watch::recording && watch::Record(WATCH_CLEAR_DEPTH, &d, sizeof(d))) return;
     glClearDepth(d);
     glClear(GL_DEPTH_BUFFER_BIT);
 }
 
 void vdbCullFace(bool enabled)
 {
+    if (watch::recording) { int args = enabled; if (watch::Record(WATCH_CULL_FACE, &args, sizeof(args))) return; }
     if (enabled) glEnable(GL_CULL_FACE);
     else glDisable(GL_CULL_FACE);
 }
 
 void vdbBlendNone()
 {
+    if (watch::recording && watch::Record(WATCH_BLEND_NONE)) return;
     glDisable(GL_BLEND);
 }
 
 void vdbBlendAdd()
 {
+    if (watch::recording && watch::Record(WATCH_BLEND_ADD)) return;
     glEnable(GL_BLEND);
     glBlendFunc(GL_ONE, GL_ONE);
 }
 
 void vdbBlendAlpha()
 {
+    if (watch::recording && watch::Record(WATCH_BLEND_ALPHA)) return;
     glEnable(GL_BLEND);
     glBlendEquation(GL_FUNC_ADD);
     glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ONE);
 }
 
-void vdbDepthFuncAlways() { glDepthFunc(GL_ALWAYS); }
-void vdbDepthFuncLess() { glDepthFunc(GL_LESS); }
-void vdbDepthFuncLessOrEqual() { glDepthFunc(GL_LEQUAL); }
+void vdbDepthFuncAlways() { if (watch::recording && watch::Record(WATCH_DEPTH_FUNC_ALWAYS)) return; glDepthFunc(GL_ALWAYS); }
+void vdbDepthFuncLess() { if (watch::recording && watch::Record(WATCH_DEPTH_FUNC_LESS)) return; glDepthFunc(GL_LESS); }
+void vdbDepthFuncLessOrEqual() { if (watch::recording && watch::Record(WATCH_DEPTH_FUNC_LEQUAL)) return; glDepthFunc(GL_LEQUAL); }
 
 void vdbDepthTest(bool enabled)
 {
+    if (watch::recording) { int args = enabled; if (watch::Record(WATCH_DEPTH_TEST, &args, sizeof(args))) return; }
     if (enabled) glEnable(GL_DEPTH_TEST);
     else glDisable(GL_DEPTH_TEST);
 }
 
 void vdbDepthWrite(bool enabled)
 {
+    if (watch::recording) { int args = enabled; if (watch::Record(WATCH_DEPTH_WRITE, &args, sizeof(args))) return; }
     if (enabled) { glDepthMask(GL_TRUE); glDepthRange(0.0f, 1.0f); }
     else { glDepthMask(GL_FALSE); }
 }
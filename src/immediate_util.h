@@ -9,6 +9,17 @@ namespace immediate_util
 
 void vdbNoteV(float x, float y, const char *fmt, va_list args)
 {
+    if (watch::recording)
+    {
+        // the arguments are used again below if the recorded call also runs
+        va_list copy;
+        va_copy(copy, args);
+        bool recorded_only = watch::RecordNote(x, y, fmt, copy);
+        va_end(copy);
+        if (recorded_only)
+            return;
+    }
+
     // Transform position to window coordinates
     vdbVec2 ndc = vdbModelToNDC(x,y,0.0f,1.0f);
     vdbVec2 win = vdbNDCToWindow(ndc.x,ndc.y);
@@ -1,5 +1,6 @@
 #pragma once
 #include <vector>
+#include <new>
 typedef int log_type_t;
 enum log_type_
 {
@@ -8,65 +9,339 @@ enum log_type_
     log_type_matrix
 };
 
+// The samples of a scalar log. Only the newest VDB_LOG_MAX_SAMPLES are kept, in a
+// ring buffer that grows as needed up to that size. For plotting, a pyramid of
+// min/max values is updated on every append: level k holds the min and max of each
+// aligned block of 2^(k+MIN_SHIFT) samples, so the min/max of any range can be found
+// by reading O(log n) blocks rather than every sample in it.
+struct log_series_t
+{
+    enum { MIN_SHIFT = 3, MAX_LEVELS = 32 };
+    float *samples; // ring buffer
+    size_t capacity; // of samples (power of two)
+    uint64_t total; // number of samples ever appended
+    float *mins[MAX_LEVELS]; // indexed by block number & (blocks per level - 1)
+    float *maxs[MAX_LEVELS];
+    size_t blocks[MAX_LEVELS]; // blocks per level (power of two, so that appending doesn't divide)
+    int levels;
+
+    size_t Count() { return total < capacity ? (size_t)total : capacity; }
+    uint64_t First() { return total - Count(); } // absolute index of the oldest sample
+    float Get(uint64_t i) { return samples[i & (capacity - 1)]; } // absolute index
+    float Last() { return Get(total - 1); }
+
+    // Updates the pyramid with sample i (absolute index), which must be the newest.
+    void UpdateLevels(uint64_t i, float x)
+    {
+        for (int k = 0; k < levels; k++)
+        {
+            int shift = k + MIN_SHIFT;
+            size_t b = (size_t)(i >> shift) & (blocks[k] - 1);
+            if ((i & ((1ull << shift) - 1)) == 0)
+            {
+                mins[k][b] = x;
+                maxs[k][b] = x;
+            }
+            else
+            {
+                if (x < mins[k][b]) mins[k][b] = x;
+                if (x > maxs[k][b]) maxs[k][b] = x;
+            }
+        }
+    }
+
+    // Grows the ring buffer (which has not wrapped yet) and rebuilds the pyramid.
+    void Grow(size_t new_capacity)
+    {
+        samples = (float*)realloc(samples, new_capacity*sizeof(float));
+        assert(samples && "Ran out of memory for logs");
+        capacity = new_capacity;
+        for (int k = 0; k < levels; k++)
+        {
+            free(mins[k]);
+            free(maxs[k]);
+        }
+        levels = 0;
+        while (levels < MAX_LEVELS && ((size_t)1 << (levels + MIN_SHIFT)) <= capacity)
+        {
+            size_t n = 1;
+            while (n < (capacity >> (levels + MIN_SHIFT)) + 2) // the blocks at both ends may be partial
+                n *= 2;
+            blocks[levels] = n;
+            mins[levels] = (float*)malloc(n*sizeof(float));
+            maxs[levels] = (float*)malloc(n*sizeof(float));
+            assert(mins[levels] && maxs[levels] && "Ran out of memory for logs");
+            levels++;
+        }
+        for (uint64_t i = 0; i < total; i++)
+            UpdateLevels(i, samples[i]);
+    }
+
+    void Append(float x)
+    {
+        if (total >= capacity && capacity < (size_t)(VDB_LOG_MAX_SAMPLES))
+        {
+            size_t new_capacity = capacity ? 2*capacity : 1024;
+            while (new_capacity > (size_t)(VDB_LOG_MAX_SAMPLES))
+                new_capacity /= 2;
+            if (new_capacity > capacity)
+                Grow(new_capacity);
+        }
+        samples[total & (capacity - 1)] = x;
+        UpdateLevels(total, x);
+        total++;
+    }
+
+    // Min and max of the samples with absolute indices in [a, b), which must be kept.
+    void MinMax(uint64_t a, uint64_t b, float *out_min, float *out_max)
+    {
+        float lo = FLT_MAX;
+        float hi = -FLT_MAX;
+        while (a < b)
+        {
+            // the largest aligned block that starts at a and ends before b
+            int k = levels - 1;
+            while (k >= 0 && ((a & ((1ull << (k + MIN_SHIFT)) - 1)) != 0 || a + (1ull << (k + MIN_SHIFT)) > b))
+                k--;
+            if (k < 0)
+            {
+                float x = Get(a);
+                if (x < lo) lo = x;
+                if (x > hi) hi = x;
+                a++;
+            }
+            else
+            {
+                size_t i = (size_t)(a >> (k + MIN_SHIFT)) & (blocks[k] - 1);
+                if (mins[k][i] < lo) lo = mins[k][i];
+                if (maxs[k][i] > hi) hi = maxs[k][i];
+                a += 1ull << (k + MIN_SHIFT);
+            }
+        }
+        *out_min = lo;
+        *out_max = hi;
+    }
+
+    // Writes at most 2*width values to out for plotting the kept samples: the samples
+    // themselves if there are few enough, otherwise the min and max of each of width
+    // equally large ranges, interleaved. Returns the number of values written.
+    int Plot(float *out, int width)
+    {
+        uint64_t first = First();
+        size_t count = Count();
+        if (count <= (size_t)(2*width))
+        {
+            for (size_t i = 0; i < count; i++)
+                out[i] = Get(first + i);
+            return (int)count;
+        }
+        for (int x = 0; x < width; x++)
+        {
+            uint64_t a = first + (uint64_t)count*x/width;
+            uint64_t b = first + (uint64_t)count*(x + 1)/width;
+            MinMax(a, b, out + 2*x, out + 2*x + 1);
+        }
+        return 2*width;
+    }
+};
+
 struct log_t
 {
-    const char *label;
+    const char *label; // copied into the arena
+    uint32_t id; // index in logs_t::nodes
+    uint32_t index; // in parent->children
     log_t *parent;
     log_type_t type;
     std::vector<log_t*> children;
-    std::vector<float> data;
+    log_series_t series; // for scalar types
+    std::vector<float> data; // for matrix types
     int rows, columns; // for matrix types
                        // note: matrix data is always column-major
+
+    // labelled children, by hash of label and type (open addressing, NULL = empty)
+    log_t **table;
+    uint32_t *table_hashes;
+    int table_capacity; // power of two
+    int table_count;
+};
+
+// Log nodes and labels are allocated in blocks and live until the program exits.
+struct log_arena_t
+{
+    enum { BLOCK_SIZE = 64*1024 };
+    char *block;
+    size_t used;
+
+    void *Alloc(size_t size)
+    {
+        size = (size + 15) & ~(size_t)15;
+        if (size > BLOCK_SIZE/4)
+        {
+            void *p = malloc(size);
+            assert(p && "Ran out of memory for logs");
+            return p;
+        }
+        if (!block || used + size > BLOCK_SIZE)
+        {
+            block = (char*)malloc(BLOCK_SIZE);
+            assert(block && "Ran out of memory for logs");
+            used = 0;
+        }
+        void *p = block + used;
+        used += size;
+        return p;
+    }
+
+    const char *CopyString(const char *s, size_t length)
+    {
+        char *copy = (char*)Alloc(length + 1);
+        memcpy(copy, s, length);
+        copy[length] = '\0';
+        return copy;
+    }
+};
+
+// A query of the log tree (see logs_t::Resolve) that keeps its result between frames.
+// A query is a path of labels or child indices, like "/iter/3/loss", and may use *
+// to match any child, like "/iter/*/loss". A path without * is only looked up again
+// when logs are created. Logs are only created, never removed, so a query with * is
+// only tested against the logs created since the last time. Child indices in a query
+// with * must not be negative.
+struct log_query_t
+{
+    enum { MAX_TEXT = 1024, MAX_TERMS = 32 };
+    char text[MAX_TEXT];
+    int num_terms; // -1 if the query is not a valid path
+    const char *terms[MAX_TERMS]; // into text, each ends at '/' or '\0'
+    bool wildcard;
+    uint32_t structure; // logs.structure at the last lookup (without *)
+    size_t nodes_checked; // logs.nodes tested so far (with *)
+    log_t **matches; // in the order they were created
+    int num_matches;
+    int max_matches;
 };
 
 struct logs_t
 {
     log_t root;
     log_t *curr;
+    log_arena_t arena;
+    std::vector<log_t*> nodes; // in the order they were created, root first
+    uint64_t changes; // incremented when a log is created or appended to
+    uint32_t structure; // incremented when a log is created
     logs_t()
     {
         root.type = log_type_group;
         root.label = NULL;
+        root.id = 0;
         root.parent = NULL;
+        root.table = NULL;
+        root.table_hashes = NULL;
+        root.table_capacity = 0;
+        root.table_count = 0;
         curr = &root;
+        nodes.push_back(&root);
+        changes = 0;
+        structure = 0;
     }
 
-    void Push(const char *label)
+    // FNV-1a of the label (up to end, or the terminating zero) and the type
+    static uint32_t Hash(const char *label, const char *end, log_type_t type)
     {
-        assert(curr);
+        uint32_t h = 2166136261u;
+        for (const char *c = label; c != end && *c; c++)
+        {
+            h ^= (unsigned char)*c;
+            h *= 16777619u;
+        }
+        h ^= (uint32_t)type;
+        h *= 16777619u;
+        return h;
+    }
+
+    log_t *NewLog(log_t *parent, const char *label, log_type_t type)
+    {
+        log_t *l = new (arena.Alloc(sizeof(log_t))) log_t;
+        l->label = label ? arena.CopyString(label, strlen(label)) : NULL;
+        l->type = type;
+        l->parent = parent;
+        l->rows = 0;
+        l->columns = 0;
+        l->table = NULL;
+        l->table_hashes = NULL;
+        l->table_capacity = 0;
+        l->table_count = 0;
+        memset(&l->series, 0, sizeof(l->series));
+        l->id = (uint32_t)nodes.size();
+        l->index = (uint32_t)parent->children.size();
+        nodes.push_back(l);
+        changes++;
+        structure++;
+        parent->children.push_back(l);
+        if (label)
+            Insert(parent, l, Hash(label, NULL, type));
+        return l;
+    }
 
-        for (size_t i = 0; i < curr->children.size(); i++)
+    void Insert(log_t *parent, log_t *child, uint32_t hash)
+    {
+        if (2*(parent->table_count + 1) > parent->table_capacity)
         {
-            if (curr->children[i]->label &&
-                strcmp(curr->children[i]->label, label) == 0)
-            {
-                curr = curr->children[i];
-                return;
-            }
+            int old_capacity = parent->table_capacity;
+            log_t **old_table = parent->table;
+            uint32_t *old_hashes = parent->table_hashes;
+            parent->table_capacity = old_capacity ? 2*old_capacity : 8;
+            parent->table = (log_t**)calloc(parent->table_capacity, sizeof(log_t*));
+            parent->table_hashes = (uint32_t*)calloc(parent->table_capacity, sizeof(uint32_t));
+            assert(parent->table && parent->table_hashes && "Ran out of memory for logs");
+            parent->table_count = 0;
+            for (int i = 0; i < old_capacity; i++)
+                if (old_table[i])
+                    Insert(parent, old_table[i], old_hashes[i]);
+            free(old_table);
+            free(old_hashes);
         }
+        uint32_t mask = (uint32_t)parent->table_capacity - 1;
+        uint32_t i = hash & mask;
+        while (parent->table[i])
+            i = (i + 1) & mask;
+        parent->table[i] = child;
+        parent->table_hashes[i] = hash;
+        parent->table_count++;
+    }
 
-        log_t *child = new log_t;
-        assert(child);
-        child->label = label;
-        child->type = log_type_group;
-        child->parent = curr;
+    // Finds the child of parent with the given label (up to end, or the terminating
+    // zero) and type, or NULL.
+    log_t *Lookup(log_t *parent, const char *label, const char *end, log_type_t type)
+    {
+        if (!parent->table)
+            return NULL;
+        uint32_t hash = Hash(label, end, type);
+        uint32_t mask = (uint32_t)parent->table_capacity - 1;
+        for (uint32_t i = hash & mask; parent->table[i]; i = (i + 1) & mask)
+        {
+            log_t *l = parent->table[i];
+            if (parent->table_hashes[i] != hash || l->type != type)
+                continue;
+            if (end ? CompareUnterminatedString(label, end, l->label) : strcmp(label, l->label) == 0)
+                return l;
+        }
+        return NULL;
+    }
 
-        curr->children.push_back(child);
+    void Push(const char *label)
+    {
+        assert(curr);
+        log_t *child = Lookup(curr, label, NULL, log_type_group);
+        if (!child)
+            child = NewLog(curr, label, log_type_group);
         curr = child;
     }
 
     void Push()
     {
         assert(curr);
-
-        log_t *child = new log_t;
-        assert(child);
-        child->label = NULL;
-        child->type = log_type_group;
-        child->parent = curr;
-
-        curr->children.push_back(child);
-        curr = child;
+        curr = NewLog(curr, NULL, log_type_group);
     }
 
     void Pop()
@@ -127,20 +402,12 @@ struct logs_t
                 if (end == c)
                     return NULL;
 
-                int match = -1;
-                for (int i = 0; i < (int)l->children.size(); i++)
-                {
-                    if (!l->children[i]->label)
-                        continue;
-                    if (CompareUnterminatedString(c, end, l->children[i]->label))
-                    {
-                        match = i;
-                        break;
-                    }
-                }
-                if (match < 0)
+                log_t *match = NULL;
+                for (log_type_t type = log_type_group; type <= log_type_matrix && !match; type++)
+                    match = Lookup(l, c, end, type);
+                if (!match)
                     return NULL;
-                l = l->children[match];
+                l = match;
                 c = end - 1;
             }
             c++;
@@ -148,28 +415,100 @@ struct logs_t
         return l;
     }
 
-    log_t *GetLog(const char *label, log_type_t type)
+    bool MatchesTerm(log_t *l, const char *term)
     {
-        for (size_t i = 0; i < curr->children.size(); i++)
+        const char *end = term;
+        while (*end && *end != '/')
+            end++;
+        if (end - term == 1 && *term == '*')
+            return true;
+        if ((*term >= '0' && *term <= '9') || *term == '-')
+            return strtol(term, NULL, 0) == (long)l->index;
+        return l->label && CompareUnterminatedString(term, end, l->label);
+    }
+
+    // Finds the logs that match a query like "/iter/*/loss" (see log_query_t).
+    void Resolve(log_query_t *q, const char *text)
+    {
+        if (strncmp(q->text, text, sizeof(q->text) - 1) != 0 || q->num_terms == 0)
         {
-            if (curr->children[i]->type == type &&
-                strcmp(curr->children[i]->label, label) == 0)
-                return curr->children[i];
+            strncpy(q->text, text, sizeof(q->text) - 1);
+            q->text[sizeof(q->text) - 1] = '\0';
+            q->num_terms = 0;
+            q->wildcard = false;
+            q->structure = structure - 1;
+            q->nodes_checked = 0;
+            q->num_matches = 0;
+            for (const char *c = q->text; *c; )
+            {
+                if (*c != '/' || c[1] == '/' || c[1] == '\0' || q->num_terms == log_query_t::MAX_TERMS)
+                {
+                    q->num_terms = -1;
+                    break;
+                }
+                c++;
+                q->terms[q->num_terms++] = c;
+                if (c[0] == '*' && (c[1] == '/' || c[1] == '\0'))
+                    q->wildcard = true;
+                while (*c && *c != '/')
+                    c++;
+            }
         }
+        if (q->num_terms <= 0)
+            return;
 
-        log_t *l = new log_t;
-        assert(l);
-        l->label = label;
-        l->type = type;
-        l->parent = curr;
-        curr->children.push_back(l);
+        if (!q->wildcard)
+        {
+            if (q->structure != structure)
+            {
+                log_t *l = Find(q->text);
+                q->num_matches = 0;
+                if (l)
+                    AddMatch(q, l);
+                q->structure = structure;
+            }
+            return;
+        }
+
+        for (size_t i = q->nodes_checked; i < nodes.size(); i++)
+        {
+            log_t *l = nodes[i];
+            int k = q->num_terms - 1;
+            while (k >= 0 && l->parent && MatchesTerm(l, q->terms[k]))
+            {
+                l = l->parent;
+                k--;
+            }
+            if (k < 0 && l == &root)
+                AddMatch(q, nodes[i]);
+        }
+        q->nodes_checked = nodes.size();
+    }
+
+    void AddMatch(log_query_t *q, log_t *l)
+    {
+        if (q->num_matches == q->max_matches)
+        {
+            q->max_matches = q->max_matches ? 2*q->max_matches : 16;
+            q->matches = (log_t**)realloc(q->matches, q->max_matches*sizeof(log_t*));
+            assert(q->matches && "Ran out of memory for log queries");
+        }
+        q->matches[q->num_matches++] = l;
+    }
+
+    log_t *GetLog(const char *label, log_type_t type)
+    {
+        log_t *l = Lookup(curr, label, NULL, type);
+        if (!l)
+            l = NewLog(curr, label, type);
         return l;
     }
 
     void Scalar(const char *label, float x)
     {
         log_t *l = GetLog(label, log_type_scalar);
-        l->data.push_back(x);
+        l->series.Append(x);
+        changes++;
     }
 
     void Matrix(const char *label, float *x, int rows, int columns)
@@ -177,6 +516,7 @@ struct logs_t
         log_t *l = GetLog(label, log_type_matrix);
         l->rows = rows;
         l->columns = columns;
+        changes++;
         for (int col = 0; col < columns; col++)
         for (int row = 0; row < rows; row++)
             l->data.push_back(x[row + col*rows]);
@@ -187,6 +527,7 @@ struct logs_t
         log_t *l = GetLog(label, log_type_matrix);
         l->rows = rows;
         l->columns = columns;
+        changes++;
         for (int col = 0; col < columns; col++)
         for (int row = 0; row < rows; row++)
             l->data.push_back(x[col + row*columns]);
@@ -232,15 +573,16 @@ struct logs_t
             {
                 indent
                 fprintf(f, "\"%s\": ", l->label);
-                if (l->data.size() == 1)
+                log_series_t *s = &l->series;
+                if (s->Count() == 1)
                 {
-                    fprintf(f, "%g", l->data[0]);
+                    fprintf(f, "%g", s->Last());
                 }
                 else
                 {
-                    fprintf(f, "[%g", l->data[0]);
-                    for (size_t i = 1; i < l->data.size(); i++)
-                        fprintf(f, ", %g", l->data[i]);
+                    fprintf(f, "[%g", s->Get(s->First()));
+                    for (uint64_t i = s->First() + 1; i < s->total; i++)
+                        fprintf(f, ", %g", s->Get(i));
                     fprintf(f, "]");
                 }
             }
@@ -281,17 +623,14 @@ struct logs_t
     void Dump(const char *filename)
     {
         FILE *f = fopen(filename, "w+");
+        if (!f)
+        {
+            fprintf(stderr, "vdb: failed to open %s\n", filename);
+            return;
+        }
         _Dump(f, &root, 0);
+        fclose(f);
     }
 };
 
 static logs_t logs;
-
-void vdbLogPush(const char *label) { logs.Push(label); }
-void vdbLogPush() { logs.Push(); }
-void vdbLogPop() { logs.Pop(); }
-void vdbLogScalar(const char *label, float x) { logs.Scalar(label, x); }
-void vdbLogMatrix(const char *label, float *x, int rows, int columns) { logs.Matrix(label, x, rows, columns); }
-void vdbLogMatrix_RowMaj(const char *label, float *x, int rows, int columns) { logs.Matrix_RowMaj(label, x, rows, columns); }
-void vdbLogVector(const char *label, float *x, int elements) { logs.Vector(label, x, elements); }
-void vdbLogDump(const char *filename) { logs.Dump(filename); }
@@ -0,0 +1,388 @@
+// Writes the log tree to .vdblog files (see vdblog.h) and reads them back.
+//
+// vdbLogStreamToFile keeps the file up to date while the program runs: at every
+// vdbBeginBreak, the logs that changed since the last one are packed into a buffer
+// (new nodes and one block of new values per log) and handed to a writer thread,
+// which writes and flushes it. The program only pays for copying the new values.
+// Scalar logs only keep their newest samples (see VDB_LOG_MAX_SAMPLES), so if more
+// than that are logged between two breaks, the oldest of them are not written.
+struct log_file_buffer_t
+{
+    std::vector<unsigned char> data;
+    log_file_buffer_t *next;
+};
+
+namespace log_file
+{
+    enum { MAX_BLOCK_VALUES = 16*1024*1024 }; // keeps record sizes within 32 bits
+
+    static FILE *file;
+    static SDL_Thread *thread;
+    static SDL_mutex *mutex;
+    static SDL_cond *queued;
+    static log_file_buffer_t *queue_first; // protected by mutex
+    static log_file_buffer_t *queue_last; // protected by mutex
+    static bool closing; // protected by mutex
+    static std::vector<uint64_t> streamed; // values already written, per node id
+    static size_t nodes_streamed;
+    static uint64_t changes_streamed; // logs.changes at the last flush
+
+    static void AppendRecord(std::vector<unsigned char> &out, uint32_t type, const void *header, size_t header_size, const void *data, size_t data_size)
+    {
+        vdblog_record_t record;
+        record.type = type;
+        record.size = (uint32_t)((header_size + data_size + 7) & ~(size_t)7);
+        size_t at = out.size();
+        out.resize(at + sizeof(record) + record.size, 0);
+        memcpy(&out[at], &record, sizeof(record));
+        memcpy(&out[at + sizeof(record)], header, header_size);
+        if (data_size > 0)
+            memcpy(&out[at + sizeof(record) + header_size], data, data_size);
+    }
+
+    static void AppendBlock(std::vector<unsigned char> &out, uint32_t id, uint64_t first, const float *values, uint64_t count)
+    {
+        while (count > 0)
+        {
+            uint32_t n = count < MAX_BLOCK_VALUES ? (uint32_t)count : MAX_BLOCK_VALUES;
+            vdblog_block_t block;
+            block.id = id;
+            block.count = n;
+            block.first = first;
+            AppendRecord(out, VDBLOG_BLOCK, &block, sizeof(block), values, n*sizeof(float));
+            first += n;
+            values += n;
+            count -= n;
+        }
+    }
+
+    // Packs the nodes created since nodes_done and the values appended since
+    // progress[id] into out.
+    static void Encode(std::vector<unsigned char> &out, std::vector<uint64_t> &progress, size_t *nodes_done)
+    {
+        for (size_t i = *nodes_done; i < logs.nodes.size(); i++)
+        {
+            log_t *l = logs.nodes[i];
+            if (!l->parent)
+                continue; // the root is not written
+            vdblog_node_t node;
+            node.id = l->id;
+            node.parent = l->parent->id;
+            node.type = (uint32_t)l->type;
+            node.label_length = l->label ? (uint32_t)strlen(l->label) : VDBLOG_NO_LABEL;
+            node.rows = l->rows;
+            node.columns = l->columns;
+            AppendRecord(out, VDBLOG_NODE, &node, sizeof(node), l->label, l->label ? node.label_length : 0);
+        }
+        *nodes_done = logs.nodes.size();
+
+        progress.resize(logs.nodes.size(), 0);
+        for (size_t i = 1; i < logs.nodes.size(); i++)
+        {
+            log_t *l = logs.nodes[i];
+            if (l->type == log_type_scalar)
+            {
+                log_series_t *s = &l->series;
+                uint64_t from = progress[i] > s->First() ? progress[i] : s->First();
+                while (from < s->total)
+                {
+                    // the kept samples are in at most two contiguous pieces of the ring buffer
+                    size_t at = (size_t)(from & (s->capacity - 1));
+                    uint64_t n = s->total - from;
+                    if (n > s->capacity - at)
+                        n = s->capacity - at;
+                    AppendBlock(out, l->id, from, s->samples + at, n);
+                    from += n;
+                }
+                progress[i] = s->total;
+            }
+            else if (l->type == log_type_matrix)
+            {
+                uint64_t size = l->data.size();
+                if (size > progress[i])
+                    AppendBlock(out, l->id, progress[i], &l->data[0] + progress[i], size - progress[i]);
+                progress[i] = size;
+            }
+        }
+    }
+
+    // Writes a buffer of records that start at *position in the file, and adds its
+    // blocks to the index.
+    static void Write(FILE *f, const std::vector<unsigned char> &data, uint64_t *position, std::vector<vdblog_index_entry_t> &index)
+    {
+        if (data.empty())
+            return;
+        fwrite(&data[0], 1, data.size(), f);
+        size_t at = 0;
+        while (at + sizeof(vdblog_record_t) <= data.size())
+        {
+            vdblog_record_t record;
+            memcpy(&record, &data[at], sizeof(record));
+            if (record.type == VDBLOG_BLOCK)
+            {
+                vdblog_block_t block;
+                memcpy(&block, &data[at + sizeof(record)], sizeof(block));
+                vdblog_index_entry_t entry;
+                entry.id = block.id;
+                entry.count = block.count;
+                entry.first = block.first;
+                entry.offset = *position + at + sizeof(record) + sizeof(block);
+                index.push_back(entry);
+            }
+            at += sizeof(record) + record.size;
+        }
+        *position += data.size();
+    }
+
+    static void WriteHeader(FILE *f)
+    {
+        vdblog_header_t header = {0};
+        memcpy(header.magic, VDBLOG_MAGIC, sizeof(header.magic));
+        header.version = VDBLOG_VERSION;
+        fwrite(&header, sizeof(header), 1, f);
+    }
+
+    static void WriteIndex(FILE *f, const std::vector<vdblog_index_entry_t> &index, uint64_t position)
+    {
+        vdblog_record_t record;
+        record.type = VDBLOG_INDEX;
+        record.size = (uint32_t)(index.size()*sizeof(vdblog_index_entry_t));
+        fwrite(&record, sizeof(record), 1, f);
+        if (!index.empty())
+            fwrite(&index[0], sizeof(vdblog_index_entry_t), index.size(), f);
+        vdblog_footer_t footer;
+        footer.index_offset = position;
+        memcpy(footer.magic, VDBLOG_MAGIC, sizeof(footer.magic));
+        fwrite(&footer, sizeof(footer), 1, f);
+    }
+
+    static int ThreadMain(void*)
+    {
+        std::vector<vdblog_index_entry_t> index;
+        uint64_t position = sizeof(vdblog_header_t);
+        for (;;)
+        {
+            SDL_LockMutex(mutex);
+            while (!queue_first && !closing)
+                SDL_CondWait(queued, mutex);
+            log_file_buffer_t *buffer = queue_first;
+            queue_first = NULL;
+            queue_last = NULL;
+            bool done = closing && !buffer;
+            SDL_UnlockMutex(mutex);
+
+            if (done)
+                break;
+            while (buffer)
+            {
+                log_file_buffer_t *next = buffer->next;
+                Write(file, buffer->data, &position, index);
+                delete buffer;
+                buffer = next;
+            }
+            // keep everything up to the last break if the program stops early
+            fflush(file);
+        }
+        WriteIndex(file, index, position);
+        return 0;
+    }
+
+    // Called at the start of every vdbBeginBreak.
+    static void Flush()
+    {
+        if (!file || logs.changes == changes_streamed)
+            return;
+        changes_streamed = logs.changes;
+        log_file_buffer_t *buffer = new log_file_buffer_t;
+        buffer->next = NULL;
+        Encode(buffer->data, streamed, &nodes_streamed);
+        SDL_LockMutex(mutex);
+        if (queue_last) queue_last->next = buffer;
+        else queue_first = buffer;
+        queue_last = buffer;
+        SDL_CondSignal(queued);
+        SDL_UnlockMutex(mutex);
+    }
+
+    static void Close()
+    {
+        if (!file)
+            return;
+        Flush();
+        SDL_LockMutex(mutex);
+        closing = true;
+        SDL_CondSignal(queued);
+        SDL_UnlockMutex(mutex);
+        SDL_WaitThread(thread, NULL);
+        thread = NULL;
+        fclose(file);
+        file = NULL;
+    }
+
+    static void Dump(const char *filename)
+    {
+        FILE *f = fopen(filename, "wb");
+        if (!f)
+        {
+            fprintf(stderr, "vdb: failed to open %s\n", filename);
+            return;
+        }
+        std::vector<unsigned char> data;
+        std::vector<uint64_t> progress;
+        std::vector<vdblog_index_entry_t> index;
+        size_t nodes_done = 0;
+        uint64_t position = sizeof(vdblog_header_t);
+        Encode(data, progress, &nodes_done);
+        WriteHeader(f);
+        Write(f, data, &position, index);
+        WriteIndex(f, index, position);
+        fclose(f);
+    }
+
+    static bool HasExtension(const char *filename, const char *extension)
+    {
+        size_t n = strlen(filename);
+        size_t m = strlen(extension);
+        return n >= m && strcmp(filename + n - m, extension) == 0;
+    }
+}
+
+void vdbLogDump(const char *filename)
+{
+    if (log_file::HasExtension(filename, ".vdblog"))
+        log_file::Dump(filename);
+    else
+        logs.Dump(filename);
+}
+
+void vdbLogStreamToFile(const char *filename)
+{
+    using namespace log_file;
+    Close();
+    if (!filename)
+        return;
+    file = fopen(filename, "wb");
+    if (!file)
+    {
+        fprintf(stderr, "vdb: failed to open %s for writing\n", filename);
+        return;
+    }
+    WriteHeader(file);
+    if (!mutex)
+    {
+        mutex = SDL_CreateMutex();
+        queued = SDL_CreateCond();
+        assert(mutex && queued);
+        atexit(Close); // writes the index
+    }
+    closing = false;
+    streamed.clear();
+    nodes_streamed = 0;
+    changes_streamed = logs.changes - 1; // write what was logged so far at the next flush
+    thread = SDL_CreateThread(ThreadMain, "vdb log writer", NULL);
+    assert(thread && "Failed to create log writer thread");
+}
+
+bool vdbLogLoad(const char *filename)
+{
+    FILE *f = fopen(filename, "rb");
+    if (!f)
+    {
+        fprintf(stderr, "vdb: failed to open %s\n", filename);
+        return false;
+    }
+    vdblog_header_t header;
+    if (fread(&header, sizeof(header), 1, f) != 1 ||
+        memcmp(header.magic, VDBLOG_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != VDBLOG_VERSION)
+    {
+        fprintf(stderr, "vdb: %s is not a valid .vdblog file (version %d)\n", filename, VDBLOG_VERSION);
+        fclose(f);
+        return false;
+    }
+
+    // Record sizes come from the file, so they are checked against what is left of it
+    // before anything is allocated.
+    int64_t file_size = 0;
+    if (vdb_fseek64(f, 0, SEEK_END) == 0)
+        file_size = (int64_t)vdb_ftell64(f);
+    vdb_fseek64(f, sizeof(header), SEEK_SET);
+    int64_t position = sizeof(header);
+
+    // Nodes with a label are merged into the logs that already have that path.
+    std::vector<log_t*> nodes(1, &logs.root); // by id in the file
+    uint32_t num_node_records = 0;
+    bool corrupt = false;
+    std::vector<unsigned char> data;
+    vdblog_record_t record;
+    while (fread(&record, sizeof(record), 1, f) == 1 && record.type != VDBLOG_INDEX)
+    {
+        position += sizeof(record);
+        if ((int64_t)record.size > file_size - position)
+            break; // the program stopped while writing this record
+        position += record.size;
+        data.resize(record.size + 1);
+        if (fread(&data[0], 1, record.size, f) != record.size)
+            break;
+        if (record.type == VDBLOG_NODE && record.size >= sizeof(vdblog_node_t))
+        {
+            vdblog_node_t node;
+            memcpy(&node, &data[0], sizeof(node));
+
+            // ids are given out in order, so a larger one can only come from a bad file
+            // (and would make us allocate up to 4G pointers)
+            if (node.id == 0 || node.id > num_node_records + 1)
+            {
+                corrupt = true;
+                break;
+            }
+            num_node_records++;
+            if (node.parent >= nodes.size() || !nodes[node.parent] || node.type > log_type_matrix)
+                continue;
+            const char *label = NULL;
+            if (node.label_length != VDBLOG_NO_LABEL)
+            {
+                if (sizeof(node) + node.label_length > record.size)
+                    continue;
+                data[sizeof(node) + node.label_length] = '\0';
+                label = (const char*)&data[sizeof(node)];
+            }
+            log_t *parent = nodes[node.parent];
+            log_t *l = label ? logs.Lookup(parent, label, NULL, (log_type_t)node.type) : NULL;
+            if (!l)
+                l = logs.NewLog(parent, label, (log_type_t)node.type);
+            l->rows = node.rows;
+            l->columns = node.columns;
+            if (node.id >= nodes.size())
+                nodes.resize(node.id + 1, NULL);
+            nodes[node.id] = l;
+        }
+        else if (record.type == VDBLOG_BLOCK && record.size >= sizeof(vdblog_block_t))
+        {
+            vdblog_block_t block;
+            memcpy(&block, &data[0], sizeof(block));
+            if (block.id >= nodes.size() || !nodes[block.id] ||
+                sizeof(block) + (uint64_t)block.count*sizeof(float) > record.size)
+                continue;
+            log_t *l = nodes[block.id];
+            const float *values = (const float*)&data[sizeof(block)];
+            if (l->type == log_type_scalar)
+            {
+                for (uint32_t i = 0; i < block.count; i++)
+                    l->series.Append(values[i]);
+            }
+            else if (l->type == log_type_matrix)
+            {
+                l->data.insert(l->data.end(), values, values + block.count);
+            }
+            logs.changes++;
+        }
+    }
+    fclose(f);
+    if (corrupt)
+    {
+        fprintf(stderr, "vdb: %s is corrupt (bad node id), only the logs before it were loaded\n", filename);
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,226 @@
+// Log windows draw scalar logs with OpenGL instead of ImGui::PlotLines, which would
+// build geometry for every sample every frame. Each window keeps a vertex buffer
+// that mirrors the log's ring buffer (see log_series_t): new samples are uploaded
+// once, at the same position as in the ring buffer, and the visible range is drawn
+// as one or two line strips from inside the window's ImGui draw list (through a draw
+// callback). The buffer has one extra slot with a copy of the first sample, so that
+// the line continues where the ring buffer wraps around.
+//
+// The mouse wheel zooms in on the time axis, dragging pans, and double-clicking shows
+// all samples again, following new ones.
+#include "shaders/log_plot.h"
+
+struct log_plot_t
+{
+    log_t *log; // that vbo mirrors
+    GLuint vbo;
+    size_t capacity; // of the ring buffer mirrored by vbo
+    uint64_t uploaded; // absolute index of the next sample to upload
+    bool zoomed; // otherwise the view shows all kept samples
+    double view_min, view_max; // absolute sample indices at the left and right edge
+
+    // set each frame for Callback
+    ImVec2 p0, p1;
+    float y_min, y_max;
+    ImVec4 color;
+};
+
+namespace log_plot
+{
+    static GLuint vao;
+
+    static void Release(log_plot_t *plot)
+    {
+        if (plot->vbo)
+            glDeleteBuffers(1, &plot->vbo);
+        plot->vbo = 0;
+        plot->log = NULL;
+    }
+
+    static void Upload(log_plot_t *plot, log_t *l)
+    {
+        log_series_t *s = &l->series;
+        if (plot->log != l || plot->capacity != s->capacity || !plot->vbo)
+        {
+            Release(plot);
+            glGenBuffers(1, &plot->vbo);
+            glBindBuffer(GL_ARRAY_BUFFER, plot->vbo);
+            glBufferData(GL_ARRAY_BUFFER, (s->capacity + 1)*sizeof(float), NULL, GL_DYNAMIC_DRAW);
+            plot->log = l;
+            plot->capacity = s->capacity;
+            plot->uploaded = s->First();
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, plot->vbo);
+        uint64_t from = plot->uploaded > s->First() ? plot->uploaded : s->First();
+        while (from < s->total)
+        {
+            size_t at = (size_t)(from & (s->capacity - 1));
+            uint64_t n = s->total - from;
+            if (n > s->capacity - at)
+                n = s->capacity - at;
+            glBufferSubData(GL_ARRAY_BUFFER, at*sizeof(float), (GLsizeiptr)(n*sizeof(float)), s->samples + at);
+            if (at == 0)
+                glBufferSubData(GL_ARRAY_BUFFER, s->capacity*sizeof(float), sizeof(float), s->samples);
+            from += n;
+        }
+        plot->uploaded = s->total;
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    static void Callback(const ImDrawList *, const ImDrawCmd *cmd)
+    {
+        static GLuint program = LoadShaderFromMemory(shader_log_plot_vs, shader_log_plot_fs);
+        assert(program);
+        static GLint attrib_value     = glGetAttribLocation(program, "value");
+        static GLint uniform_x_offset = glGetUniformLocation(program, "x_offset");
+        static GLint uniform_x_scale  = glGetUniformLocation(program, "x_scale");
+        static GLint uniform_y_range  = glGetUniformLocation(program, "y_range");
+        static GLint uniform_color    = glGetUniformLocation(program, "color");
+
+        log_plot_t *plot = (log_plot_t*)cmd->UserCallbackData;
+        log_series_t *s = &plot->log->series;
+
+        // ImGui's renderer doesn't set its state again after a callback
+        GLint last_program; glGetIntegerv(GL_CURRENT_PROGRAM, &last_program);
+        GLint last_vertex_array; glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &last_vertex_array);
+        GLint last_array_buffer; glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &last_array_buffer);
+        GLint last_viewport[4]; glGetIntegerv(GL_VIEWPORT, last_viewport);
+        GLint last_scissor_box[4]; glGetIntegerv(GL_SCISSOR_BOX, last_scissor_box);
+
+        ImGuiIO &io = ImGui::GetIO();
+        ImVec2 scale = io.DisplayFramebufferScale;
+        float fb_height = io.DisplaySize.y*scale.y;
+        ImVec4 clip = cmd->ClipRect;
+        glScissor((GLint)(clip.x*scale.x), (GLint)(fb_height - clip.w*scale.y),
+                  (GLsizei)((clip.z - clip.x)*scale.x), (GLsizei)((clip.w - clip.y)*scale.y));
+        glViewport((GLint)(plot->p0.x*scale.x), (GLint)(fb_height - plot->p1.y*scale.y),
+                   (GLsizei)((plot->p1.x - plot->p0.x)*scale.x), (GLsizei)((plot->p1.y - plot->p0.y)*scale.y));
+
+        if (!vao)
+            glGenVertexArrays(1, &vao);
+        glUseProgram(program);
+        glBindVertexArray(vao);
+        glBindBuffer(GL_ARRAY_BUFFER, plot->vbo);
+        glEnableVertexAttribArray(attrib_value);
+        glVertexAttribPointer(attrib_value, 1, GL_FLOAT, GL_FALSE, 0, (const void*)(0));
+        glUniform1f(uniform_x_scale, (float)(2.0/(plot->view_max - plot->view_min)));
+        glUniform2f(uniform_y_range, plot->y_min, plot->y_max);
+        glUniform4f(uniform_color, plot->color.x, plot->color.y, plot->color.z, plot->color.w);
+
+        // the visible samples, plus one on each side so that lines reach the edges
+        double a = floor(plot->view_min) - 1.0;
+        double b = ceil(plot->view_max) + 2.0;
+        uint64_t first = (a > (double)s->First()) ? (uint64_t)a : s->First();
+        uint64_t end = (b < (double)s->total) ? (uint64_t)b : s->total;
+        while (first + 1 < end)
+        {
+            size_t at = (size_t)(first & (s->capacity - 1));
+            uint64_t n = end - first;
+            bool wraps = n > s->capacity - at;
+            if (wraps)
+                n = s->capacity - at;
+            // gl_VertexID starts at 'at', so shift x back by that much
+            glUniform1f(uniform_x_offset, (float)((double)first - plot->view_min - (double)at));
+            glDrawArrays(GL_LINE_STRIP, (GLint)at, (GLsizei)(wraps ? n + 1 : n));
+            first += n;
+        }
+
+        glDisableVertexAttribArray(attrib_value);
+        glUseProgram(last_program);
+        glBindVertexArray(last_vertex_array);
+        glBindBuffer(GL_ARRAY_BUFFER, last_array_buffer);
+        glViewport(last_viewport[0], last_viewport[1], (GLsizei)last_viewport[2], (GLsizei)last_viewport[3]);
+        glScissor(last_scissor_box[0], last_scissor_box[1], (GLsizei)last_scissor_box[2], (GLsizei)last_scissor_box[3]);
+    }
+
+    static void Draw(log_plot_t *plot, log_t *l, ImVec2 size)
+    {
+        log_series_t *s = &l->series;
+        if (size.x < 1.0f || size.y < 1.0f)
+            return;
+        Upload(plot, l);
+
+        ImVec2 p0 = ImGui::GetCursorScreenPos();
+        ImVec2 p1 = ImVec2(p0.x + size.x, p0.y + size.y);
+        ImGui::InvisibleButton("##plot", size);
+
+        // zoom and pan the time axis
+        double first = (double)s->First();
+        double last = (double)(s->total - 1);
+        if (!plot->zoomed)
+        {
+            plot->view_min = first;
+            plot->view_max = last;
+        }
+        double width = plot->view_max - plot->view_min;
+        float t = (ImGui::GetIO().MousePos.x - p0.x)/size.x;
+        if (ImGui::IsItemHovered())
+        {
+            float wheel = ImGui::GetIO().MouseWheel;
+            if (wheel != 0.0f)
+            {
+                double center = plot->view_min + t*width;
+                width *= pow(0.8, (double)wheel);
+                if (width < 4.0) width = 4.0;
+                plot->view_min = center - t*width;
+                plot->view_max = plot->view_min + width;
+                plot->zoomed = true;
+            }
+            if (ImGui::IsMouseDoubleClicked(0))
+                plot->zoomed = false;
+        }
+        if (ImGui::IsItemActive() && ImGui::IsMouseDragging(0))
+        {
+            double dx = ImGui::GetIO().MouseDelta.x/size.x*width;
+            plot->view_min -= dx;
+            plot->view_max -= dx;
+            plot->zoomed = true;
+        }
+        if (plot->zoomed && plot->view_max - plot->view_min >= last - first)
+            plot->zoomed = false;
+        if (plot->zoomed)
+        {
+            // keep the view within the kept samples
+            width = plot->view_max - plot->view_min;
+            if (plot->view_min < first) { plot->view_min = first; plot->view_max = first + width; }
+            if (plot->view_max > last) { plot->view_max = last; plot->view_min = last - width; }
+        }
+
+        // vertical range of the visible samples
+        uint64_t a = (uint64_t)(plot->view_min > first ? floor(plot->view_min) : first);
+        uint64_t b = (uint64_t)(ceil(plot->view_max) + 1.0);
+        if (b > s->total) b = s->total;
+        if (a >= b) a = b - 1;
+        s->MinMax(a, b, &plot->y_min, &plot->y_max);
+        if (plot->y_max - plot->y_min < 1e-6f*(fabsf(plot->y_min) + 1.0f))
+        {
+            plot->y_min -= 0.5f;
+            plot->y_max += 0.5f;
+        }
+
+        plot->p0 = p0;
+        plot->p1 = p1;
+        plot->color = ImGui::GetStyleColorVec4(ImGuiCol_PlotLines);
+        ImDrawList *draw_list = ImGui::GetWindowDrawList();
+        draw_list->AddRectFilled(p0, p1, ImGui::GetColorU32(ImGuiCol_FrameBg), ImGui::GetStyle().FrameRounding);
+        draw_list->PushClipRect(p0, p1, true);
+        draw_list->AddCallback(Callback, plot);
+        char text[64];
+        ImU32 text_color = ImGui::GetColorU32(ImGuiCol_TextDisabled);
+        sprintf(text, "%g", plot->y_max);
+        draw_list->AddText(ImVec2(p0.x + 4.0f, p0.y + 2.0f), text_color, text);
+        sprintf(text, "%g", plot->y_min);
+        draw_list->AddText(ImVec2(p0.x + 4.0f, p1.y - ImGui::GetTextLineHeight() - 2.0f), text_color, text);
+        draw_list->PopClipRect();
+
+        if (ImGui::IsItemHovered())
+        {
+            double x = plot->view_min + t*(plot->view_max - plot->view_min) + 0.5;
+            if (x >= first && x < (double)s->total)
+            {
+                uint64_t i = (uint64_t)x;
+                ImGui::SetTooltip("%llu: %g", (unsigned long long)i, s->Get(i));
+            }
+        }
+    }
+}
@@ -0,0 +1,304 @@
+// Logging from several threads. The log tree (see log.h) is owned by one thread: the
+// first one to call vdbBeginBreak, usually the main thread, since that is the thread
+// that shows the logs. It writes to the tree directly. Any other thread, and every
+// thread before the owner has claimed the tree, writes its calls to a buffer of its
+// own, which is merged into the tree at the next vdbBeginBreak. Each buffer is a
+// single-producer single-consumer ring buffer: the logging thread only advances the
+// write position and the owner only advances the read position, so neither takes a
+// lock. A value that doesn't fit in the buffer is dropped (and counted) rather than
+// waiting for the owner.
+//
+// Each thread has its own stack of groups (vdbLogPush/Pop). Outside of any group of
+// its own, a thread logs into the group that the owner is in at the time, so a
+// parallel loop inside vdbLogPush("iter") logs into "iter" from every thread.
+//
+// A buffer is allocated the first time a thread logs (VDB_LOG_THREAD_BUFFER_SIZE bytes)
+// and is kept when the thread exits; thread pools such as OpenMP's reuse their threads.
+enum log_thread_op_
+{
+    LOG_THREAD_BASE = 1, // log_t *group
+    LOG_THREAD_PUSH, // label
+    LOG_THREAD_PUSH_UNNAMED,
+    LOG_THREAD_POP,
+    LOG_THREAD_SCALAR, // label, float x
+    LOG_THREAD_MATRIX, // label, int32 rows, int32 columns, float x[rows*columns] (column-major)
+};
+
+struct log_thread_t
+{
+    unsigned char *data;
+    uint32_t capacity; // power of two
+    SDL_atomic_t write_pos; // advanced by the logging thread
+    SDL_atomic_t read_pos; // advanced by the owner
+    SDL_atomic_t dropped; // calls that didn't fit
+    log_t *base; // the owner's group last written as LOG_THREAD_BASE (logging thread)
+    int depth; // groups pushed by the logging thread
+    int skipped; // groups whose push was dropped and that are not popped yet (logging thread)
+    log_t *merge_curr; // where the merge left off (owner)
+    log_thread_t *next;
+};
+
+namespace log_threads
+{
+    enum { GROUP_RESERVE = 16*1024 }; // bytes kept free for vdbLogPush/Pop calls
+    static SDL_atomic_t owner_claimed;
+    static thread_local bool is_owner;
+    static thread_local log_thread_t *buffer;
+    static void *first; // list of all buffers, log_thread_t*
+    static void *owner_curr; // the owner's group (logs.curr), log_t*
+
+    static bool IsOwner()
+    {
+        return is_owner;
+    }
+
+    // Called at the start of every vdbBeginBreak; the first thread to call it owns the tree.
+    static void ClaimOwner()
+    {
+        if (!is_owner && SDL_AtomicGet(&owner_claimed) == 0)
+            is_owner = SDL_AtomicCAS(&owner_claimed, 0, 1) == SDL_TRUE;
+    }
+
+    // Called by the owner whenever logs.curr changes.
+    static void PublishCurr()
+    {
+        SDL_AtomicSetPtr(&owner_curr, logs.curr);
+    }
+
+    static log_thread_t *GetBuffer()
+    {
+        if (buffer)
+            return buffer;
+        log_thread_t *b = (log_thread_t*)calloc(1, sizeof(log_thread_t));
+        assert(b && "Ran out of memory for logs");
+        b->capacity = VDB_LOG_THREAD_BUFFER_SIZE;
+        b->data = (unsigned char*)malloc(b->capacity);
+        assert(b->data && "Ran out of memory for logs");
+        b->merge_curr = &logs.root;
+        do b->next = (log_thread_t*)SDL_AtomicGetPtr(&first);
+        while (!SDL_AtomicCASPtr(&first, b->next, b));
+        buffer = b;
+        return b;
+    }
+
+    static void Copy(log_thread_t *b, uint32_t pos, const void *data, uint32_t size)
+    {
+        uint32_t start = pos & (b->capacity - 1);
+        uint32_t n = b->capacity - start;
+        if (n > size) n = size;
+        memcpy(b->data + start, data, n);
+        memcpy(b->data, (const unsigned char*)data + n, size - n);
+    }
+
+    static void Read(log_thread_t *b, uint32_t pos, void *data, uint32_t size)
+    {
+        uint32_t start = pos & (b->capacity - 1);
+        uint32_t n = b->capacity - start;
+        if (n > size) n = size;
+        memcpy(data, b->data + start, n);
+        memcpy((unsigned char*)data + n, b->data, size - n);
+    }
+
+    // Writes one call: op, optional label, then size bytes of data. Returns false if
+    // the call didn't fit and was dropped.
+    static bool Write(uint8_t op, const char *label, const void *data, uint32_t size)
+    {
+        log_thread_t *b = GetBuffer();
+        if (b->skipped > 0)
+        {
+            // inside a group that was dropped
+            SDL_AtomicAdd(&b->dropped, 1);
+            return false;
+        }
+        size_t length = label ? strlen(label) : 0;
+        uint8_t label_length = (uint8_t)(length > 255 ? 255 : length);
+
+        // outside of its own groups, a thread logs into the owner's current group
+        log_t *base = NULL;
+        if (b->depth == 0)
+        {
+            base = (log_t*)SDL_AtomicGetPtr(&owner_curr);
+            if (!base)
+                base = &logs.root;
+            if (base == b->base)
+                base = NULL;
+        }
+
+        // values are dropped a bit early, so that groups still fit and stay balanced
+        uint32_t total = 1 + (label ? 1 + label_length : 0) + size + (base ? 1 + sizeof(base) : 0);
+        uint32_t reserve = (op == LOG_THREAD_SCALAR || op == LOG_THREAD_MATRIX) ? GROUP_RESERVE : 0;
+        uint32_t write_pos = (uint32_t)SDL_AtomicGet(&b->write_pos);
+        uint32_t read_pos = spsc::Load(&b->read_pos);
+        if (b->capacity - (write_pos - read_pos) < total + reserve)
+        {
+            SDL_AtomicAdd(&b->dropped, 1);
+            return false;
+        }
+        if (base)
+        {
+            uint8_t base_op = LOG_THREAD_BASE;
+            Copy(b, write_pos, &base_op, 1);
+            Copy(b, write_pos + 1, &base, sizeof(base));
+            write_pos += 1 + sizeof(base);
+            b->base = base;
+        }
+        Copy(b, write_pos, &op, 1);
+        write_pos += 1;
+        if (label)
+        {
+            Copy(b, write_pos, &label_length, 1);
+            Copy(b, write_pos + 1, label, label_length);
+            write_pos += 1 + label_length;
+        }
+        if (size > 0)
+            Copy(b, write_pos, data, size);
+        write_pos += size;
+        spsc::Store(&b->write_pos, write_pos); // publish the call
+        return true;
+    }
+
+    // The depth only counts groups that are in the buffer, so a Pop whose Push was
+    // dropped is dropped as well.
+    static void Push(const char *label)
+    {
+        log_thread_t *b = GetBuffer();
+        if (b->skipped > 0 || !Write(label ? LOG_THREAD_PUSH : LOG_THREAD_PUSH_UNNAMED, label, NULL, 0))
+            b->skipped++;
+        else
+            b->depth++;
+    }
+
+    static void Pop()
+    {
+        log_thread_t *b = GetBuffer();
+        if (b->skipped > 0)
+        {
+            b->skipped--;
+            return;
+        }
+        assert(b->depth > 0 && "Mismatched vdbLogPush/vdbLogPop pair");
+        if (b->depth > 0 && Write(LOG_THREAD_POP, NULL, NULL, 0))
+            b->depth--;
+    }
+
+    static void Scalar(const char *label, float x)
+    {
+        Write(LOG_THREAD_SCALAR, label, &x, sizeof(x));
+    }
+
+    static void Matrix(const char *label, const float *x, int rows, int columns, bool row_major)
+    {
+        enum { MAX_VALUES = 256 };
+        float data[2 + MAX_VALUES];
+        int n = rows*columns;
+        if (n > MAX_VALUES)
+        {
+            fprintf(stderr, "vdb: matrix logs from other threads are limited to %d values\n", MAX_VALUES);
+            return;
+        }
+        int32_t size[2] = { rows, columns };
+        memcpy(data, size, sizeof(size));
+        for (int col = 0; col < columns; col++)
+        for (int row = 0; row < rows; row++)
+            data[2 + row + col*rows] = row_major ? x[col + row*columns] : x[row + col*rows];
+        Write(LOG_THREAD_MATRIX, label, data, (uint32_t)((2 + n)*sizeof(float)));
+    }
+
+    // Called by the owner at the start of every vdbBeginBreak.
+    static void Merge()
+    {
+        if (!IsOwner())
+            return;
+        log_t *owner = logs.curr;
+        for (log_thread_t *b = (log_thread_t*)SDL_AtomicGetPtr(&first); b; b = b->next)
+        {
+            uint32_t read_pos = (uint32_t)SDL_AtomicGet(&b->read_pos);
+            uint32_t write_pos = spsc::Load(&b->write_pos);
+            if (read_pos == write_pos)
+                continue;
+            logs.curr = b->merge_curr;
+            char label[256];
+            while (read_pos != write_pos)
+            {
+                uint8_t op;
+                Read(b, read_pos++, &op, 1);
+                if (op == LOG_THREAD_PUSH || op == LOG_THREAD_SCALAR || op == LOG_THREAD_MATRIX)
+                {
+                    uint8_t label_length;
+                    Read(b, read_pos, &label_length, 1);
+                    Read(b, read_pos + 1, label, label_length);
+                    label[label_length] = '\0';
+                    read_pos += 1 + label_length;
+                }
+                if (op == LOG_THREAD_BASE)
+                {
+                    Read(b, read_pos, &logs.curr, sizeof(log_t*));
+                    read_pos += sizeof(log_t*);
+                }
+                else if (op == LOG_THREAD_PUSH) logs.Push(label);
+                else if (op == LOG_THREAD_PUSH_UNNAMED) logs.Push();
+                else if (op == LOG_THREAD_POP) logs.Pop();
+                else if (op == LOG_THREAD_SCALAR)
+                {
+                    float x;
+                    Read(b, read_pos, &x, sizeof(x));
+                    read_pos += sizeof(x);
+                    logs.Scalar(label, x);
+                }
+                else if (op == LOG_THREAD_MATRIX)
+                {
+                    int32_t size[2];
+                    float x[256];
+                    Read(b, read_pos, size, sizeof(size));
+                    Read(b, read_pos + sizeof(size), x, size[0]*size[1]*sizeof(float));
+                    read_pos += sizeof(size) + size[0]*size[1]*sizeof(float);
+                    logs.Matrix(label, x, size[0], size[1]);
+                }
+            }
+            b->merge_curr = logs.curr;
+            spsc::Store(&b->read_pos, read_pos); // free the space
+            int dropped = SDL_AtomicSet(&b->dropped, 0);
+            if (dropped > 0)
+                fprintf(stderr, "vdb: dropped %d log calls from another thread (see VDB_LOG_THREAD_BUFFER_SIZE)\n", dropped);
+        }
+        logs.curr = owner;
+    }
+}
+
+void vdbLogPush(const char *label)
+{
+    if (!log_threads::IsOwner()) { log_threads::Push(label); return; }
+    logs.Push(label);
+    log_threads::PublishCurr();
+}
+void vdbLogPush()
+{
+    if (!log_threads::IsOwner()) { log_threads::Push(NULL); return; }
+    logs.Push();
+    log_threads::PublishCurr();
+}
+void vdbLogPop()
+{
+    if (!log_threads::IsOwner()) { log_threads::Pop(); return; }
+    logs.Pop();
+    log_threads::PublishCurr();
+}
+void vdbLogScalar(const char *label, float x)
+{
+    if (!log_threads::IsOwner()) log_threads::Scalar(label, x);
+    else logs.Scalar(label, x);
+}
+void vdbLogMatrix(const char *label, float *x, int rows, int columns)
+{
+    if (!log_threads::IsOwner()) log_threads::Matrix(label, x, rows, columns, false);
+    else logs.Matrix(label, x, rows, columns);
+}
+void vdbLogMatrix_RowMaj(const char *label, float *x, int rows, int columns)
+{
+    if (!log_threads::IsOwner()) log_threads::Matrix(label, x, rows, columns, true);
+    else logs.Matrix_RowMaj(label, x, rows, columns);
+}
+void vdbLogVector(const char *label, float *x, int elements)
+{
+    vdbLogMatrix(label, x, elements, 1);
+}
@@ -265,11 +265,15 @@ static vdbMat4 vdbMatOrthogonalize(vdbMat4 R)
     return O;
 }
 
-#if 0
-static vdbVec4 vdbMulInverse()
+static vdbMat4 vdbMatInverse(vdbMat4 M)
+// General 4x4 inverse by cofactor expansion. Returns the zero matrix if M is singular.
+// (This works on the flat array, which is fine for either storage order, since the
+// inverse of the transpose is the transpose of the inverse.)
 {
     // http://stackoverflow.com/questions/1148309/inverting-a-4x4-matrix
-    vdb_mat4 inv;
+    const float *m = M.data;
+    vdbMat4 result;
+    float *inv = result.data;
     inv[0] = m[5]  * m[10] * m[15] - m[5]  * m[11] * m[14] - m[9]  * m[6]  * m[15] + m[9]  * m[7]  * m[14] + m[13] * m[6]  * m[11] - m[13] * m[7]  * m[10];
     inv[4] = -m[4]  * m[10] * m[15] + m[4]  * m[11] * m[14] + m[8]  * m[6]  * m[15] - m[8]  * m[7]  * m[14] - m[12] * m[6]  * m[11] + m[12] * m[7]  * m[10];
     inv[8] = m[4]  * m[9] * m[15] - m[4]  * m[11] * m[13] - m[8]  * m[5] * m[15] + m[8]  * m[7] * m[13] + m[12] * m[5] * m[11] - m[12] * m[7] * m[9];
@@ -290,11 +294,13 @@ static vdbVec4 vdbMulInverse()
     float det = m[0] * inv[0] + m[1] * inv[4] + m[2] * inv[8] + m[3] * inv[12];
 
     if (det == 0)
-        return false;
+    {
+        vdbMat4 zero = {0};
+        return zero;
+    }
 
     for (int i = 0; i < 16; i++)
         inv[i] /= det;
 
-    *y = vdb_mul4x1(inv, x);
+    return result;
 }
-#endif
@@ -14,6 +14,7 @@ namespace mouse
     static int x,y; // The position of the mouse in the client area in screen coordinates where (0,0):top-left
     static vdbVec2 ndc; // -||- in normalized device coordinates where (-1,-1):bottom-left (+1,+1):top-right
     static float wheel;
+    static bool position_used; // the user's code asked for the mouse position this frame
     static struct button_t
     {
         bool pressed,released,down;
@@ -34,6 +35,7 @@ namespace mouse
 bool vdbWasMouseOver(float x, float y, float z, float w)
 {
     // todo: find closest in z
+    mouse::position_used = true;
     vdbVec2 ndc = vdbModelToNDC(x, y, z, w);
     vdbVec2 win = vdbNDCToWindow(ndc.x, ndc.y);
 
@@ -65,11 +67,13 @@ int vdbGetMouseOverIndex(float *x, float *y, float *z)
 
 vdbVec2 vdbGetMousePos()
 {
+    mouse::position_used = true;
     return vdbVec2((float)mouse::x, (float)mouse::y);
 }
 
 vdbVec2 vdbGetMousePosNDC()
 {
+    mouse::position_used = true;
     return mouse::ndc;
 }
 
@@ -0,0 +1,469 @@
+// Renders a screenshot at a resolution larger than the window (e.g. 16k x 16k),
+// for prints and posters. The image is split into window-sized tiles, one tile
+// is rendered per frame into an offscreen framebuffer, and each tile is drawn
+// by scaling and offsetting the projection matrix so that the tile's part of
+// normalized device coordinates fills the framebuffer:
+//
+//       poster (3x2 tiles)             tile (1,0)
+//     -------------------          ----------------
+//    | (0,0) |(1,0)| (2,0)|       |                |
+//    |-------+-----+------|  -->  |  ndc*S + T     |
+//    | (0,1) |(1,1)| (2,1)|       |                |
+//     -------------------          ----------------
+//
+// Tiles are rendered strip by strip from the top. When a horizontal strip of
+// tiles is done its rows are filtered, deflated and appended to the PNG file,
+// so only one strip is ever held in memory. Because tiles are rendered on
+// successive frames, the scene should be static while the poster renders.
+// Lines and points keep their size in pixels, so they look thinner relative
+// to the scene than on screen.
+
+// Writes a PNG one row at a time. stb_image_write needs the whole image in
+// memory, so this has its own (simple) deflate encoder: each row becomes one
+// fixed-Huffman block with LZ77 matches found through a single-entry hash table.
+struct png_stream_t
+{
+    FILE *f;
+    int width;
+    int height;
+    int channels;
+    int rows_written;
+    unsigned char *filtered; // filter type byte + width*channels bytes
+    unsigned char *prev_row; // previous unfiltered row (zero for the first row)
+    unsigned char *out; // compressed bytes waiting to be written as an IDAT chunk
+    size_t out_count;
+    unsigned int bit_buffer;
+    int bit_count;
+    unsigned int adler_a;
+    unsigned int adler_b;
+    int *hash_head;
+};
+
+namespace png_stream
+{
+    enum { HASH_BITS = 14, MAX_MATCH = 258, WINDOW_SIZE = 32768 };
+
+    static unsigned int Crc32(unsigned int crc, const unsigned char *data, size_t count)
+    {
+        static unsigned int table[256];
+        if (!table[1])
+        {
+            for (unsigned int i = 0; i < 256; i++)
+            {
+                unsigned int c = i;
+                for (int k = 0; k < 8; k++)
+                    c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+                table[i] = c;
+            }
+        }
+        crc = ~crc;
+        for (size_t i = 0; i < count; i++)
+            crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+        return ~crc;
+    }
+
+    static void WriteBE32(unsigned char *dst, unsigned int x)
+    {
+        dst[0] = (unsigned char)(x >> 24);
+        dst[1] = (unsigned char)(x >> 16);
+        dst[2] = (unsigned char)(x >> 8);
+        dst[3] = (unsigned char)(x);
+    }
+
+    static void WriteChunk(FILE *f, const char *type, const unsigned char *data, size_t count)
+    {
+        unsigned char header[8];
+        WriteBE32(header, (unsigned int)count);
+        memcpy(header + 4, type, 4);
+        unsigned int crc = Crc32(0, header + 4, 4);
+        crc = Crc32(crc, data, count);
+        unsigned char footer[4];
+        WriteBE32(footer, crc);
+        fwrite(header, 1, 8, f);
+        if (count > 0)
+            fwrite(data, 1, count, f);
+        fwrite(footer, 1, 4, f);
+    }
+
+    static void PutBits(png_stream_t *s, unsigned int bits, int count)
+    {
+        s->bit_buffer |= bits << s->bit_count;
+        s->bit_count += count;
+        while (s->bit_count >= 8)
+        {
+            s->out[s->out_count++] = (unsigned char)(s->bit_buffer & 0xff);
+            s->bit_buffer >>= 8;
+            s->bit_count -= 8;
+        }
+    }
+
+    // Huffman codes are stored most significant bit first, everything else least significant bit first.
+    static unsigned int ReverseBits(unsigned int code, int count)
+    {
+        unsigned int result = 0;
+        for (int i = 0; i < count; i++)
+        {
+            result = (result << 1) | (code & 1);
+            code >>= 1;
+        }
+        return result;
+    }
+
+    static void PutSymbol(png_stream_t *s, int symbol) // fixed Huffman literal/length code
+    {
+        if      (symbol <= 143) PutBits(s, ReverseBits(0x30 + symbol, 8), 8);
+        else if (symbol <= 255) PutBits(s, ReverseBits(0x190 + symbol - 144, 9), 9);
+        else if (symbol <= 279) PutBits(s, ReverseBits(symbol - 256, 7), 7);
+        else                    PutBits(s, ReverseBits(0xc0 + symbol - 280, 8), 8);
+    }
+
+    static void PutMatch(png_stream_t *s, int length, int distance)
+    {
+        static const int length_base[29] = { 3,4,5,6,7,8,9,10,11,13,15,17,19,23,27,31,35,43,51,59,67,83,99,115,131,163,195,227,258 };
+        static const int length_extra[29] = { 0,0,0,0,0,0,0,0,1,1,1,1,2,2,2,2,3,3,3,3,4,4,4,4,5,5,5,5,0 };
+        static const int distance_base[30] = { 1,2,3,4,5,7,9,13,17,25,33,49,65,97,129,193,257,385,513,769,1025,1537,2049,3073,4097,6145,8193,12289,16385,24577 };
+        static const int distance_extra[30] = { 0,0,0,0,1,1,2,2,3,3,4,4,5,5,6,6,7,7,8,8,9,9,10,10,11,11,12,12,13,13 };
+        int i = 28;
+        while (length_base[i] > length) i--;
+        PutSymbol(s, 257 + i);
+        if (length_extra[i]) PutBits(s, length - length_base[i], length_extra[i]);
+        int j = 29;
+        while (distance_base[j] > distance) j--;
+        PutBits(s, ReverseBits(j, 5), 5);
+        if (distance_extra[j]) PutBits(s, distance - distance_base[j], distance_extra[j]);
+    }
+
+    static unsigned int Hash3(const unsigned char *p)
+    {
+        unsigned int x = (p[0] << 16) | (p[1] << 8) | p[2];
+        return (x*2654435761u) >> (32 - HASH_BITS);
+    }
+
+    // Compresses data as a single non-final deflate block.
+    static void PutBlock(png_stream_t *s, const unsigned char *data, int count)
+    {
+        PutBits(s, 0, 1); // BFINAL = 0
+        PutBits(s, 1, 2); // BTYPE = 1 (fixed Huffman)
+
+        for (int i = 0; i < (1 << HASH_BITS); i++)
+            s->hash_head[i] = -1;
+
+        int i = 0;
+        while (i < count)
+        {
+            int length = 0;
+            int candidate = -1;
+            if (i + 3 <= count)
+            {
+                unsigned int h = Hash3(data + i);
+                candidate = s->hash_head[h];
+                s->hash_head[h] = i;
+            }
+            if (candidate >= 0 && i - candidate <= WINDOW_SIZE)
+            {
+                int max_length = count - i < MAX_MATCH ? count - i : MAX_MATCH;
+                while (length < max_length && data[candidate + length] == data[i + length])
+                    length++;
+            }
+            if (length >= 3)
+            {
+                PutMatch(s, length, i - candidate);
+                for (int k = 1; k < length && i + k + 3 <= count; k++)
+                    s->hash_head[Hash3(data + i + k)] = i + k;
+                i += length;
+            }
+            else
+            {
+                PutSymbol(s, data[i]);
+                i++;
+            }
+        }
+        PutSymbol(s, 256); // end of block
+    }
+
+    static void UpdateAdler32(png_stream_t *s, const unsigned char *data, int count)
+    {
+        unsigned int a = s->adler_a;
+        unsigned int b = s->adler_b;
+        while (count > 0)
+        {
+            int n = count < 5552 ? count : 5552; // largest n such that b cannot overflow
+            for (int i = 0; i < n; i++)
+            {
+                a += data[i];
+                b += a;
+            }
+            a %= 65521;
+            b %= 65521;
+            data += n;
+            count -= n;
+        }
+        s->adler_a = a;
+        s->adler_b = b;
+    }
+
+    static unsigned char Paeth(int a, int b, int c)
+    {
+        int p = a + b - c;
+        int pa = abs(p - a);
+        int pb = abs(p - b);
+        int pc = abs(p - c);
+        if (pa <= pb && pa <= pc) return (unsigned char)a;
+        if (pb <= pc) return (unsigned char)b;
+        return (unsigned char)c;
+    }
+
+    static void FilterRow(unsigned char *dst, const unsigned char *row, const unsigned char *prev, int count, int n, int type)
+    {
+        for (int i = 0; i < count; i++)
+        {
+            int left = i >= n ? row[i-n] : 0;
+            int up_left = i >= n ? prev[i-n] : 0;
+            if      (type == 1) dst[i] = (unsigned char)(row[i] - left);
+            else if (type == 2) dst[i] = (unsigned char)(row[i] - prev[i]);
+            else                dst[i] = (unsigned char)(row[i] - Paeth(left, prev[i], up_left));
+        }
+    }
+
+    static bool Open(png_stream_t *s, const char *filename, int width, int height, int channels)
+    {
+        assert(channels == 3 || channels == 4);
+        memset(s, 0, sizeof(png_stream_t));
+        s->f = fopen(filename, "wb");
+        if (!s->f)
+            return false;
+        s->width = width;
+        s->height = height;
+        s->channels = channels;
+        size_t row_size = (size_t)width*channels;
+        s->filtered = (unsigned char*)malloc(row_size + 1);
+        s->prev_row = (unsigned char*)calloc(row_size, 1);
+        s->out = (unsigned char*)malloc(2*row_size + 64); // fixed Huffman uses at most 9 bits per byte
+        s->hash_head = (int*)malloc(sizeof(int) << HASH_BITS);
+        assert(s->filtered && s->prev_row && s->out && s->hash_head);
+        s->adler_a = 1;
+        s->adler_b = 0;
+
+        static const unsigned char signature[8] = { 137,80,78,71,13,10,26,10 };
+        fwrite(signature, 1, 8, s->f);
+        unsigned char ihdr[13];
+        WriteBE32(ihdr, width);
+        WriteBE32(ihdr + 4, height);
+        ihdr[8] = 8; // bit depth
+        ihdr[9] = channels == 4 ? 6 : 2; // color type (RGBA or RGB)
+        ihdr[10] = 0; // compression
+        ihdr[11] = 0; // filter
+        ihdr[12] = 0; // interlace
+        WriteChunk(s->f, "IHDR", ihdr, 13);
+
+        s->out[s->out_count++] = 0x78; // zlib header: deflate, 32K window
+        s->out[s->out_count++] = 0x01;
+        return true;
+    }
+
+    // Rows are given from top to bottom.
+    static void WriteRow(png_stream_t *s, const unsigned char *row)
+    {
+        assert(s->f);
+        assert(s->rows_written < s->height);
+        int count = s->width*s->channels;
+        int n = s->channels;
+
+        // pick the filter with the smallest sum of absolute differences (same heuristic as stb_image_write)
+        int best_type = 1;
+        long long best_sum = -1;
+        for (int type = 1; type <= 4; type++)
+        {
+            if (type == 3)
+                continue;
+            FilterRow(s->filtered + 1, row, s->prev_row, count, n, type);
+            long long sum = 0;
+            for (int i = 1; i <= count; i++)
+                sum += abs((signed char)s->filtered[i]);
+            if (best_sum < 0 || sum < best_sum)
+            {
+                best_sum = sum;
+                best_type = type;
+            }
+        }
+        if (best_type != 4)
+            FilterRow(s->filtered + 1, row, s->prev_row, count, n, best_type);
+        s->filtered[0] = (unsigned char)best_type;
+
+        PutBlock(s, s->filtered, count + 1);
+        UpdateAdler32(s, s->filtered, count + 1);
+        WriteChunk(s->f, "IDAT", s->out, s->out_count);
+        s->out_count = 0;
+
+        memcpy(s->prev_row, row, count);
+        s->rows_written++;
+    }
+
+    // Returns false if the file could not be written completely.
+    static bool Close(png_stream_t *s)
+    {
+        if (!s->f)
+            return false;
+        bool ok = s->rows_written == s->height;
+        PutBits(s, 1, 1); // BFINAL = 1
+        PutBits(s, 1, 2); // BTYPE = 1 (fixed Huffman)
+        PutSymbol(s, 256); // empty block
+        if (s->bit_count > 0)
+            PutBits(s, 0, 8 - s->bit_count);
+        WriteBE32(s->out + s->out_count, (s->adler_b << 16) | s->adler_a);
+        s->out_count += 4;
+        WriteChunk(s->f, "IDAT", s->out, s->out_count);
+        WriteChunk(s->f, "IEND", NULL, 0);
+        if (ferror(s->f))
+            ok = false;
+        fclose(s->f);
+        free(s->filtered);
+        free(s->prev_row);
+        free(s->out);
+        free(s->hash_head);
+        memset(s, 0, sizeof(png_stream_t));
+        return ok;
+    }
+}
+
+namespace poster
+{
+    static bool active;
+    static char filename[1024];
+    static int width; // size of the full poster
+    static int height;
+    static int channels;
+    static framebuffer_t tile;
+    static int num_tiles_x;
+    static int num_tiles_y;
+    static int tile_x; // tile currently being rendered (column, and strip counted from the top)
+    static int tile_y;
+    static unsigned char *strip; // one horizontal strip of tiles (tile.height rows of the poster)
+    static png_stream_t png;
+
+    static void Free()
+    {
+        active = false;
+        free(strip);
+        strip = NULL;
+        FreeFramebuffer(&tile);
+    }
+
+    static void Start(const char *output_filename, int poster_width, int poster_height, bool alpha_channel)
+    {
+        assert(!active);
+        assert(poster_width > 0 && poster_height > 0);
+
+        // Tiles are window-sized so that lines and points (specified in window pixels) come out right.
+        GLint max_size;
+        glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_size);
+        int tile_width = window::framebuffer_width < max_size ? window::framebuffer_width : max_size;
+        int tile_height = window::framebuffer_height < max_size ? window::framebuffer_height : max_size;
+
+        snprintf(filename, sizeof(filename), "%s", output_filename);
+        width = poster_width;
+        height = poster_height;
+        channels = alpha_channel ? 4 : 3;
+        num_tiles_x = (width + tile_width - 1)/tile_width;
+        num_tiles_y = (height + tile_height - 1)/tile_height;
+        tile_x = 0;
+        tile_y = 0;
+
+        strip = (unsigned char*)malloc((size_t)width*tile_height*channels);
+        if (!strip)
+        {
+            fprintf(stderr, "Not enough memory to render a %dx%d poster\n", width, height);
+            return;
+        }
+        if (!png_stream::Open(&png, filename, width, height, channels))
+        {
+            fprintf(stderr, "Failed to open %s for writing\n", filename);
+            free(strip);
+            strip = NULL;
+            return;
+        }
+        tile = MakeFramebuffer(tile_width, tile_height, GL_NEAREST, GL_NEAREST, true);
+        active = true;
+    }
+
+    static void Cancel()
+    {
+        if (!active)
+            return;
+        png_stream::Close(&png);
+        remove(filename);
+        Free();
+    }
+
+    static int TileBottom() // poster row (counted from the bottom, as in OpenGL) of the tile's first row
+    {
+        return height - (tile_y + 1)*tile.height; // negative for the last strip if height isn't a multiple
+    }
+
+    // Called in place of the render scaler at the start of the frame.
+    static void BeginTile()
+    {
+        assert(active);
+        EnableFramebuffer(&tile);
+        {
+            GLboolean depth_test = glIsEnabled(GL_DEPTH_TEST);
+            GLboolean depth_mask; glGetBooleanv(GL_DEPTH_WRITEMASK, &depth_mask);
+            vdbDepthWrite(true);
+            vdbDepthTest(true);
+            glClear(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
+            vdbDepthWrite(depth_mask);
+            vdbDepthTest(depth_test);
+        }
+
+        // viewports are given in poster pixels from here on (see transform.h)
+        transform::tiled_framebuffer = &tile;
+        transform::tiled_width = width;
+        transform::tiled_height = height;
+        transform::tile_left = tile_x*tile.width;
+        transform::tile_bottom = TileBottom();
+        vdbViewporti(0, 0, width, height);
+        vdbProjection(NULL);
+    }
+
+    // Called at the end of the frame, after the grid is drawn but before ImGui.
+    static void EndTile()
+    {
+        assert(active);
+        int x0 = tile_x*tile.width;
+        int y0 = TileBottom();
+        int read_x = x0 + tile.width <= width ? tile.width : width - x0;
+        int read_y = y0 >= 0 ? 0 : -y0;
+
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glPixelStorei(GL_PACK_ROW_LENGTH, width);
+        glReadPixels(0, read_y, read_x, tile.height - read_y,
+                     channels == 4 ? GL_RGBA : GL_RGB, GL_UNSIGNED_BYTE,
+                     strip + ((size_t)read_y*width + x0)*channels);
+        glPixelStorei(GL_PACK_ROW_LENGTH, 0);
+        DisableFramebuffer(&tile);
+
+        transform::tiled_framebuffer = NULL;
+        vdbProjection(NULL);
+
+        tile_x++;
+        if (tile_x == num_tiles_x)
+        {
+            // strip is bottom-up, the PNG is top-down
+            for (int y = tile.height - 1; y >= read_y; y--)
+                png_stream::WriteRow(&png, strip + (size_t)y*width*channels);
+            tile_x = 0;
+            tile_y++;
+        }
+
+        if (tile_y == num_tiles_y)
+        {
+            if (png_stream::Close(&png))
+                printf("Saved %dx%d poster to %s\n", width, height, filename);
+            else
+                fprintf(stderr, "Failed to write poster to %s\n", filename);
+            Free();
+        }
+        window::DontWaitNextFrameEvents();
+    }
+}
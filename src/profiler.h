@@ -0,0 +1,330 @@
+// CPU profiler zones (see vdbProfileBegin). Each thread writes the start and end of
+// its zones, with a high-resolution timestamp, into a single-producer single-consumer
+// ring buffer of its own, so recording a zone takes no locks and no allocation. At the
+// first frame of each break the buffers are emptied into a list of zones that cover
+// the time since the previous break, i.e. the program's own work between two VDBB
+// blocks, which Tools > Profiler shows as a flame graph with one lane per thread.
+//
+// Zones that don't fit in the buffer (VDB_PROFILE_BUFFER_SIZE events per thread) are
+// dropped together with the zones inside them. Zone names are not copied.
+#include <algorithm>
+
+struct profile_event_t
+{
+    uint64_t time; // SDL_GetPerformanceCounter
+    const char *name; // NULL for the end of a zone
+};
+
+struct profile_zone_t
+{
+    const char *name;
+    uint64_t begin, end;
+    int depth;
+    int lane;
+};
+
+struct profile_total_t
+{
+    const char *name;
+    int count;
+    uint64_t time;
+};
+
+struct profile_thread_t
+{
+    profile_event_t *events;
+    uint32_t capacity; // power of two
+    SDL_atomic_t write_pos; // advanced by the profiled thread
+    SDL_atomic_t read_pos; // advanced by Collect
+    SDL_atomic_t dropped; // zones that didn't fit
+    int depth; // zones written and not yet ended (profiled thread)
+    int skipped; // zones not written and not yet ended (profiled thread)
+    int lane;
+    profile_event_t open[64]; // zones begun and not yet ended (Collect)
+    int num_open;
+    profile_thread_t *next;
+};
+
+namespace profiler
+{
+    enum { MAX_DEPTH = 64 };
+    static thread_local profile_thread_t *thread;
+    static void *first; // list of all buffers, profile_thread_t*
+    static SDL_atomic_t num_lanes;
+    static SDL_atomic_t collecting;
+
+    // the zones since the previous break
+    static std::vector<profile_zone_t> zones;
+    static std::vector<profile_total_t> totals; // by total time
+    static uint64_t period_begin;
+    static uint64_t period_end;
+    static int num_dropped;
+    static int max_depth;
+
+    static bool window_open;
+    static bool zoomed;
+    static double view_begin, view_end; // seconds since period_begin
+
+    static profile_thread_t *GetThread()
+    {
+        if (thread)
+            return thread;
+        profile_thread_t *t = (profile_thread_t*)calloc(1, sizeof(profile_thread_t));
+        assert(t && "Ran out of memory for the profiler");
+        t->capacity = VDB_PROFILE_BUFFER_SIZE;
+        t->events = (profile_event_t*)malloc(t->capacity*sizeof(profile_event_t));
+        assert(t->events && "Ran out of memory for the profiler");
+        t->lane = SDL_AtomicAdd(&num_lanes, 1);
+        do t->next = (profile_thread_t*)SDL_AtomicGetPtr(&first);
+        while (!SDL_AtomicCASPtr(&first, t->next, t));
+        thread = t;
+        return t;
+    }
+
+    static void Begin(const char *name)
+    {
+        profile_thread_t *t = GetThread();
+        uint32_t write_pos = (uint32_t)SDL_AtomicGet(&t->write_pos);
+        uint32_t read_pos = spsc::Load(&t->read_pos);
+        uint32_t space = t->capacity - (write_pos - read_pos);
+
+        // leave room for the ends of every open zone, so that they are never dropped
+        if (t->skipped > 0 || t->depth == MAX_DEPTH || space < (uint32_t)t->depth + 2)
+        {
+            if (t->skipped == 0)
+                SDL_AtomicAdd(&t->dropped, 1);
+            t->skipped++;
+            return;
+        }
+        profile_event_t *e = t->events + (write_pos & (t->capacity - 1));
+        e->name = name;
+        e->time = SDL_GetPerformanceCounter();
+        spsc::Store(&t->write_pos, write_pos + 1);
+        t->depth++;
+    }
+
+    static void End()
+    {
+        uint64_t now = SDL_GetPerformanceCounter();
+        profile_thread_t *t = GetThread();
+        if (t->skipped > 0)
+        {
+            t->skipped--;
+            return;
+        }
+        assert(t->depth > 0 && "vdbProfileEnd without vdbProfileBegin");
+        if (t->depth == 0)
+            return;
+        uint32_t write_pos = (uint32_t)SDL_AtomicGet(&t->write_pos);
+        profile_event_t *e = t->events + (write_pos & (t->capacity - 1));
+        e->name = NULL;
+        e->time = now;
+        spsc::Store(&t->write_pos, write_pos + 1);
+        t->depth--;
+    }
+
+    static void AddTotal(const char *name, uint64_t time)
+    {
+        for (size_t i = 0; i < totals.size(); i++)
+        {
+            if (totals[i].name == name || strcmp(totals[i].name, name) == 0)
+            {
+                totals[i].count++;
+                totals[i].time += time;
+                return;
+            }
+        }
+        profile_total_t total = { name, 1, time };
+        totals.push_back(total);
+    }
+
+    static bool CompareTotals(const profile_total_t &a, const profile_total_t &b)
+    {
+        return a.time > b.time;
+    }
+
+    // Called at the first frame of every break.
+    static void Collect()
+    {
+        if (!SDL_AtomicCAS(&collecting, 0, 1))
+            return;
+        uint64_t now = SDL_GetPerformanceCounter();
+        period_begin = period_end ? period_end : now;
+        period_end = now;
+        zones.clear();
+        totals.clear();
+        num_dropped = 0;
+        max_depth = 0;
+        for (profile_thread_t *t = (profile_thread_t*)SDL_AtomicGetPtr(&first); t; t = t->next)
+        {
+            uint32_t read_pos = (uint32_t)SDL_AtomicGet(&t->read_pos);
+            uint32_t write_pos = spsc::Load(&t->write_pos);
+            for (; read_pos != write_pos; read_pos++)
+            {
+                profile_event_t e = t->events[read_pos & (t->capacity - 1)];
+                if (e.name)
+                {
+                    if (period_begin > e.time)
+                        period_begin = e.time; // the first zones ever recorded
+                    t->open[t->num_open++] = e;
+                }
+                else if (t->num_open > 0)
+                {
+                    profile_event_t begin = t->open[--t->num_open];
+                    profile_zone_t zone;
+                    zone.name = begin.name;
+                    zone.begin = begin.time;
+                    zone.end = e.time;
+                    zone.depth = t->num_open;
+                    zone.lane = t->lane;
+                    zones.push_back(zone);
+                    AddTotal(zone.name, zone.end - zone.begin);
+                }
+            }
+            spsc::Store(&t->read_pos, read_pos);
+
+            // zones that are still open are shown until now, and again next time
+            for (int i = 0; i < t->num_open; i++)
+            {
+                profile_zone_t zone;
+                zone.name = t->open[i].name;
+                zone.begin = t->open[i].time;
+                zone.end = now;
+                zone.depth = i;
+                zone.lane = t->lane;
+                zones.push_back(zone);
+            }
+            num_dropped += SDL_AtomicSet(&t->dropped, 0);
+        }
+        for (size_t i = 0; i < zones.size(); i++)
+        {
+            if (zones[i].begin < period_begin)
+                zones[i].begin = period_begin; // still open from an earlier period
+            if (zones[i].depth > max_depth)
+                max_depth = zones[i].depth;
+        }
+        std::sort(totals.begin(), totals.end(), CompareTotals);
+        SDL_AtomicSet(&collecting, 0);
+    }
+
+    static ImU32 NameColor(const char *name)
+    {
+        uint32_t h = 2166136261u;
+        for (const char *c = name; *c; c++)
+            h = (h ^ (unsigned char)*c)*16777619u;
+        float hue = (h % 360)/360.0f;
+        float r,g,b;
+        ImGui::ColorConvertHSVtoRGB(hue, 0.5f, 0.8f, r, g, b);
+        return ImGui::GetColorU32(ImVec4(r, g, b, 1.0f));
+    }
+
+    static void Window()
+    {
+        if (!window_open)
+            return;
+        ImGui::SetNextWindowSize(ImVec2(600, 300), ImGuiCond_FirstUseEver);
+        if (!ImGui::Begin("Profiler", &window_open))
+        {
+            ImGui::End();
+            return;
+        }
+
+        double frequency = (double)SDL_GetPerformanceFrequency();
+        double duration = (double)(period_end - period_begin)/frequency;
+        ImGui::Text("%.3f ms since the previous break, %d zones", 1000.0*duration, (int)zones.size());
+        if (num_dropped > 0)
+        {
+            ImGui::SameLine();
+            ImGui::TextColored(ImVec4(1.0f, 0.5f, 0.3f, 1.0f), "(%d dropped, see VDB_PROFILE_BUFFER_SIZE)", num_dropped);
+        }
+        if (zones.empty())
+        {
+            ImGui::TextDisabled("Use vdbProfileBegin/End or VDB_PROFILE to add zones.");
+            ImGui::End();
+            return;
+        }
+
+        // flame graph: one lane per thread, one row per depth
+        int lanes = SDL_AtomicGet(&num_lanes);
+        float row_height = ImGui::GetTextLineHeight() + 4.0f;
+        float lane_height = (max_depth + 1)*row_height + 4.0f;
+        ImVec2 size = ImVec2(ImGui::GetContentRegionAvailWidth(), lanes*lane_height);
+        ImVec2 p0 = ImGui::GetCursorScreenPos();
+        ImGui::InvisibleButton("##flame", size);
+        bool hovered = ImGui::IsItemHovered();
+
+        if (!zoomed || duration <= 0.0)
+        {
+            view_begin = 0.0;
+            view_end = duration > 0.0 ? duration : 1e-6;
+        }
+        double width = view_end - view_begin;
+        ImVec2 mouse = ImGui::GetIO().MousePos;
+        double t = (mouse.x - p0.x)/size.x;
+        if (hovered && ImGui::GetIO().MouseWheel != 0.0f)
+        {
+            double center = view_begin + t*width;
+            width *= pow(0.8, (double)ImGui::GetIO().MouseWheel);
+            view_begin = center - t*width;
+            view_end = view_begin + width;
+            zoomed = true;
+        }
+        if (ImGui::IsItemActive() && ImGui::IsMouseDragging(0))
+        {
+            double dx = ImGui::GetIO().MouseDelta.x/size.x*width;
+            view_begin -= dx;
+            view_end -= dx;
+            zoomed = true;
+        }
+        if (hovered && ImGui::IsMouseDoubleClicked(0))
+            zoomed = false;
+
+        ImDrawList *draw_list = ImGui::GetWindowDrawList();
+        ImVec2 p1 = ImVec2(p0.x + size.x, p0.y + size.y);
+        draw_list->AddRectFilled(p0, p1, ImGui::GetColorU32(ImGuiCol_FrameBg));
+        draw_list->PushClipRect(p0, p1, true);
+        const profile_zone_t *hovered_zone = NULL;
+        ImU32 text_color = ImGui::GetColorU32(ImVec4(0,0,0,1));
+        for (size_t i = 0; i < zones.size(); i++)
+        {
+            const profile_zone_t &z = zones[i];
+            double begin = (double)(z.begin - period_begin)/frequency;
+            double end = (double)(z.end - period_begin)/frequency;
+            float x0 = p0.x + (float)((begin - view_begin)/width*size.x);
+            float x1 = p0.x + (float)((end - view_begin)/width*size.x);
+            if (x1 < p0.x || x0 > p1.x || x1 - x0 < 0.5f)
+                continue;
+            float y0 = p0.y + z.lane*lane_height + z.depth*row_height;
+            ImVec2 a = ImVec2(x0, y0);
+            ImVec2 b = ImVec2(x1, y0 + row_height - 1.0f);
+            draw_list->AddRectFilled(a, b, NameColor(z.name));
+            if (x1 - x0 > 20.0f)
+            {
+                ImVec4 clip = ImVec4(x0 > p0.x ? x0 : p0.x, a.y, x1 < p1.x ? x1 : p1.x, b.y);
+                draw_list->AddText(NULL, 0.0f, ImVec2(clip.x + 2.0f, a.y + 2.0f), text_color, z.name, NULL, 0.0f, &clip);
+            }
+            if (hovered && mouse.x >= a.x && mouse.x < b.x && mouse.y >= a.y && mouse.y < b.y)
+                hovered_zone = &z;
+        }
+        draw_list->PopClipRect();
+        if (hovered_zone)
+            ImGui::SetTooltip("%s\n%.3f ms", hovered_zone->name, 1000.0*(hovered_zone->end - hovered_zone->begin)/frequency);
+
+        // total time per zone name
+        ImGui::Columns(3, "##totals");
+        ImGui::TextDisabled("Zone"); ImGui::NextColumn();
+        ImGui::TextDisabled("Calls"); ImGui::NextColumn();
+        ImGui::TextDisabled("Total"); ImGui::NextColumn();
+        for (size_t i = 0; i < totals.size(); i++)
+        {
+            ImGui::Text("%s", totals[i].name); ImGui::NextColumn();
+            ImGui::Text("%d", totals[i].count); ImGui::NextColumn();
+            ImGui::Text("%.3f ms", 1000.0*totals[i].time/frequency); ImGui::NextColumn();
+        }
+        ImGui::Columns(1);
+        ImGui::End();
+    }
+}
+
+void vdbProfileBegin(const char *name) { profiler::Begin(name); }
+void vdbProfileEnd() { profiler::End(); }
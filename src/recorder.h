@@ -0,0 +1,383 @@
+// The recorder (see vdbRecordToFile) writes what each break drew to a .vdbrec file
+// (see vdbrec.h). Only the first frame of each visit to a break is recorded, i.e.
+// after every step, since that is when the user's data changes. It uses watch.h's
+// command stream in passthrough mode: the block runs as usual while its calls are
+// recorded, so the same functions can be recorded (no shaders, render targets or
+// widgets). Calls made by the built-in cameras and the grid are not part of the
+// recording, so a recording is viewed with the camera of the player.
+//
+// vdbPlayRecording replays a recording in a normal vdb loop: F10 steps to the next
+// frame, and a slider scrubs through all of them.
+
+// recordings of long runs may be larger than 2 GB
+#ifdef _MSC_VER
+#define vdb_fseek64 _fseeki64
+#define vdb_ftell64 _ftelli64
+#else
+#define vdb_fseek64 fseeko
+#define vdb_ftell64 ftello
+#endif
+
+namespace recorder
+{
+    static FILE *file;
+    static char *file_buffer;
+    static bool capturing; // inside the first frame of a break that is being recorded
+    static watch_snapshot_t frame; // calls recorded this frame
+    static watch_snapshot_t packed; // same, with chunks replaced by references
+    static uint64_t *chunks; // hashes of chunks already in the file (open addressing, 0 = empty)
+    static size_t chunks_capacity;
+    static size_t num_chunks;
+
+    static void CheckEnvironment()
+    {
+        const char *filename = getenv("VDB_RECORD");
+        if (!file && filename && *filename)
+            vdbRecordToFile(filename);
+    }
+
+    // Returns true if the chunk was already in the table.
+    static bool InsertChunk(uint64_t hash)
+    {
+        if (2*(num_chunks + 1) > chunks_capacity)
+        {
+            size_t old_capacity = chunks_capacity;
+            uint64_t *old_chunks = chunks;
+            chunks_capacity = old_capacity ? 2*old_capacity : 1024;
+            chunks = (uint64_t*)calloc(chunks_capacity, sizeof(uint64_t));
+            assert(chunks && "Ran out of memory recording to file");
+            num_chunks = 0;
+            for (size_t i = 0; i < old_capacity; i++)
+                if (old_chunks[i])
+                    InsertChunk(old_chunks[i]);
+            free(old_chunks);
+        }
+        size_t i = (size_t)(hash % chunks_capacity);
+        while (chunks[i])
+        {
+            if (chunks[i] == hash)
+                return true;
+            i = (i + 1) % chunks_capacity;
+        }
+        chunks[i] = hash;
+        num_chunks++;
+        return false;
+    }
+
+    static void WriteRecord(uint32_t type, const void *header, size_t header_size, const void *data, size_t data_size)
+    {
+        vdbrec_record_t record;
+        record.type = type;
+        record.size = (uint32_t)(header_size + data_size);
+        fwrite(&record, sizeof(record), 1, file);
+        fwrite(header, 1, header_size, file);
+        fwrite(data, 1, data_size, file);
+    }
+
+    static void BeginFrame(const char *label)
+    {
+        frame.used = 0;
+        frame.label = label;
+        watch::destination = &frame;
+        watch::recording = true;
+        watch::passthrough = true;
+        capturing = true;
+    }
+
+    static void EndFrame()
+    {
+        watch::recording = false;
+        watch::passthrough = false;
+        capturing = false;
+        if (!file)
+            return; // only captured for the frame history (see history.h)
+
+        // Store large vdbBegin/vdbEnd batches and images as chunks, and replace each
+        // by a reference. Chunks were either written before or are written now, ahead
+        // of the frame that refers to them.
+        packed.used = 0;
+        const unsigned char *p = frame.data;
+        const unsigned char *end = frame.data + frame.used;
+        while (p < end)
+        {
+            // the frame was recorded by us, so every op fits (OpSize is never 0)
+            const unsigned char *q = p + watch::OpSize(p, end);
+            if (*p == WATCH_BEGIN_LINES || *p == WATCH_BEGIN_POINTS || *p == WATCH_BEGIN_TRIANGLES)
+            {
+                while (q < end && *q != WATCH_END)
+                    q += watch::OpSize(q, end);
+                if (q < end)
+                    q += watch::OpSize(q, end);
+            }
+
+            size_t size = (size_t)(q - p);
+            if (size >= VDB_RECORD_MIN_CHUNK_SIZE)
+            {
+                uint64_t hash = vdbrec::Hash(p, size);
+                if (!InsertChunk(hash))
+                    WriteRecord(VDBREC_CHUNK, &hash, sizeof(hash), p, size);
+                unsigned char *r = watch::Reserve(1 + sizeof(hash), &packed);
+                r[0] = VDBREC_OP_CHUNK;
+                memcpy(r + 1, &hash, sizeof(hash));
+            }
+            else
+            {
+                memcpy(watch::Reserve(size, &packed), p, size);
+            }
+            p = q;
+        }
+
+        const char *label = frame.label ? frame.label : "";
+        uint32_t label_length = (uint32_t)strlen(label);
+        double time = window::GetTime();
+        unsigned char header[sizeof(double) + 4 + 256];
+        if (label_length > 256)
+            label_length = 256;
+        memcpy(header + 0, &time, sizeof(double));
+        memcpy(header + sizeof(double), &label_length, 4);
+        memcpy(header + sizeof(double) + 4, label, label_length);
+        WriteRecord(VDBREC_FRAME, header, sizeof(double) + 4 + label_length, packed.data, packed.used);
+
+        // keep every complete frame if the program stops early
+        fflush(file);
+    }
+
+    static void Close()
+    {
+        if (!file)
+            return;
+        fclose(file);
+        file = NULL;
+        free(file_buffer);
+        file_buffer = NULL;
+        free(chunks);
+        chunks = NULL;
+        chunks_capacity = 0;
+        num_chunks = 0;
+    }
+
+    // Playback
+
+    struct frame_index_t
+    {
+        int64_t offset; // of the command stream
+        uint32_t size;
+        const char *label;
+        double time;
+    };
+    struct chunk_index_t
+    {
+        uint64_t hash;
+        int64_t offset;
+        uint32_t size;
+    };
+
+    static int CompareChunks(const void *a, const void *b)
+    {
+        uint64_t x = ((const chunk_index_t*)a)->hash;
+        uint64_t y = ((const chunk_index_t*)b)->hash;
+        return x < y ? -1 : (x > y ? 1 : 0);
+    }
+
+    // Expands the chunk references of a frame into a stream that watch::Replay accepts.
+    static bool ReadFrame(FILE *f, frame_index_t *fi, chunk_index_t *chunk_index, int num_chunk_index,
+                          watch_snapshot_t *temp, watch_snapshot_t *result)
+    {
+        temp->used = 0;
+        result->used = 0;
+        unsigned char *data = watch::Reserve(fi->size, temp);
+        if (vdb_fseek64(f, fi->offset, SEEK_SET) != 0 || fread(data, 1, fi->size, f) != fi->size)
+            return false;
+        const unsigned char *p = data;
+        const unsigned char *end = data + fi->size;
+        while (p < end)
+        {
+            if (*p == VDBREC_OP_CHUNK)
+            {
+                if (end - p < 9)
+                    return false;
+                chunk_index_t key;
+                memcpy(&key.hash, p + 1, sizeof(key.hash));
+                chunk_index_t *c = (chunk_index_t*)bsearch(&key, chunk_index, num_chunk_index, sizeof(chunk_index_t), CompareChunks);
+                if (!c || vdb_fseek64(f, c->offset, SEEK_SET) != 0)
+                    return false;
+                unsigned char *chunk = watch::Reserve(c->size, result);
+                if (fread(chunk, 1, c->size, f) != c->size)
+                    return false;
+                for (const unsigned char *q = chunk; q < chunk + c->size; )
+                {
+                    size_t size = watch::OpSize(q, chunk + c->size);
+                    if (size < 1)
+                        return false;
+                    q += size;
+                }
+                p += 9;
+            }
+            else
+            {
+                size_t size = watch::OpSize(p, end);
+                if (size < 1)
+                    return false;
+                memcpy(watch::Reserve(size, result), p, size);
+                p += size;
+            }
+        }
+        return true;
+    }
+}
+
+void vdbRecordToFile(const char *filename)
+{
+    recorder::Close();
+    if (!filename)
+        return;
+
+    recorder::file = fopen(filename, "wb");
+    if (!recorder::file)
+    {
+        fprintf(stderr, "vdb: failed to open %s for recording\n", filename);
+        return;
+    }
+    recorder::file_buffer = (char*)malloc(VDB_RECORD_BUFFER_SIZE);
+    if (recorder::file_buffer)
+        setvbuf(recorder::file, recorder::file_buffer, _IOFBF, VDB_RECORD_BUFFER_SIZE);
+
+    vdbrec_header_t header = {0};
+    memcpy(header.magic, VDBREC_MAGIC, sizeof(header.magic));
+    header.version = VDBREC_VERSION;
+    fwrite(&header, sizeof(header), 1, recorder::file);
+}
+
+bool vdbPlayRecording(const char *filename)
+{
+    using namespace recorder;
+    FILE *f = fopen(filename, "rb");
+    if (!f)
+    {
+        fprintf(stderr, "vdb: failed to open %s\n", filename);
+        return false;
+    }
+    vdbrec_header_t header;
+    if (fread(&header, sizeof(header), 1, f) != 1 ||
+        memcmp(header.magic, VDBREC_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != VDBREC_VERSION)
+    {
+        fprintf(stderr, "vdb: %s is not a valid .vdbrec file (version %d)\n", filename, VDBREC_VERSION);
+        fclose(f);
+        return false;
+    }
+
+    // Index the file. Labels are interned so that vdbBeginBreak sees one pointer per label.
+    frame_index_t *frames = NULL;
+    chunk_index_t *chunk_index = NULL;
+    const char **labels = NULL;
+    int num_frames = 0;
+    int num_chunk_index = 0;
+    int num_labels = 0;
+    vdbrec_record_t record;
+    while (fread(&record, sizeof(record), 1, f) == 1)
+    {
+        int64_t offset = (int64_t)vdb_ftell64(f);
+        if (record.type == VDBREC_CHUNK && record.size >= 8)
+        {
+            chunk_index_t c;
+            if (fread(&c.hash, sizeof(c.hash), 1, f) != 1)
+                break;
+            c.offset = offset + 8;
+            c.size = record.size - 8;
+            chunk_index = (chunk_index_t*)realloc(chunk_index, (num_chunk_index + 1)*sizeof(chunk_index_t));
+            chunk_index[num_chunk_index++] = c;
+        }
+        else if (record.type == VDBREC_FRAME && record.size >= sizeof(double) + 4)
+        {
+            frame_index_t fi;
+            uint32_t label_length;
+            char label[257];
+            if (fread(&fi.time, sizeof(double), 1, f) != 1 ||
+                fread(&label_length, 4, 1, f) != 1 ||
+                label_length > 256 || sizeof(double) + 4 + label_length > record.size ||
+                fread(label, 1, label_length, f) != label_length)
+                break;
+            label[label_length] = '\0';
+            fi.label = NULL;
+            for (int i = 0; i < num_labels && !fi.label; i++)
+                if (strcmp(labels[i], label) == 0)
+                    fi.label = labels[i];
+            if (!fi.label)
+            {
+                labels = (const char**)realloc(labels, (num_labels + 1)*sizeof(const char*));
+                fi.label = labels[num_labels++] = strdup(label);
+            }
+            fi.offset = offset + (int64_t)(sizeof(double) + 4 + label_length);
+            fi.size = record.size - (uint32_t)(sizeof(double) + 4 + label_length);
+            frames = (frame_index_t*)realloc(frames, (num_frames + 1)*sizeof(frame_index_t));
+            frames[num_frames++] = fi;
+        }
+        if (vdb_fseek64(f, offset + record.size, SEEK_SET) != 0)
+            break;
+    }
+    if (num_frames == 0)
+    {
+        fprintf(stderr, "vdb: %s has no frames\n", filename);
+        fclose(f);
+        return false;
+    }
+    qsort(chunk_index, num_chunk_index, sizeof(chunk_index_t), CompareChunks);
+
+    watch_snapshot_t temp = {0};
+    watch_snapshot_t commands = {0};
+    int loaded = -1;
+    int selected = 0;
+    int jump_to = -1;
+    int num_skipped = 0; // stop if every frame is skipped (e.g. F5 on every label)
+    while (num_skipped < num_frames)
+    {
+        frame_index_t *fi = frames + selected;
+        if (vdbBeginBreak(fi->label))
+        {
+            num_skipped = 0;
+            if (loaded != selected)
+            {
+                if (!ReadFrame(f, fi, chunk_index, num_chunk_index, &temp, &commands))
+                {
+                    fprintf(stderr, "vdb: frame %d of %s is corrupt\n", selected, filename);
+                    commands.used = 0;
+                }
+                loaded = selected;
+            }
+            watch::Replay(&commands);
+
+            ImGui::SetNextWindowPos(ImVec2(10.0f, 40.0f), ImGuiCond_FirstUseEver);
+            ImGui::Begin("Recording", NULL, ImGuiWindowFlags_AlwaysAutoResize);
+            int frame = selected;
+            ImGui::SliderInt("Frame", &frame, 0, num_frames - 1);
+            ImGui::Text("%s (%.2f s)", fi->label, fi->time);
+            ImGui::TextDisabled("F10: next frame");
+            ImGui::End();
+            if (frame != selected)
+            {
+                jump_to = frame;
+                vdbStepOnce(); // ends this break, so that the next one is a first frame
+            }
+            vdbEndBreak();
+        }
+        else if (jump_to >= 0)
+        {
+            selected = jump_to;
+            jump_to = -1;
+        }
+        else
+        {
+            selected = (selected + 1) % num_frames;
+            num_skipped++;
+        }
+    }
+
+    free(temp.data);
+    free(commands.data);
+    free(labels); // but not the labels themselves, which vdb may still point to
+    free(frames);
+    free(chunk_index);
+    fclose(f);
+    return true;
+}
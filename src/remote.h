@@ -0,0 +1,514 @@
+// In client mode (see vdbConnect), the vdb window, OpenGL context, SDL and ImGui live
+// in a separate viewer process (see vdbRunViewer and tools/vdbviewer). Breaks work
+// like in watch mode (see watch.h): vdbBeginBreak returns true once, the calls made
+// inside the block are recorded, and vdbEndBreak copies them into a ring buffer in
+// shared memory. The viewer replays the newest frame in the buffer every time it
+// draws. If the viewer falls behind and the buffer is full, frames are dropped
+// instead of waiting, so the debugged program only pays for recording and a memcpy.
+//
+// Input goes the other way over a Unix domain datagram socket: after every frame
+// the viewer sends the state of the keyboard, the mouse, the window size and the
+// widgets to the client. The client reads everything that has arrived at the start of
+// each break, so key and button presses are seen once even if several viewer frames
+// passed in between. The same functions can be called as in watch mode; queries that
+// depend on the matrix stack (e.g. vdbGetMousePosModel) are not supported.
+//
+// Start the viewer first: it creates the shared memory (/vdb-<name>) and the socket
+// (/tmp/vdb-<name>.sock), and the client attaches to them. Closing the viewer window
+// makes the client skip its breaks. Only available on Linux and macOS.
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <limits.h>
+#endif
+
+#define VDB_REMOTE_MAGIC "VDBSHM1"
+
+struct remote_ring_t
+{
+    char magic[8]; // VDB_REMOTE_MAGIC
+    uint32_t capacity; // size of the data that follows (a power of two)
+    SDL_atomic_t write_pos; // advanced by the client once a frame is complete
+    SDL_atomic_t read_pos; // advanced by the viewer once it has read a frame
+    SDL_atomic_t frames_dropped; // frames that didn't fit
+};
+
+// Sent by the viewer after each frame. Must fit in one datagram (at most 2048 bytes on macOS).
+struct remote_input_t
+{
+    int32_t window_width, window_height;
+    int32_t framebuffer_width, framebuffer_height;
+    int32_t mouse_x, mouse_y;
+    float mouse_ndc[2];
+    float mouse_wheel;
+    uint8_t mouse_down[3]; // left, right, middle
+    uint8_t mouse_pressed[3];
+    uint8_t mouse_released[3];
+    uint8_t quit; // the viewer is closing
+    uint8_t key_down[VDB_NUM_KEYS/8]; // bitsets indexed by vdbKey
+    uint8_t key_pressed[VDB_NUM_KEYS/8];
+    uint8_t key_released[VDB_NUM_KEYS/8];
+    int32_t num_widget_values;
+    watch_widget_value_t widget_values[watch::MAX_WIDGET_VALUES];
+};
+
+namespace remote
+{
+    static bool connected; // this process is a client
+    static bool viewer_closed;
+    static bool in_block;
+    static remote_ring_t *ring;
+    static size_t ring_size; // including the header
+    static watch_snapshot_t snapshot;
+    static char shm_name[256];
+    static char socket_path[256]; // the viewer's
+    static char client_path[256]; // the client's (to receive input)
+    #ifndef _WIN32
+    static int sock = -1;
+    static sockaddr_un peer; // the viewer (for the client) or the client (for the viewer)
+    static bool has_peer;
+    #endif
+
+    static void CheckEnvironment()
+    {
+        static bool checked = false;
+        const char *name = getenv("VDB_CONNECT");
+        if (!checked && name && *name)
+            vdbConnect(name);
+        checked = true;
+    }
+
+    static void MakeNames(const char *name)
+    {
+        snprintf(shm_name, sizeof(shm_name), "/vdb-%s", name);
+        snprintf(socket_path, sizeof(socket_path), "/tmp/vdb-%s.sock", name);
+    }
+
+    static unsigned char *RingData() { return (unsigned char*)(ring + 1); }
+
+    // Positions grow without bound (modulo 2^32) and are wrapped into the buffer here.
+    static void RingWrite(uint32_t pos, const void *data, uint32_t size)
+    {
+        uint32_t mask = ring->capacity - 1;
+        uint32_t start = pos & mask;
+        uint32_t first = ring->capacity - start;
+        if (first > size) first = size;
+        memcpy(RingData() + start, data, first);
+        memcpy(RingData(), (const unsigned char*)data + first, size - first);
+    }
+
+    static void RingRead(uint32_t pos, void *data, uint32_t size)
+    {
+        uint32_t mask = ring->capacity - 1;
+        uint32_t start = pos & mask;
+        uint32_t first = ring->capacity - start;
+        if (first > size) first = size;
+        memcpy(data, RingData() + start, first);
+        memcpy((unsigned char*)data + first, RingData(), size - first);
+    }
+
+    static void SetBit(uint8_t *bits, int i, bool value) { if (value) bits[i/8] |= (uint8_t)(1 << (i%8)); }
+    static bool GetBit(const uint8_t *bits, int i) { return (bits[i/8] >> (i%8)) & 1; }
+
+    #ifndef _WIN32
+    // Socket paths must fit in sun_path (108 bytes on Linux), so long names are refused
+    // rather than cut off, which would make two names share a path.
+    static bool SetPath(sockaddr_un *address, const char *path)
+    {
+        memset(address, 0, sizeof(*address));
+        address->sun_family = AF_UNIX;
+        int n = snprintf(address->sun_path, sizeof(address->sun_path), "%s", path);
+        return n >= 0 && (size_t)n < sizeof(address->sun_path);
+    }
+
+    // Whether the paths made from name fit, including a client's, which has a pid in it.
+    static bool NameFits(const char *name)
+    {
+        sockaddr_un address;
+        char path[256];
+        int n = snprintf(path, sizeof(path), "/tmp/vdb-%s-%d.sock", name, INT_MAX);
+        return n >= 0 && (size_t)n < sizeof(path) && SetPath(&address, path);
+    }
+
+    static void Cleanup()
+    {
+        if (sock >= 0)
+            close(sock);
+        sock = -1;
+        if (connected)
+            unlink(client_path);
+    }
+
+    // Reads the input that the viewer sent since the last break.
+    static void ReceiveInput()
+    {
+        memset(keys::pressed, 0, sizeof(keys::pressed));
+        memset(keys::released, 0, sizeof(keys::released));
+        mouse::wheel = 0.0f;
+        mouse::button_t *buttons[] = { &mouse::left, &mouse::right, &mouse::middle };
+        for (int i = 0; i < 3; i++)
+            buttons[i]->pressed = buttons[i]->released = false;
+
+        remote_input_t in;
+        while (recv(sock, &in, sizeof(in), MSG_DONTWAIT) == (ssize_t)sizeof(in))
+        {
+            if (in.quit)
+                viewer_closed = true;
+            window::window_width = in.window_width;
+            window::window_height = in.window_height;
+            window::framebuffer_width = in.framebuffer_width;
+            window::framebuffer_height = in.framebuffer_height;
+            mouse::x = in.mouse_x;
+            mouse::y = in.mouse_y;
+            mouse::ndc = vdbVec2(in.mouse_ndc[0], in.mouse_ndc[1]);
+            mouse::wheel += in.mouse_wheel;
+            for (int i = 0; i < 3; i++)
+            {
+                buttons[i]->down = in.mouse_down[i] != 0;
+                buttons[i]->pressed |= in.mouse_pressed[i] != 0;
+                buttons[i]->released |= in.mouse_released[i] != 0;
+            }
+            for (int i = 0; i < VDB_NUM_KEYS; i++)
+            {
+                keys::down[i] = GetBit(in.key_down, i);
+                keys::pressed[i] |= GetBit(in.key_pressed, i);
+                keys::released[i] |= GetBit(in.key_released, i);
+            }
+            int n = in.num_widget_values;
+            if (n < 0) n = 0;
+            if (n > watch::MAX_WIDGET_VALUES) n = watch::MAX_WIDGET_VALUES;
+            for (int i = 0; i < n; i++)
+            {
+                watch_widget_value_t *w = in.widget_values + i;
+                w->name[sizeof(w->name) - 1] = '\0';
+                watch::SetWidgetValue(w->name, w->value, w->is_button != 0);
+            }
+        }
+    }
+
+    static bool Connect(const char *name)
+    {
+        MakeNames(name);
+        int fd = shm_open(shm_name, O_RDWR, 0);
+        if (fd < 0)
+            return false;
+        remote_ring_t header;
+        void *p = MAP_FAILED;
+        if (read(fd, &header, sizeof(header)) == (ssize_t)sizeof(header) &&
+            memcmp(header.magic, VDB_REMOTE_MAGIC, sizeof(header.magic)) == 0)
+        {
+            ring_size = sizeof(remote_ring_t) + header.capacity;
+            p = mmap(NULL, ring_size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+        }
+        close(fd);
+        if (p == MAP_FAILED)
+            return false;
+
+        // bind our own address so that the viewer can send input back to us
+        sock = socket(AF_UNIX, SOCK_DGRAM, 0);
+        snprintf(client_path, sizeof(client_path), "/tmp/vdb-%s-%d.sock", name, (int)getpid());
+        unlink(client_path);
+        sockaddr_un self;
+        if (sock < 0 || !SetPath(&self, client_path) || !SetPath(&peer, socket_path) ||
+            bind(sock, (sockaddr*)&self, sizeof(self)) != 0)
+        {
+            munmap(p, ring_size);
+            return false;
+        }
+        ring = (remote_ring_t*)p;
+        char hello = 1;
+        sendto(sock, &hello, 1, MSG_DONTWAIT, (sockaddr*)&peer, sizeof(peer));
+        connected = true;
+        atexit(Cleanup);
+        return true;
+    }
+
+    // Viewer
+
+    static bool OpenViewer(const char *name)
+    {
+        MakeNames(name);
+        shm_unlink(shm_name); // left behind by a viewer that crashed
+        int fd = shm_open(shm_name, O_RDWR|O_CREAT|O_EXCL, 0600);
+        if (fd < 0)
+            return false;
+        ring_size = sizeof(remote_ring_t) + VDB_REMOTE_BUFFER_SIZE;
+        void *p = ftruncate(fd, (off_t)ring_size) == 0 ? mmap(NULL, ring_size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+        close(fd);
+        if (p == MAP_FAILED)
+        {
+            shm_unlink(shm_name);
+            return false;
+        }
+        ring = (remote_ring_t*)p;
+        ring->capacity = VDB_REMOTE_BUFFER_SIZE;
+        SDL_AtomicSet(&ring->write_pos, 0);
+        SDL_AtomicSet(&ring->read_pos, 0);
+        SDL_AtomicSet(&ring->frames_dropped, 0);
+        SDL_MemoryBarrierRelease();
+        memcpy(ring->magic, VDB_REMOTE_MAGIC, sizeof(ring->magic)); // last, since clients check it
+
+        sock = socket(AF_UNIX, SOCK_DGRAM, 0);
+        if (sock < 0)
+            return false;
+        unlink(socket_path);
+        sockaddr_un self;
+        return SetPath(&self, socket_path) && bind(sock, (sockaddr*)&self, sizeof(self)) == 0;
+    }
+
+    static void CloseViewer()
+    {
+        if (has_peer)
+        {
+            remote_input_t out = {0};
+            out.quit = 1;
+            sendto(sock, &out, sizeof(out), MSG_DONTWAIT, (sockaddr*)&peer, sizeof(peer));
+        }
+        if (sock >= 0)
+            close(sock);
+        sock = -1;
+        unlink(socket_path);
+        shm_unlink(shm_name);
+    }
+
+    // Wakes up the viewer when a client has sent a frame (the viewer may be waiting for events).
+    static Uint32 PollRing(Uint32 interval, void *)
+    {
+        static int last_write_pos;
+        int write_pos = SDL_AtomicGet(&ring->write_pos);
+        if (write_pos != last_write_pos)
+        {
+            last_write_pos = write_pos;
+            SDL_Event event = {0};
+            event.type = SDL_USEREVENT;
+            SDL_PushEvent(&event);
+        }
+        return interval;
+    }
+
+    // Reads the newest frame in the ring and skips older ones. Returns its label, or
+    // NULL if no new frame has arrived.
+    static const char *ReceiveFrame(watch_snapshot_t *commands)
+    {
+        // a client says hello when it connects
+        sockaddr_un from;
+        socklen_t from_length = sizeof(from);
+        char hello;
+        while (recvfrom(sock, &hello, 1, MSG_DONTWAIT, (sockaddr*)&from, &from_length) >= 0)
+        {
+            peer = from;
+            has_peer = true;
+            from_length = sizeof(from);
+        }
+
+        uint32_t read_pos = (uint32_t)SDL_AtomicGet(&ring->read_pos);
+        uint32_t write_pos = spsc::Load(&ring->write_pos);
+        if (read_pos == write_pos)
+            return NULL;
+
+        // the ring is written by another process, so its sizes are checked before use; if
+        // they don't add up, everything up to write_pos is dropped
+        uint32_t available = write_pos - read_pos;
+        uint32_t size = 0;
+        uint32_t label_length = 0;
+        bool valid = available <= ring->capacity;
+        while (valid)
+        {
+            RingRead(read_pos, &size, 4);
+            if ((uint64_t)4 + size > available)
+            {
+                valid = false;
+                break;
+            }
+            if (4 + size == available)
+                break;
+            read_pos += 4 + size;
+            available -= 4 + size;
+        }
+        if (valid)
+        {
+            RingRead(read_pos + 4, &label_length, 4);
+            valid = size >= 4 && (uint64_t)4 + label_length <= size;
+        }
+        if (!valid)
+        {
+            fprintf(stderr, "vdb: dropped a malformed frame from the client\n");
+            spsc::Store(&ring->read_pos, write_pos);
+            return NULL;
+        }
+
+        static char label[256];
+        uint32_t stored_length = label_length < sizeof(label) ? label_length : (uint32_t)sizeof(label) - 1;
+        RingRead(read_pos + 8, label, stored_length);
+        label[stored_length] = '\0';
+        commands->used = 0;
+        uint32_t commands_size = size - 4 - label_length;
+        RingRead(read_pos + 8 + label_length, watch::Reserve(commands_size, commands), commands_size);
+        spsc::Store(&ring->read_pos, write_pos); // give the space back to the client
+        return label;
+    }
+
+    static void SendInput()
+    {
+        if (!has_peer)
+            return;
+        remote_input_t out;
+        memset(&out, 0, sizeof(out));
+        out.window_width = window::window_width;
+        out.window_height = window::window_height;
+        out.framebuffer_width = window::framebuffer_width;
+        out.framebuffer_height = window::framebuffer_height;
+        out.mouse_x = mouse::x;
+        out.mouse_y = mouse::y;
+        out.mouse_ndc[0] = mouse::ndc.x;
+        out.mouse_ndc[1] = mouse::ndc.y;
+        out.mouse_wheel = vdbGetMouseWheel();
+        out.mouse_down[0] = vdbIsMouseLeftDown();
+        out.mouse_down[1] = vdbIsMouseRightDown();
+        out.mouse_down[2] = vdbIsMouseMiddleDown();
+        out.mouse_pressed[0] = vdbWasMouseLeftPressed();
+        out.mouse_pressed[1] = vdbWasMouseRightPressed();
+        out.mouse_pressed[2] = vdbWasMouseMiddlePressed();
+        out.mouse_released[0] = vdbWasMouseLeftReleased();
+        out.mouse_released[1] = vdbWasMouseRightReleased();
+        out.mouse_released[2] = vdbWasMouseMiddleReleased();
+        for (int i = 0; i < VDB_NUM_KEYS; i++)
+        {
+            SetBit(out.key_down, i, vdbIsKeyDown(i));
+            SetBit(out.key_pressed, i, vdbWasKeyPressed(i));
+            SetBit(out.key_released, i, vdbWasKeyReleased(i));
+        }
+        out.num_widget_values = watch::num_widget_values;
+        memcpy(out.widget_values, watch::widget_values, sizeof(out.widget_values));
+        if (sendto(sock, &out, sizeof(out), MSG_DONTWAIT, (sockaddr*)&peer, sizeof(peer)) == (ssize_t)sizeof(out))
+        {
+            // the clicks are the client's now (see watch::SetWidgetValue)
+            for (int i = 0; i < watch::num_widget_values; i++)
+                if (watch::widget_values[i].is_button)
+                    watch::widget_values[i].value = 0.0f;
+        }
+    }
+    #endif
+
+    // Called instead of the usual vdbBeginBreak in client mode.
+    static bool BeginBreak(const char *label)
+    {
+        if (in_block)
+        {
+            in_block = false; // the block has run once, let the user's loop continue
+            return false;
+        }
+        #ifndef _WIN32
+        ReceiveInput();
+        #endif
+        if (viewer_closed)
+            return false;
+        snapshot.used = 0;
+        snapshot.label = label;
+        in_block = true;
+        watch::recording = true;
+        watch::passthrough = false;
+        watch::destination = &snapshot;
+        return true;
+    }
+
+    static void EndBreak()
+    {
+        watch::recording = false;
+
+        // message: uint32 size, uint32 label_length, label, commands
+        const char *label = snapshot.label ? snapshot.label : "";
+        uint32_t label_length = (uint32_t)strlen(label);
+        uint32_t size = 4 + label_length + (uint32_t)snapshot.used;
+        uint32_t write_pos = (uint32_t)SDL_AtomicGet(&ring->write_pos);
+        uint32_t read_pos = spsc::Load(&ring->read_pos);
+        uint32_t available = ring->capacity - (write_pos - read_pos);
+        if ((uint64_t)size + 4 > available)
+        {
+            SDL_AtomicIncRef(&ring->frames_dropped);
+            return;
+        }
+        RingWrite(write_pos, &size, 4);
+        RingWrite(write_pos + 4, &label_length, 4);
+        RingWrite(write_pos + 8, label, label_length);
+        RingWrite(write_pos + 8 + label_length, snapshot.data, (uint32_t)snapshot.used);
+        spsc::Store(&ring->write_pos, write_pos + 4 + size); // publish the frame
+    }
+}
+
+bool vdbConnect(const char *name)
+{
+    #ifdef _WIN32
+    fprintf(stderr, "vdb: client mode is not supported on Windows\n");
+    (void)name;
+    return false;
+    #else
+    if (remote::connected)
+        return true;
+    if (!remote::NameFits(name))
+    {
+        fprintf(stderr, "vdb: the name '%s' is too long for a socket path\n", name);
+        return false;
+    }
+    if (!remote::Connect(name))
+    {
+        fprintf(stderr, "vdb: could not connect to viewer '%s' (start vdb-viewer %s first)\n", name, name);
+        remote::Cleanup();
+        return false;
+    }
+    // vdb's input queries read ImGui's capture flags, so they need a context (but nothing else)
+    if (!ImGui::GetCurrentContext())
+        ImGui::CreateContext();
+    return true;
+    #endif
+}
+
+bool vdbRunViewer(const char *name)
+{
+    #ifdef _WIN32
+    fprintf(stderr, "vdb: the viewer is not supported on Windows\n");
+    (void)name;
+    return false;
+    #else
+    if (!remote::NameFits(name))
+    {
+        fprintf(stderr, "vdb: the name '%s' is too long for a socket path\n", name);
+        return false;
+    }
+    if (!remote::OpenViewer(name))
+    {
+        fprintf(stderr, "vdb: could not create shared memory or socket for viewer '%s'\n", name);
+        remote::CloseViewer();
+        return false;
+    }
+    atexit(remote::CloseViewer); // vdb exits when the window is closed
+
+    watch_snapshot_t commands = {0};
+    const char *label = NULL;
+    SDL_TimerID timer = 0;
+    while (true)
+    {
+        if (vdbBeginBreak(label ? label : "vdb-viewer"))
+        {
+            if (!timer)
+                timer = SDL_AddTimer(VDB_REMOTE_POLL_MS, remote::PollRing, NULL);
+
+            const char *new_label = remote::ReceiveFrame(&commands);
+            if (new_label)
+                label = watch::InternName(new_label, (int)strlen(new_label));
+            watch::Replay(&commands);
+
+            ImGui::SetNextWindowPos(ImVec2(10.0f, 40.0f), ImGuiCond_FirstUseEver);
+            ImGui::Begin("Viewer", NULL, ImGuiWindowFlags_AlwaysAutoResize);
+            if (remote::has_peer)
+                ImGui::Text("%s (%d frames dropped)", label ? label : "Connected", SDL_AtomicGet(&remote::ring->frames_dropped));
+            else
+                ImGui::Text("Waiting for a client to connect to '%s'...", name);
+            ImGui::End();
+
+            remote::SendInput();
+            vdbEndBreak();
+        }
+    }
+    #endif
+}
@@ -24,6 +24,27 @@
 //                                   -----------------
 // In this example, it would take 4 frames before the output settles,
 // assuming a static scene.
+//
+// With reprojection enabled, the output is instead rebuilt every frame:
+// pixels that were not rendered this frame are fetched from where they
+// were in the previous output, found by unprojecting them with the
+// current pvm matrix and low-res depth, and projecting them with last
+// frame's pvm. Samples whose depth doesn't match what was stored there
+// (i.e. the surface was hidden last frame) fall back to the low-res
+// frame. This keeps the image sharp while the camera moves, as long as
+// the scene itself doesn't change. The pvm matrix is read at the end of
+// the render scaler, so the user's drawing code should leave the matrix
+// stack as it found it (true for the built-in cameras).
+//
+// With dynamic resolution, the low-res size is not a fixed power of two
+// below the window, but is chosen every frame so that the GPU time spent
+// between Begin and End stays near VDB_DYNAMIC_RESOLUTION_TARGET_MS.
+// The time is measured with timer queries, which are read back a few
+// frames later to avoid stalling. Assuming the cost is proportional to
+// the number of pixels, the scale is set to s*sqrt(target/measured).
+// Sizes are quantized so that framebuffers are not recreated every frame,
+// and once the user stops interacting the scale snaps back to full
+// resolution and the supersampler is given time to converge.
 namespace render_scaler
 {
     static framebuffer_t output;
@@ -37,13 +58,110 @@ namespace render_scaler
     static float frag_offset_y;
     static float sample_pos_ndc_x;
     static float sample_pos_ndc_y;
+    static bool reproject;
+    static framebuffer_t history; // previous output (only used with reprojection)
+    static bool history_valid;
+    static vdbMat4 prev_pvm;
 
-    void Begin(int w, int h, int n_up)
+    enum { NUM_TIMER_QUERIES = 4 };
+    static int timer_supported = -1; // -1: not checked yet
+    static GLuint timer_queries[NUM_TIMER_QUERIES];
+    static bool timer_pending[NUM_TIMER_QUERIES];
+    static float timer_scale[NUM_TIMER_QUERIES]; // dynamic scale used in the measured frame
+    static int timer_next;
+    static int timer_active = -1; // query running between Begin and End
+    static float dynamic_scale = 1.0f; // current (quantized) scale relative to full quality
+    static float dynamic_scale_smooth = 1.0f;
+    static float dynamic_gpu_ms; // last measured GPU time
+    static int dynamic_converge_frames;
+
+    static bool TimerQueriesSupported()
+    {
+        if (timer_supported < 0)
+        {
+            timer_supported = timer_query::Supported() ? 1 : 0;
+            if (timer_supported)
+                glGenQueries(NUM_TIMER_QUERIES, timer_queries);
+            else
+                fprintf(stderr, "vdb: dynamic resolution needs GL_ARB_timer_query, which your OpenGL driver doesn't support.\n");
+        }
+        return timer_supported == 1;
+    }
+
+    // Returns the low-res size to pass to Begin for the given window
+    // framebuffer size, when dynamic resolution is enabled. Full quality
+    // means that the output has the same size as the window.
+    static void GetDynamicSize(int fb_w, int fb_h, int n_up, int *w, int *h)
+    {
+        const float min_scale = VDB_DYNAMIC_RESOLUTION_MIN_SCALE;
+        const float step = 1.0f/16.0f;
+        if (TimerQueriesSupported())
+        {
+            // only the newest finished measurement is used
+            float scale_measured = 0.0f;
+            for (int k = 0; k < NUM_TIMER_QUERIES; k++)
+            {
+                int i = (timer_next + k) % NUM_TIMER_QUERIES; // oldest first
+                if (!timer_pending[i])
+                    continue;
+                GLuint available = 0;
+                glGetQueryObjectuiv(timer_queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+                if (!available)
+                    break;
+                GLuint ns = 0;
+                glGetQueryObjectuiv(timer_queries[i], GL_QUERY_RESULT, &ns);
+                timer_pending[i] = false;
+                dynamic_gpu_ms = ns/1e6f;
+                scale_measured = timer_scale[i];
+            }
+
+            if (window::idle_frames >= 2)
+            {
+                // the user has stopped interacting: render at full quality until
+                // the supersampler has converged, after which vdb goes idle
+                if (dynamic_scale < 1.0f)
+                {
+                    dynamic_scale = dynamic_scale_smooth = 1.0f;
+                    dynamic_converge_frames = window::idle_frames + 3 + (1<<n_up)*(1<<n_up);
+                }
+                window::SetMinimumNumSettleFrames(dynamic_converge_frames);
+            }
+            else if (scale_measured > 0.0f && dynamic_gpu_ms > 0.0f)
+            {
+                float desired = scale_measured*sqrtf(VDB_DYNAMIC_RESOLUTION_TARGET_MS/dynamic_gpu_ms);
+                if (desired < min_scale) desired = min_scale;
+                if (desired > 1.0f) desired = 1.0f;
+                dynamic_scale_smooth += 0.5f*(desired - dynamic_scale_smooth);
+
+                // hysteresis: only switch size when the smoothed scale is clearly in another step
+                if (fabsf(dynamic_scale_smooth - dynamic_scale) > 0.75f*step)
+                {
+                    dynamic_scale = step*floorf(dynamic_scale_smooth/step + 0.5f);
+                    if (dynamic_scale < min_scale) dynamic_scale = min_scale;
+                    if (dynamic_scale > 1.0f) dynamic_scale = 1.0f;
+                }
+            }
+        }
+        else
+        {
+            dynamic_scale = 1.0f;
+        }
+        *w = (int)(dynamic_scale*fb_w) >> n_up;
+        *h = (int)(dynamic_scale*fb_h) >> n_up;
+        if (*w < 1) *w = 1;
+        if (*h < 1) *h = 1;
+    }
+
+    // measure_gpu_time: time the user's drawing for dynamic resolution (see GetDynamicSize)
+    void Begin(int w, int h, int n_up, bool _reproject=false, bool measure_gpu_time=false)
     {
         window::SetMinimumNumSettleFrames(3 + (1<<n_up)*(1<<n_up));
 
         scale_up = n_up;
         has_begun = true;
+        reproject = _reproject;
+        if (!reproject)
+            history_valid = false;
 
         if (lowres.width != w || lowres.height != h)
         {
@@ -56,6 +174,7 @@ namespace render_scaler
             FreeFramebuffer(&output);
             output = MakeFramebuffer(w<<n_up, h<<n_up, GL_NEAREST, GL_NEAREST, true);
             subpixel = 0;
+            history_valid = false;
             EnableFramebuffer(&output);
             // Although we do _eventually_ overwrite all pixels in
             // the output RT, the user may see some garbage frames
@@ -116,6 +235,13 @@ namespace render_scaler
             sample_pos_ndc_x = (-0.5f*num_samples + 0.5f + sample_pos_idx)*pixel_width_ndc;
             sample_pos_ndc_y = (-0.5f*num_samples + 0.5f + sample_pos_idy)*pixel_height_ndc;
         }
+
+        timer_active = -1;
+        if (measure_gpu_time && TimerQueriesSupported() && !timer_pending[timer_next])
+        {
+            timer_active = timer_next;
+            glBeginQuery(GL_TIME_ELAPSED, timer_queries[timer_active]);
+        }
     }
     void End()
     {
@@ -179,9 +305,140 @@ namespace render_scaler
             assert(uniform_nx >= 0 && "Unused or nonexistent uniform");
         }
 
+        static GLuint reproject_program = 0;
+        static GLint reproject_attrib_position = 0;
+        static GLint reproject_uniform_lowres_color = 0;
+        static GLint reproject_uniform_lowres_depth = 0;
+        static GLint reproject_uniform_history_color = 0;
+        static GLint reproject_uniform_history_depth = 0;
+        static GLint reproject_uniform_dx = 0;
+        static GLint reproject_uniform_dy = 0;
+        static GLint reproject_uniform_nx = 0;
+        static GLint reproject_uniform_reprojection = 0;
+        static GLint reproject_uniform_output_size = 0;
+        if (!reproject_program && reproject)
+        {
+            #define SHADER(S) "#version 150\n" #S
+            const char *vs = SHADER(
+            in vec2 position;
+            out vec2 texel;
+            void main()
+            {
+                texel = vec2(0.5) + 0.5*position;
+                gl_Position = vec4(position, 0.0, 1.0);
+            }
+            );
+
+            const char *fs = SHADER(
+            in vec2 texel;
+            uniform sampler2D lowres_color;
+            uniform sampler2D lowres_depth;
+            uniform sampler2D history_color;
+            uniform sampler2D history_depth;
+            uniform float dx;
+            uniform float dy;
+            uniform float nx;
+            uniform mat4 reprojection; // previous pvm * inverse(current pvm)
+            uniform vec2 output_size;
+            out vec4 out_color;
+            void main()
+            {
+                vec4 current = texture(lowres_color, texel);
+                float depth = texture(lowres_depth, texel).x;
+                gl_FragDepth = depth;
+
+                float ix = trunc(mod(gl_FragCoord.x,nx));
+                float iy = trunc(mod(gl_FragCoord.y,nx));
+                if (ix == dx && iy == dy)
+                {
+                    out_color = current;
+                    return;
+                }
+
+                vec4 ndc = vec4(2.0*gl_FragCoord.xy/output_size - vec2(1.0), 2.0*depth - 1.0, 1.0);
+                vec4 prev = reprojection*ndc;
+                vec2 prev_texel = vec2(0.5) + 0.5*prev.xy/prev.w;
+                if (prev.w <= 0.0 || prev_texel.x < 0.0 || prev_texel.x > 1.0 || prev_texel.y < 0.0 || prev_texel.y > 1.0)
+                {
+                    out_color = current; // was outside the view
+                    return;
+                }
+
+                // With a perspective projection, 1-depth is roughly proportional to 1/distance,
+                // so this rejects samples whose distance differs by more than a few percent.
+                float expected_depth = 0.5 + 0.5*prev.z/prev.w;
+                float stored_depth = texture(history_depth, prev_texel).x;
+                if (abs(stored_depth - expected_depth) > 0.05*(1.0 - expected_depth) + 0.00001)
+                {
+                    out_color = current; // was occluded
+                    return;
+                }
+
+                vec4 history = texture(history_color, prev_texel);
+
+                // If the pixel moved, limit the history to the colors around it in the low-res
+                // frame to hide remaining ghosting. Static pixels keep their full history so
+                // that the image converges to the super-sampled result.
+                vec2 motion = (prev_texel - gl_FragCoord.xy/output_size)*output_size;
+                if (dot(motion, motion) > 0.25)
+                {
+                    vec4 c1 = textureOffset(lowres_color, texel, ivec2(-1,-1));
+                    vec4 c2 = textureOffset(lowres_color, texel, ivec2( 0,-1));
+                    vec4 c3 = textureOffset(lowres_color, texel, ivec2( 1,-1));
+                    vec4 c4 = textureOffset(lowres_color, texel, ivec2(-1, 0));
+                    vec4 c5 = textureOffset(lowres_color, texel, ivec2( 1, 0));
+                    vec4 c6 = textureOffset(lowres_color, texel, ivec2(-1, 1));
+                    vec4 c7 = textureOffset(lowres_color, texel, ivec2( 0, 1));
+                    vec4 c8 = textureOffset(lowres_color, texel, ivec2( 1, 1));
+                    vec4 lo = min(current, min(min(min(c1,c2),min(c3,c4)),min(min(c5,c6),min(c7,c8))));
+                    vec4 hi = max(current, max(max(max(c1,c2),max(c3,c4)),max(max(c5,c6),max(c7,c8))));
+                    history = clamp(history, lo, hi);
+                }
+                out_color = history;
+            }
+            );
+            #undef SHADER
+
+            reproject_program = LoadShaderFromMemory(vs,fs);
+            assert(reproject_program && "Failed to compile TemporalReprojection shader");
+            reproject_attrib_position = glGetAttribLocation(reproject_program, "position");
+            reproject_uniform_lowres_color = glGetUniformLocation(reproject_program, "lowres_color");
+            reproject_uniform_lowres_depth = glGetUniformLocation(reproject_program, "lowres_depth");
+            reproject_uniform_history_color = glGetUniformLocation(reproject_program, "history_color");
+            reproject_uniform_history_depth = glGetUniformLocation(reproject_program, "history_depth");
+            reproject_uniform_dx = glGetUniformLocation(reproject_program, "dx");
+            reproject_uniform_dy = glGetUniformLocation(reproject_program, "dy");
+            reproject_uniform_nx = glGetUniformLocation(reproject_program, "nx");
+            reproject_uniform_reprojection = glGetUniformLocation(reproject_program, "reprojection");
+            reproject_uniform_output_size = glGetUniformLocation(reproject_program, "output_size");
+            assert(reproject_attrib_position >= 0 && "Unused or nonexistent attribute");
+            assert(reproject_uniform_history_color >= 0 && "Unused or nonexistent uniform");
+            assert(reproject_uniform_history_depth >= 0 && "Unused or nonexistent uniform");
+            assert(reproject_uniform_reprojection >= 0 && "Unused or nonexistent uniform");
+        }
+
+        if (timer_active >= 0)
+        {
+            glEndQuery(GL_TIME_ELAPSED);
+            timer_pending[timer_active] = true;
+            timer_scale[timer_active] = dynamic_scale;
+            timer_next = (timer_active + 1) % NUM_TIMER_QUERIES;
+            timer_active = -1;
+        }
+
         has_begun = false;
         DisableFramebuffer(&lowres);
 
+        // world-to-clip transform used while drawing this frame (before we reset it below)
+        vdbMat4 pvm = transform::pvm;
+        bool use_history = reproject && history_valid;
+        if (reproject && (history.width != output.width || history.height != output.height))
+        {
+            FreeFramebuffer(&history);
+            history = MakeFramebuffer(output.width, output.height, GL_NEAREST, GL_NEAREST, true);
+            use_history = false;
+        }
+
         imm_state_t last_state = immediate::GetState();
         float last_projection[4*4];
         vdbGetProjection(last_projection);
@@ -195,6 +452,8 @@ namespace render_scaler
         vdbDepthFuncAlways();
         immediate::SetRenderOffsetNDC(vdbVec2(0.0f, 0.0f));
 
+        int timer = gpu_timer::Begin(GPU_TIMER_COMPOSITE);
+
         // interleave just-rendered frame into full resolution framebuffer
         {
             static GLuint vao = 0;
@@ -210,23 +469,60 @@ namespace render_scaler
             assert(vao);
             assert(vbo);
 
-            EnableFramebuffer(&output);
-            glBindVertexArray(vao);
-            glBindBuffer(GL_ARRAY_BUFFER, vbo);
-            glUseProgram(program);
-            glActiveTexture(GL_TEXTURE1);
-            glUniform1i(uniform_sampler1, 1);
-            glBindTexture(GL_TEXTURE_2D, lowres.depth);
-            glActiveTexture(GL_TEXTURE0);
-            glUniform1i(uniform_sampler0, 0);
-            glBindTexture(GL_TEXTURE_2D, lowres.color[0]);
-            glUniform1f(uniform_dx, (float)sample_pos_idx);
-            glUniform1f(uniform_dy, (float)sample_pos_idy);
-            glUniform1f(uniform_nx, (float)(1<<scale_up));
-            glVertexAttribPointer(attrib_position, 2, GL_FLOAT, GL_FALSE, 0, 0);
-            glEnableVertexAttribArray(attrib_position);
-            glDrawArrays(GL_TRIANGLES, 0, 6);
-            glDisableVertexAttribArray(attrib_position);
+            if (use_history)
+            {
+                // the previous output becomes the history, and every pixel of the new output is rewritten
+                framebuffer_t temp = history;
+                history = output;
+                output = temp;
+
+                vdbMat4 reprojection = vdbMul4x4(prev_pvm, vdbMatInverse(pvm));
+                EnableFramebuffer(&output);
+                glBindVertexArray(vao);
+                glBindBuffer(GL_ARRAY_BUFFER, vbo);
+                glUseProgram(reproject_program);
+                glActiveTexture(GL_TEXTURE3);
+                glUniform1i(reproject_uniform_history_depth, 3);
+                glBindTexture(GL_TEXTURE_2D, history.depth);
+                glActiveTexture(GL_TEXTURE2);
+                glUniform1i(reproject_uniform_history_color, 2);
+                glBindTexture(GL_TEXTURE_2D, history.color[0]);
+                glActiveTexture(GL_TEXTURE1);
+                glUniform1i(reproject_uniform_lowres_depth, 1);
+                glBindTexture(GL_TEXTURE_2D, lowres.depth);
+                glActiveTexture(GL_TEXTURE0);
+                glUniform1i(reproject_uniform_lowres_color, 0);
+                glBindTexture(GL_TEXTURE_2D, lowres.color[0]);
+                glUniform1f(reproject_uniform_dx, (float)sample_pos_idx);
+                glUniform1f(reproject_uniform_dy, (float)sample_pos_idy);
+                glUniform1f(reproject_uniform_nx, (float)(1<<scale_up));
+                glUniform2f(reproject_uniform_output_size, (float)output.width, (float)output.height);
+                UniformMat4(reproject_uniform_reprojection, 1, reprojection);
+                glVertexAttribPointer(reproject_attrib_position, 2, GL_FLOAT, GL_FALSE, 0, 0);
+                glEnableVertexAttribArray(reproject_attrib_position);
+                glDrawArrays(GL_TRIANGLES, 0, 6);
+                glDisableVertexAttribArray(reproject_attrib_position);
+            }
+            else
+            {
+                EnableFramebuffer(&output);
+                glBindVertexArray(vao);
+                glBindBuffer(GL_ARRAY_BUFFER, vbo);
+                glUseProgram(program);
+                glActiveTexture(GL_TEXTURE1);
+                glUniform1i(uniform_sampler1, 1);
+                glBindTexture(GL_TEXTURE_2D, lowres.depth);
+                glActiveTexture(GL_TEXTURE0);
+                glUniform1i(uniform_sampler0, 0);
+                glBindTexture(GL_TEXTURE_2D, lowres.color[0]);
+                glUniform1f(uniform_dx, (float)sample_pos_idx);
+                glUniform1f(uniform_dy, (float)sample_pos_idy);
+                glUniform1f(uniform_nx, (float)(1<<scale_up));
+                glVertexAttribPointer(attrib_position, 2, GL_FLOAT, GL_FALSE, 0, 0);
+                glEnableVertexAttribArray(attrib_position);
+                glDrawArrays(GL_TRIANGLES, 0, 6);
+                glDisableVertexAttribArray(attrib_position);
+            }
             glUseProgram(0);
             glBindBuffer(GL_ARRAY_BUFFER, 0);
             glBindVertexArray(0);
@@ -237,6 +533,7 @@ namespace render_scaler
         // note: we re-enable user's draw state (e.g. depth test/write).
         immediate::SetState(last_state);
         DrawRenderTargetWithDepth(output);
+        gpu_timer::End(timer);
 
         vdbPopMatrix();
         vdbProjection(last_projection);
@@ -244,6 +541,9 @@ namespace render_scaler
         // just a linear sampling order. want something nicer in the future
         int num_subpixels = (1<<scale_up)*(1<<scale_up);
         subpixel = (subpixel+1)%num_subpixels;
+
+        prev_pvm = pvm;
+        history_valid = reproject;
     }
 }
 
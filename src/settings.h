@@ -71,6 +71,8 @@ struct render_scaler_settings_t
     bool dirty;
     int down;
     int up;
+    bool reproject; // reuse the previous output when the camera moves (see render_scaler.h)
+    bool dynamic; // choose the low-res size from the measured GPU time instead of 'down'
 };
 
 struct camera_settings_t
@@ -117,6 +119,9 @@ struct settings_t
     bool can_idle;
     int auto_step_delay_ms;
     int dpi_scale;
+    bool vsync;
+    int frame_rate_cap; // see window::SwapBuffers
+    bool history; // see history.h
 
     void LoadOrDefault(const char *filename);
     void Save(const char *filename);
@@ -177,6 +182,8 @@ void DefaultFrameSettings(frame_settings_t *fs)
     fs->render_scaler.dirty = false;
     fs->render_scaler.down = 0;
     fs->render_scaler.up = 0;
+    fs->render_scaler.reproject = false;
+    fs->render_scaler.dynamic = false;
 }
 
 namespace settings_parser
@@ -390,6 +397,9 @@ void settings_t::LoadOrDefault(const char *filename)
     can_idle = false;
     num_frames = 0;
     auto_step_delay_ms = 250;
+    vsync = true;
+    frame_rate_cap = 0;
+    history = true;
     font_size = (int)(VDB_DEFAULT_FONT_SIZE);
 
     char *data = NULL;
@@ -456,6 +466,8 @@ void settings_t::LoadOrDefault(const char *filename)
             else if (ParseKey(c, "cube_visible"))       { ParseBool(c,       &frame->grid.cube_visible);           frame->grid.dirty = true; }
             else if (ParseKey(c, "render_scale_down"))  { ParseInt(c,        &frame->render_scaler.down, 0, VDB_MAX_RENDER_SCALE_DOWN); frame->render_scaler.dirty = true; }
             else if (ParseKey(c, "render_scale_up"))    { ParseInt(c,        &frame->render_scaler.up, 0, VDB_MAX_RENDER_SCALE_UP); frame->render_scaler.dirty = true; }
+            else if (ParseKey(c, "render_scale_reproject")) { ParseBool(c,   &frame->render_scaler.reproject);     frame->render_scaler.dirty = true; }
+            else if (ParseKey(c, "render_scale_dynamic")) { ParseBool(c,     &frame->render_scaler.dynamic);       frame->render_scaler.dirty = true; }
             else *c = *c + 1;
         }
         else if (ParseKey(c, "window_pos"))         ParseInt2(c,       &window.x, &window.y);
@@ -470,6 +482,9 @@ void settings_t::LoadOrDefault(const char *filename)
         else if (ParseKey(c, "dpi_scale"))          ParseFloatToInt(c, &dpi_scale, 100, 200);
         else if (ParseKey(c, "can_idle"))           ParseBool(c,       &can_idle);
         else if (ParseKey(c, "auto_step_delay_ms")) ParseInt(c,        &auto_step_delay_ms);
+        else if (ParseKey(c, "vsync"))              ParseBool(c,       &vsync);
+        else if (ParseKey(c, "frame_rate_cap"))     ParseInt(c,        &frame_rate_cap, -1, 1000);
+        else if (ParseKey(c, "history"))            ParseBool(c,       &history);
         else *c = *c + 1;
     }
 
@@ -516,6 +531,7 @@ namespace settings_writer
 
 void settings_t::Save(const char *filename)
 {
+    trace_scope_t trace_scope("Save settings");
     using namespace settings_writer;
     FILE *f = fopen(filename, "wb+");
     if (!f)
@@ -536,6 +552,9 @@ void settings_t::Save(const char *filename)
     fprintf(f, "dpi_scale=%d\n", dpi_scale);
     fprintf(f, "can_idle=%d\n", can_idle);
     fprintf(f, "auto_step_delay_ms=%d\n", auto_step_delay_ms);
+    fprintf(f, "vsync=%d\n", vsync);
+    fprintf(f, "frame_rate_cap=%d\n", frame_rate_cap);
+    fprintf(f, "history=%d\n", history);
     for (int i = 0; i < num_frames; i++)
     {
         frame_settings_t *frame = frames + i;
@@ -588,6 +607,8 @@ void settings_t::Save(const char *filename)
         {
             fprintf(f, "render_scale_down=%d\n", frame->render_scaler.down);
             fprintf(f, "render_scale_up=%d\n", frame->render_scaler.up);
+            fprintf(f, "render_scale_reproject=%d\n", frame->render_scaler.reproject ? 1 : 0);
+            fprintf(f, "render_scale_dynamic=%d\n", frame->render_scaler.dynamic ? 1 : 0);
         }
     }
     fclose(f);
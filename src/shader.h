@@ -163,7 +163,10 @@ void vdbEndShader()
     GLint attrib_in_position = glGetAttribLocation(vdb_gl_current_program, "in_position");
     glEnableVertexAttribArray(attrib_in_position);
     glVertexAttribPointer(attrib_in_position, 2, GL_FLOAT, GL_FALSE, 0, 0);
+    frame_stats::Draw(vdb_gl_current_program, 6);
+    int timer = gpu_timer::Begin(GPU_TIMER_SHADERS);
     glDrawArrays(GL_TRIANGLES, 0, 6);
+    gpu_timer::End(timer);
     glDisableVertexAttribArray(attrib_in_position);
     glUseProgram(0);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
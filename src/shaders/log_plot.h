@@ -0,0 +1,21 @@
+const char *shader_log_plot_vs =
+    "#version 150\n"
+    "in float value;\n"
+    "uniform float x_offset;\n"
+    "uniform float x_scale;\n"
+    "uniform vec2 y_range;\n"
+    "void main()\n"
+    "{\n"
+    "    float x = (float(gl_VertexID) + x_offset)*x_scale - 1.0;\n"
+    "    float y = 2.0*(value - y_range.x)/(y_range.y - y_range.x) - 1.0;\n"
+    "    gl_Position = vec4(x, y, 0.0, 1.0);\n"
+    "}\n";
+
+const char *shader_log_plot_fs =
+    "#version 150\n"
+    "uniform vec4 color;\n"
+    "out vec4 color0;\n"
+    "void main()\n"
+    "{\n"
+    "    color0 = color;\n"
+    "}\n";
@@ -0,0 +1,22 @@
+// Positions of the single-producer single-consumer rings (log_threads.h, profiler.h and
+// remote.h). The producer writes its data and then stores the new write position; the
+// consumer loads the write position and then reads the data, and the same goes the
+// other way for the read position. SDL_AtomicSet alone doesn't order the data before the
+// store (with GCC and Clang it is only an acquire barrier), so the barriers are explicit.
+namespace spsc
+{
+    // Load a position written by the other side, before reading what it covers.
+    static uint32_t Load(SDL_atomic_t *pos)
+    {
+        uint32_t x = (uint32_t)SDL_AtomicGet(pos);
+        SDL_MemoryBarrierAcquire();
+        return x;
+    }
+
+    // Store a position read by the other side, after writing (or reading) what it covers.
+    static void Store(SDL_atomic_t *pos, uint32_t x)
+    {
+        SDL_MemoryBarrierRelease();
+        SDL_AtomicSet(pos, (int)x);
+    }
+}
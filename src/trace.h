@@ -0,0 +1,230 @@
+// Writes the time spent in each phase of a frame to a trace file (see vdbTraceToFile),
+// so that vdb's overhead can be compared with the application's own traces. The file
+// uses the JSON array format of the Chrome trace event format, which can be opened in
+// chrome://tracing, ui.perfetto.dev or Speedscope, and merged with other such traces.
+//
+// Each phase is a complete event ("ph":"X") on the thread that calls vdbBeginBreak:
+// the phases of vdbBeginBreak (waiting for events, saving settings, starting the ImGui
+// frame), the user's block (from the return of vdbBeginBreak to vdbEndBreak), and the
+// phases of vdbEndBreak (render scale composite, grid, widgets, framegrab readback,
+// ImGui, swap). Events are formatted into a buffer that is handed to a writer thread
+// at every vdbBeginBreak, like log_file.h does for logs, so writing never blocks the
+// frame. The closing bracket is written at exit; viewers accept files without it if
+// the program stops early.
+#include <vector>
+
+struct trace_buffer_t
+{
+    std::vector<char> data;
+    trace_buffer_t *next;
+};
+
+namespace trace
+{
+    enum { MAX_DEPTH = 16 };
+
+    static FILE *file;
+    static SDL_Thread *thread;
+    static SDL_mutex *mutex;
+    static SDL_cond *queued;
+    static trace_buffer_t *queue_first; // protected by mutex
+    static trace_buffer_t *queue_last; // protected by mutex
+    static bool closing; // protected by mutex
+
+    static trace_buffer_t *buffer; // events since the last flush
+    static uint64_t start; // performance counter at vdbTraceToFile
+    static bool first_event;
+    static const char *names[MAX_DEPTH];
+    static uint64_t begins[MAX_DEPTH];
+    static int depth;
+    static uint64_t block_begin; // 0 outside of the user's block
+    static char block_label[256];
+
+    static double Microseconds(uint64_t t)
+    {
+        return 1e6*(double)(t - start)/(double)SDL_GetPerformanceFrequency();
+    }
+
+    static void Append(const char *text)
+    {
+        if (!buffer)
+        {
+            buffer = new trace_buffer_t;
+            buffer->next = NULL;
+        }
+        if (!first_event)
+            buffer->data.push_back(',');
+        first_event = false;
+        buffer->data.insert(buffer->data.end(), text, text + strlen(text));
+        buffer->data.push_back('\n');
+    }
+
+    // Writes s as the contents of a JSON string (without quotes), truncated to fit.
+    static void Escape(char *out, size_t size, const char *s)
+    {
+        size_t n = 0;
+        for (; *s && n + 7 < size; s++)
+        {
+            unsigned char c = (unsigned char)*s;
+            if (c == '"' || c == '\\') { out[n++] = '\\'; out[n++] = (char)c; }
+            else if (c < 0x20) n += sprintf(out + n, "\\u%04x", c);
+            else out[n++] = (char)c;
+        }
+        out[n] = '\0';
+    }
+
+    static void Complete(const char *name, uint64_t t0, uint64_t t1, const char *label = NULL)
+    {
+        char text[512];
+        int n = sprintf(text, "{\"name\":\"%s\",\"cat\":\"vdb\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%.3f,\"dur\":%.3f",
+            name, Microseconds(t0), Microseconds(t1) - Microseconds(t0));
+        if (label)
+        {
+            char escaped[256];
+            Escape(escaped, sizeof(escaped), label);
+            n += sprintf(text + n, ",\"args\":{\"label\":\"%s\"}", escaped);
+        }
+        sprintf(text + n, "}");
+        Append(text);
+    }
+
+    static void Begin(const char *name)
+    {
+        if (!file)
+            return;
+        if (depth < MAX_DEPTH)
+        {
+            names[depth] = name;
+            begins[depth] = SDL_GetPerformanceCounter();
+        }
+        depth++;
+    }
+
+    static void End()
+    {
+        if (!file || depth == 0)
+            return;
+        depth--;
+        if (depth < MAX_DEPTH)
+            Complete(names[depth], begins[depth], SDL_GetPerformanceCounter());
+    }
+
+    // Called when vdbBeginBreak returns true.
+    static void BeginBlock(const char *label)
+    {
+        if (!file)
+            return;
+        block_begin = SDL_GetPerformanceCounter();
+        strncpy(block_label, label ? label : "", sizeof(block_label) - 1);
+    }
+
+    // Called at the start of vdbEndBreak.
+    static void EndBlock()
+    {
+        if (!file || !block_begin)
+            return;
+        Complete("Block", block_begin, SDL_GetPerformanceCounter(), block_label);
+        block_begin = 0;
+    }
+
+    static int ThreadMain(void*)
+    {
+        for (;;)
+        {
+            SDL_LockMutex(mutex);
+            while (!queue_first && !closing)
+                SDL_CondWait(queued, mutex);
+            trace_buffer_t *b = queue_first;
+            queue_first = NULL;
+            queue_last = NULL;
+            bool done = closing && !b;
+            SDL_UnlockMutex(mutex);
+
+            if (done)
+                break;
+            while (b)
+            {
+                trace_buffer_t *next = b->next;
+                if (!b->data.empty())
+                    fwrite(&b->data[0], 1, b->data.size(), file);
+                delete b;
+                b = next;
+            }
+            fflush(file);
+        }
+        fprintf(file, "]\n");
+        return 0;
+    }
+
+    // Called at the start of every vdbBeginBreak.
+    static void Flush()
+    {
+        if (!file || !buffer)
+            return;
+        SDL_LockMutex(mutex);
+        if (queue_last) queue_last->next = buffer;
+        else queue_first = buffer;
+        queue_last = buffer;
+        SDL_CondSignal(queued);
+        SDL_UnlockMutex(mutex);
+        buffer = NULL;
+    }
+
+    static void Close()
+    {
+        if (!file)
+            return;
+        Flush();
+        SDL_LockMutex(mutex);
+        closing = true;
+        SDL_CondSignal(queued);
+        SDL_UnlockMutex(mutex);
+        SDL_WaitThread(thread, NULL);
+        thread = NULL;
+        fclose(file);
+        file = NULL;
+        depth = 0;
+        block_begin = 0;
+    }
+
+    static void CheckEnvironment()
+    {
+        const char *filename = getenv("VDB_TRACE");
+        if (!file && filename && *filename)
+            vdbTraceToFile(filename);
+    }
+}
+
+struct trace_scope_t
+{
+    trace_scope_t(const char *name) { trace::Begin(name); }
+    ~trace_scope_t() { trace::End(); }
+};
+
+void vdbTraceToFile(const char *filename)
+{
+    using namespace trace;
+    Close();
+    if (!filename)
+        return;
+    file = fopen(filename, "wb");
+    if (!file)
+    {
+        fprintf(stderr, "vdb: failed to open %s for writing\n", filename);
+        return;
+    }
+    fprintf(file, "[\n");
+    if (!mutex)
+    {
+        mutex = SDL_CreateMutex();
+        queued = SDL_CreateCond();
+        assert(mutex && queued);
+        atexit(Close); // writes the closing bracket
+    }
+    closing = false;
+    first_event = true;
+    start = SDL_GetPerformanceCounter();
+    Append("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"vdb\"}}");
+    thread = SDL_CreateThread(ThreadMain, "vdb trace writer", NULL);
+    assert(thread && "Failed to create trace writer thread");
+}
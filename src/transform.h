@@ -1,26 +1,63 @@
 namespace transform
 {
-    static vdbMat4 projection = vdbMatIdentity();
+    static vdbMat4 projection = vdbMatIdentity(); // as set by the user (without the tile)
     static vdbMat4 view_model = vdbMatIdentity();
-    static vdbMat4 pvm = vdbMatIdentity();
+    static vdbMat4 pvm = vdbMatIdentity(); // tile*projection*view_model
     static matrix_stack_t matrix_stack = {0};
-    int viewport_left;
+
+    // While a poster is rendered in tiles (see poster.h) and tiled_framebuffer is bound,
+    // the framebuffer size reported to the user is that of the full poster, so that
+    // aspect ratios come out right, and viewports are given in poster pixels. The
+    // viewport is then clipped to the tile, whose lower-left corner is at (tile_left,
+    // tile_bottom) in the poster, and 'tile' maps the viewport's normalized device
+    // coordinates to the clipped one's. It is only applied when building pvm, so that
+    // the user gets back the projection they set.
+    static vdbMat4 tile = vdbMatIdentity();
+    static bool tiled; // tile is not the identity
+    static framebuffer_t *tiled_framebuffer;
+    static int tiled_width;
+    static int tiled_height;
+    static int tile_left;
+    static int tile_bottom;
+    int viewport_left; // as set by the user
     int viewport_bottom;
     int viewport_width;
     int viewport_height;
 
+    static void UpdatePVM()
+    {
+        pvm = vdbMul4x4(projection, view_model);
+        if (tiled)
+            pvm = vdbMul4x4(tile, pvm);
+    }
+
+    // Projection to use with the current GL viewport (for shaders that take the
+    // projection and model-to-view matrices separately).
+    static vdbMat4 TiledProjection()
+    {
+        return tiled ? vdbMul4x4(tile, projection) : projection;
+    }
+
     static void NewFrame()
     {
         projection = vdbMatIdentity();
         view_model = vdbMatIdentity();
-        pvm = vdbMatIdentity();
         matrix_stack.Reset();
-        vdbViewporti(0, 0, window::framebuffer_width, window::framebuffer_height);
+        vdbViewporti(0, 0, vdbGetFramebufferWidth(), vdbGetFramebufferHeight()); // updates pvm
     }
 }
 
+static void GetViewport(GLint viewport[4])
+{
+    viewport[0] = transform::viewport_left;
+    viewport[1] = transform::viewport_bottom;
+    viewport[2] = transform::viewport_width;
+    viewport[3] = transform::viewport_height;
+}
+
 void vdbPushMatrix()
 {
+    if (watch::recording && watch::Record(WATCH_PUSH_MATRIX)) return;
     using namespace transform;
     matrix_stack.Push();
     view_model = matrix_stack.Top();
@@ -28,30 +65,34 @@ void vdbPushMatrix()
 
 void vdbPopMatrix()
 {
+    if (watch::recording && watch::Record(WATCH_POP_MATRIX)) return;
     using namespace transform;
     matrix_stack.Pop();
     view_model = matrix_stack.Top();
-    pvm = vdbMul4x4(projection, view_model);
+    UpdatePVM();
 }
 
 void vdbProjection(vdbMat4 m)
 {
+    if (watch::recording && watch::Record(WATCH_PROJECTION, &m, sizeof(m))) return;
     transform::projection = m;
-    transform::pvm = vdbMul4x4(m, transform::view_model);
+    transform::UpdatePVM();
 }
 
 void vdbLoadMatrix(vdbMat4 m)
 {
+    if (watch::recording && watch::Record(WATCH_LOAD_MATRIX, &m, sizeof(m))) return;
     transform::matrix_stack.Load(m);
     transform::view_model = transform::matrix_stack.Top();
-    transform::pvm = vdbMul4x4(transform::projection, transform::view_model);
+    transform::UpdatePVM();
 }
 
 void vdbMultMatrix(vdbMat4 m)
 {
+    if (watch::recording && watch::Record(WATCH_MULT_MATRIX, &m, sizeof(m))) return;
     transform::matrix_stack.Multiply(m);
     transform::view_model = transform::matrix_stack.Top();
-    transform::pvm = vdbMul4x4(transform::projection, transform::view_model);
+    transform::UpdatePVM();
 }
 
 void vdbProjection(float *m)           { vdbProjection(m ? *(vdbMat4*)m : vdbMatIdentity()); }
@@ -90,6 +131,7 @@ void vdbOrtho(float x_left, float x_right, float y_bottom, float y_top, float z_
 
 void vdbPerspective(float yfov, float z_near, float z_far, float x_offset, float y_offset)
 {
+    if (watch::recording) { float args[] = {yfov,z_near,z_far,x_offset,y_offset}; if (watch::Record(WATCH_PERSPECTIVE, args, sizeof(args))) return; }
     float t = 1.0f/tanf(yfov/2.0f);
     vdbMat4 p = {0};
     p(0,0) = t/(vdbGetAspectRatio());
@@ -110,38 +152,83 @@ int vdbGetWindowHeight() { return window::window_height; }
 
 int vdbGetFramebufferWidth()
 {
-    if (current_framebuffer)
+    if (current_framebuffer && current_framebuffer == transform::tiled_framebuffer)
+        return transform::tiled_width;
+    else if (current_framebuffer)
         return current_framebuffer->width;
     else return window::framebuffer_width;
 }
 
 int vdbGetFramebufferHeight()
 {
-    if (current_framebuffer)
+    if (current_framebuffer && current_framebuffer == transform::tiled_framebuffer)
+        return transform::tiled_height;
+    else if (current_framebuffer)
         return current_framebuffer->height;
     else return window::framebuffer_height;
 }
 
+float vdbGetFrameDelta() { return window::frame_delta; }
+double vdbGetTime() { return window::GetTime(); }
+
 float vdbGetAspectRatio()
 {
     return (float)vdbGetFramebufferWidth()/vdbGetFramebufferHeight();
 }
 
+static void SetViewport(int left, int bottom, int width, int height)
+{
+    using namespace transform;
+    viewport_left = left;
+    viewport_bottom = bottom;
+    viewport_width = width;
+    viewport_height = height;
+    tiled = current_framebuffer && current_framebuffer == tiled_framebuffer;
+    if (tiled)
+    {
+        // the viewport in the tile's pixels, and its part that lies within the tile
+        int l = left - tile_left;
+        int b = bottom - tile_bottom;
+        int x0 = l > 0 ? l : 0;
+        int y0 = b > 0 ? b : 0;
+        int x1 = l + width < tiled_framebuffer->width ? l + width : tiled_framebuffer->width;
+        int y1 = b + height < tiled_framebuffer->height ? b + height : tiled_framebuffer->height;
+        if (x1 > x0 && y1 > y0)
+        {
+            float sx = (float)width/(x1 - x0);
+            float sy = (float)height/(y1 - y0);
+            float tx = (float)(2*(l - x0) + width)/(x1 - x0) - 1.0f;
+            float ty = (float)(2*(b - y0) + height)/(y1 - y0) - 1.0f;
+            tile = vdbInitMat4(sx,0,0,tx, 0,sy,0,ty, 0,0,1,0, 0,0,0,1);
+            glViewport(x0, y0, (GLsizei)(x1 - x0), (GLsizei)(y1 - y0));
+        }
+        else
+        {
+            tile = vdbMatIdentity();
+            glViewport(0, 0, 0, 0); // the viewport doesn't cover this tile
+        }
+    }
+    else
+    {
+        tile = vdbMatIdentity();
+        glViewport(left, bottom, (GLsizei)width, (GLsizei)height);
+    }
+    UpdatePVM();
+}
+
 void vdbViewporti(int left, int bottom, int width, int height)
 {
-    glViewport(left, bottom, (GLsizei)width, (GLsizei)height);
-    transform::viewport_left = left;
-    transform::viewport_bottom = bottom;
-    transform::viewport_width = width;
-    transform::viewport_height = height;
+    if (watch::recording) { int args[] = {left,bottom,width,height}; if (watch::Record(WATCH_VIEWPORTI, args, sizeof(args))) return; }
+    SetViewport(left, bottom, width, height);
 }
 
 void vdbViewport(float left, float bottom, float width, float height)
 {
+    if (watch::recording) { float args[] = {left,bottom,width,height}; if (watch::Record(WATCH_VIEWPORT, args, sizeof(args))) return; }
     int fb_width = vdbGetFramebufferWidth();
     int fb_height = vdbGetFramebufferHeight();
-    vdbViewporti((int)(left*fb_width), (int)(bottom*fb_height),
-                 (int)(width*fb_width), (int)(height*fb_height));
+    SetViewport((int)(left*fb_width), (int)(bottom*fb_height),
+                (int)(width*fb_width), (int)(height*fb_height));
 }
 
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
@@ -9,6 +9,7 @@ namespace ui
     static bool take_screenshot_should_open;
     static bool record_video_should_open;
     static bool save_logs_should_open;
+    static bool load_logs_should_open;
     static bool hide_logs;
 
     static ImFont *regular_font;
@@ -34,7 +35,9 @@ namespace ui
         bool open;
         char label[query_buffer_size];
         char query_buffer[query_buffer_size];
-        bool plot_as_histogram;
+        bool plot_as_histogram; // toggled by right-clicking the plot
+        log_plot_t plot;
+        log_query_t query; // cached result of query_buffer
         log_window_t *next;
     };
 
@@ -117,39 +120,66 @@ static void ui::ShowLogWindow(log_window_t *window)
         ImGui::PopItemWidth();
     }
 
-    log_t *l = logs.Find(window->query_buffer);
+    log_query_t *query = &window->query;
+    logs.Resolve(query, window->query_buffer);
+    log_t *l = query->num_matches > 0 ? query->matches[query->num_matches - 1] : NULL;
 
     ImVec2 plot_area_size = ImGui::GetContentRegionAvail();
 
-    if (l && l->type == log_type_scalar)
+    if (l && l->type == log_type_scalar && query->num_matches > 1)
+    {
+        // several logs match: plot the newest value of each, e.g. one per iteration
+        static std::vector<float> values;
+        values.resize(query->num_matches);
+        int values_count = 0;
+        for (int i = 0; i < query->num_matches; i++)
+        {
+            log_t *match = query->matches[i];
+            if (match->type == log_type_scalar && match->series.total > 0)
+                values[values_count++] = match->series.Last();
+        }
+        static char overlay[64];
+        sprintf(overlay, "%d logs", query->num_matches);
+        if (window->plot_as_histogram)
+            ImGui::PlotHistogram("##plot", &values[0], values_count, 0, overlay, FLT_MAX, FLT_MAX, plot_area_size);
+        else
+            ImGui::PlotLines("##plot", &values[0], values_count, 0, overlay, FLT_MAX, FLT_MAX, plot_area_size);
+        if (ImGui::IsItemClicked(1))
+            window->plot_as_histogram = !window->plot_as_histogram;
+    }
+    else if (l && l->type == log_type_scalar)
     {
         float scale_min = FLT_MAX;
         float scale_max = FLT_MAX;
         const char *label = "##plot";
-        const float *values = &l->data[0];
-        int values_count = (int)l->data.size();
-        int values_offset = 0;
         const char *overlay = NULL;
 
-        if (values_count == 1)
+        if (l->series.Count() == 1)
         {
             static char buffer[1024];
-            sprintf(buffer, "%g", values[0]);
+            sprintf(buffer, "%g", l->series.Last());
             ImGui::PushFont(ui::big_font);
             ImVec2 text_size = ImGui::CalcTextSize(buffer);
             ImGui::SetCursorPosX(plot_area_size.x*0.5f - text_size.x*0.5f);
             ImGui::Text(buffer);
             ImGui::PopFont();
         }
+        else if (window->plot_as_histogram)
+        {
+            // about one min/max pair per pixel, however many samples are kept
+            static std::vector<float> values;
+            int width = (int)plot_area_size.x;
+            if (width < 1) width = 1;
+            values.resize(2*width);
+            int values_count = l->series.Plot(&values[0], width);
+            ImGui::PlotHistogram(label, &values[0], values_count, 0, overlay, scale_min, scale_max, plot_area_size);
+        }
         else
         {
-            if (window->plot_as_histogram)
-                ImGui::PlotHistogram(label, values, values_count, values_offset, overlay, scale_min, scale_max, plot_area_size);
-            else
-                ImGui::PlotLines(label, values, values_count, values_offset, overlay, scale_min, scale_max, plot_area_size);
-            if (ImGui::IsItemClicked())
-                window->plot_as_histogram = !window->plot_as_histogram;
+            log_plot::Draw(&window->plot, l, plot_area_size);
         }
+        if (ImGui::IsItemClicked(1))
+            window->plot_as_histogram = !window->plot_as_histogram;
     }
     else if (l && l->type == log_type_matrix)
     {
@@ -180,6 +210,8 @@ static void ui::ShowLogWindows()
             if (!window->open)
             {
                 log_window_t *next = window->next;
+                log_plot::Release(&window->plot);
+                free(window->query.matches);
                 free(window);
                 if (!prev) log_windows::first = next;
                 else prev->next = next;
@@ -196,22 +228,30 @@ static void ui::ShowLogWindows()
     using namespace ImGui;
     bool enter_button = keys::pressed[VDB_KEY_RETURN];
     bool escape_button = keys::pressed[VDB_KEY_ESCAPE];
-    if (save_logs_should_open)
+    static bool load_logs;
+    if (save_logs_should_open || load_logs_should_open)
     {
+        load_logs = load_logs_should_open;
         save_logs_should_open = false;
-        OpenPopup("Save logs##popup");
+        load_logs_should_open = false;
+        OpenPopup("Logs file##popup");
         CaptureKeyboardFromApp(true);
     }
-    if (BeginPopupModal("Save logs##popup", NULL, ImGuiWindowFlags_AlwaysAutoResize))
+    if (BeginPopupModal("Logs file##popup", NULL, ImGuiWindowFlags_AlwaysAutoResize))
     {
         static char filename[1024];
         if (IsWindowAppearing())
             SetKeyboardFocusHere();
         InputText("Filename", filename, sizeof(filename));
+        SameLine();
+        ShowHelpMarker("Logs are saved as JSON, or in binary if the filename ends in .vdblog.\nOnly .vdblog files can be loaded.");
 
-        if (Button("OK [Enter]", ImVec2(120,0)) || enter_button)
+        if (Button(load_logs ? "Load [Enter]" : "Save [Enter]", ImVec2(120,0)) || enter_button)
         {
-            logs.Dump(filename);
+            if (load_logs)
+                vdbLogLoad(filename);
+            else
+                vdbLogDump(filename);
             CloseCurrentPopup();
         }
         SameLine();
@@ -292,6 +332,8 @@ static void ui::MainMenuBar(frame_settings_t *fs)
         ImGui::MenuItem("Window size", "Alt+W", &window_size_dialog_should_open);
         ImGui::MenuItem("Never ask on exit", NULL, &settings.never_ask_on_exit);
         ImGui::MenuItem("Can idle", NULL, &settings.can_idle);
+        if (ImGui::MenuItem("Frame history", NULL, &settings.history) && !settings.history)
+            history::Clear();
         if (ImGui::BeginMenu("Auto step delay"))
         {
             if (ImGui::MenuItem("0 ms",   NULL, settings.auto_step_delay_ms==0))    settings.auto_step_delay_ms = 0;
@@ -302,6 +344,18 @@ static void ui::MainMenuBar(frame_settings_t *fs)
             if (ImGui::MenuItem("1 sec" , NULL, settings.auto_step_delay_ms==1000)) settings.auto_step_delay_ms = 1000;
             ImGui::EndMenu();
         }
+        if (ImGui::MenuItem("VSync", NULL, &settings.vsync))
+            window::SetVSync(settings.vsync);
+        if (ImGui::BeginMenu("Frame rate cap"))
+        {
+            if (ImGui::MenuItem("Refresh rate", NULL, settings.frame_rate_cap==0))  settings.frame_rate_cap = 0;
+            if (ImGui::MenuItem("30 fps",       NULL, settings.frame_rate_cap==30)) settings.frame_rate_cap = 30;
+            if (ImGui::MenuItem("60 fps",       NULL, settings.frame_rate_cap==60)) settings.frame_rate_cap = 60;
+            if (ImGui::MenuItem("120 fps",      NULL, settings.frame_rate_cap==120)) settings.frame_rate_cap = 120;
+            if (ImGui::MenuItem("144 fps",      NULL, settings.frame_rate_cap==144)) settings.frame_rate_cap = 144;
+            if (ImGui::MenuItem("Unlimited",    NULL, settings.frame_rate_cap==-1)) settings.frame_rate_cap = -1;
+            ImGui::EndMenu();
+        }
         if (ImGui::BeginMenu("Font"))
         {
             if (ImGui::BeginMenu("DPI scale"))
@@ -341,6 +395,15 @@ static void ui::MainMenuBar(frame_settings_t *fs)
             ImGui::Separator();
             ITEM("8/8", 3, 3);
             #undef ITEM
+            ImGui::Separator();
+            if (ImGui::MenuItem("Reproject when moving", NULL, &fs->render_scaler.reproject))
+                fs->render_scaler.dirty = true;
+            if (ImGui::MenuItem("Dynamic resolution", NULL, &fs->render_scaler.dynamic))
+                fs->render_scaler.dirty = true;
+            if (ImGui::IsItemHovered())
+                ImGui::SetTooltip("Lowers the resolution while the scene is slow to draw (%g ms target),\nand returns to full quality when you stop interacting.\nThe upsampling factor of the selected scale is kept.", VDB_DYNAMIC_RESOLUTION_TARGET_MS);
+            if (fs->render_scaler.dynamic)
+                ImGui::TextDisabled("%d%% (%.1f ms)", (int)(100.0f*render_scaler::dynamic_scale + 0.5f), render_scaler::dynamic_gpu_ms);
             ImGui::EndMenu();
         }
         ImGui::EndMenu();
@@ -349,12 +412,17 @@ static void ui::MainMenuBar(frame_settings_t *fs)
     {
         if (ImGui::MenuItem("New log window", "Alt+L")) NewLogWindow();
         if (ImGui::MenuItem("Save logs", NULL)) save_logs_should_open = true;
+        if (ImGui::MenuItem("Load logs", NULL)) load_logs_should_open = true;
+        ImGui::MenuItem("Profiler", NULL, &profiler::window_open);
+        ImGui::MenuItem("GPU timing", NULL, &gpu_timer::enabled);
+        ImGui::MenuItem("Frame stats", NULL, &frame_stats::overlay_open);
         if (ImGui::MenuItem("Take screenshot", "Alt+S")) take_screenshot_should_open = true;
         if (ImGui::MenuItem("Record video", "Alt+S")) record_video_should_open = true;
         ImGui::MenuItem("Ruler", "Alt+R", &ruler_mode_active);
         ImGui::MenuItem("Draw", "Alt+D", &sketch_mode_active);
         ImGui::EndMenu();
     }
+    gpu_timer::Menu();
     ImGui::Separator();
     if (auto_step)
     {
@@ -473,6 +541,8 @@ static void ui::FramegrabDialog()
         const int mode_single = 0;
         const int mode_sequence = 1;
         const int mode_ffmpeg = 2;
+        const int mode_poster = 3;
+        const int mode_raw = 4;
         static bool draw_imgui = false;
         static bool draw_cursor = false;
         RadioButton("Screenshot", &mode, mode_single);
@@ -486,6 +556,14 @@ static void ui::FramegrabDialog()
         RadioButton("ffmpeg", &mode, mode_ffmpeg);
         SameLine();
         ImGui::ShowHelpMarker("Record a video with raw frames piped directly to ffmpeg, and save the output in the format specified by your filename extension (e.g. mp4). This option can be quicker as it avoids writing to the disk.\nMake sure the 'ffmpeg' executable is visible from the terminal you launched this program in.");
+        SameLine();
+        RadioButton("Raw", &mode, mode_raw);
+        SameLine();
+        ImGui::ShowHelpMarker("Record frames into a single uncompressed (or LZ4-compressed) .vdbcap file. This is the fastest mode, meant for short bursts at high framerates. Convert the file to images or video afterwards with the vdbcap tool (tools/vdbcap).");
+        SameLine();
+        RadioButton("Poster", &mode, mode_poster);
+        SameLine();
+        ImGui::ShowHelpMarker("Take a single screenshot at a higher resolution than the window (e.g. 16384x16384), saved as PNG. The image is rendered in window-sized tiles over several frames, so the scene should not change meanwhile.");
 
         Checkbox("Alpha (32bpp)", &alpha);
         SameLine();
@@ -529,10 +607,15 @@ static void ui::FramegrabDialog()
             static bool do_continue = false;
             static int start_from = 0;
             static int frame_cap = 0;
+            static bool drop_frames = false;
             InputInt("Number of frames", &frame_cap);
             SameLine();
             ImGui::ShowHelpMarker("0 for unlimited. To stop the recording at any time, press the same hotkey you used to open this dialog (CTRL+S by default).");
 
+            Checkbox("Drop frames if encoder is busy", &drop_frames);
+            SameLine();
+            ImGui::ShowHelpMarker("Images are encoded on background threads. If they can't keep up, recording normally waits for them (slowing down your program). Enable this to skip frames instead. Tip: .qoi and .bmp files are much faster to write than .png.");
+
             Checkbox("Continue from last frame", &do_continue);
             SameLine();
             ImGui::ShowHelpMarker("Enable this to continue the image filename number suffix from the last image sequence that was recording (in this program session).");
@@ -543,6 +626,12 @@ static void ui::FramegrabDialog()
                 InputInt("Start from", &start_from);
             }
 
+            int written = SDL_AtomicGet(&framegrab::frames_written);
+            int dropped = SDL_AtomicGet(&framegrab::frames_dropped);
+            int stalled = SDL_AtomicGet(&framegrab::frames_stalled);
+            if (written > 0 || dropped > 0)
+                TextDisabled("Last recording: %d frames written, %d dropped, %d waited for encoder", written, dropped, stalled);
+
             if (Button("Start [Enter]", ImVec2(120,0)) || enter_button)
             {
                 framegrab_options_t opt = {0};
@@ -552,6 +641,8 @@ static void ui::FramegrabDialog()
                 opt.draw_imgui = draw_imgui;
                 opt.video_frame_cap = frame_cap;
                 opt.reset_counter = !do_continue;
+                opt.start_from = start_from;
+                opt.drop_frames = drop_frames;
                 framegrab::RecordImageSequence(opt);
                 CloseCurrentPopup();
             }
@@ -568,11 +659,32 @@ static void ui::FramegrabDialog()
             static int frame_cap = 0;
             static float framerate = 60;
             static int crf = 21;
+            static int codec = FFMPEG_H264;
+            static int preset = FFMPEG_PRESET_FAST;
+            static bool drop_frames = false;
+            const char *codec_names[FFMPEG_NUM_CODECS] = { "H.264", "H.265", "VP9", "MPEG-4", "FFV1 (lossless)" };
+            const char *preset_names[FFMPEG_NUM_PRESETS] = { "fast", "veryfast", "ultrafast", "medium", "slow" };
             InputInt("Number of frames", &frame_cap);
             SameLine();
             ImGui::ShowHelpMarker("0 for unlimited. To stop the recording at any time, press the same hotkey you used to open this dialog (CTRL+S by default).");
-            SliderInt("Quality (lower is better)", &crf, 1, 51);
+            Combo("Codec", &codec, codec_names, FFMPEG_NUM_CODECS);
+            SameLine();
+            ImGui::ShowHelpMarker("The output container is chosen by ffmpeg from the filename extension. Use .mp4 for H.264/H.265/MPEG-4, .webm for VP9 and .mkv for FFV1.");
+            Combo("Preset", &preset, preset_names, FFMPEG_NUM_PRESETS);
+            SameLine();
+            ImGui::ShowHelpMarker("Faster presets use less CPU per frame, making it less likely that ffmpeg falls behind your program, at the cost of larger files.");
+            if (codec != FFMPEG_FFV1)
+                SliderInt("Quality (lower is better)", &crf, 1, 51);
             InputFloat("Framerate", &framerate);
+            Checkbox("Drop frames if ffmpeg is busy", &drop_frames);
+            SameLine();
+            ImGui::ShowHelpMarker("Frames are piped to ffmpeg from a background thread. If ffmpeg can't keep up, recording normally waits for it (slowing down your program). Enable this to skip frames instead.");
+
+            int written = SDL_AtomicGet(&framegrab::frames_written);
+            int dropped = SDL_AtomicGet(&framegrab::frames_dropped);
+            int stalled = SDL_AtomicGet(&framegrab::frames_stalled);
+            if (written > 0 || dropped > 0)
+                TextDisabled("Last recording: %d frames written, %d dropped, %d waited for ffmpeg", written, dropped, stalled);
 
             if (Button("Start [Enter]", ImVec2(120,0)) || enter_button)
             {
@@ -583,7 +695,10 @@ static void ui::FramegrabDialog()
                 opt.draw_imgui = draw_imgui;
                 opt.ffmpeg_crf = crf;
                 opt.ffmpeg_fps = framerate;
+                opt.ffmpeg_codec = codec;
+                opt.ffmpeg_preset = preset;
                 opt.video_frame_cap = frame_cap;
+                opt.drop_frames = drop_frames;
                 framegrab::RecordFFmpeg(opt);
                 CloseCurrentPopup();
             }
@@ -595,6 +710,85 @@ static void ui::FramegrabDialog()
                 CloseCurrentPopup();
             }
         }
+        else if (mode == mode_raw)
+        {
+            static int frame_cap = 0;
+            static int capacity_mb = 2048;
+            static bool lz4 = true;
+            static bool drop_frames = false;
+            InputInt("Number of frames", &frame_cap);
+            SameLine();
+            ImGui::ShowHelpMarker("0 for unlimited (until the file is full). To stop the recording at any time, press the same hotkey you used to open this dialog (CTRL+S by default).");
+            InputInt("File size (MB)", &capacity_mb);
+            SameLine();
+            ImGui::ShowHelpMarker("Disk space reserved up front for the recording. The file is trimmed to the space actually used when the recording stops.");
+            Checkbox("LZ4 compression", &lz4);
+            SameLine();
+            ImGui::ShowHelpMarker("Compress frames on the encoder threads. Typical vdb output compresses very well, so this fits many more frames in the file, but uses more CPU.");
+            Checkbox("Drop frames if encoder is busy", &drop_frames);
+
+            int written = SDL_AtomicGet(&framegrab::frames_written);
+            int dropped = SDL_AtomicGet(&framegrab::frames_dropped);
+            int stalled = SDL_AtomicGet(&framegrab::frames_stalled);
+            if (written > 0 || dropped > 0)
+                TextDisabled("Last recording: %d frames written, %d dropped, %d waited for encoder", written, dropped, stalled);
+
+            if (Button("Start [Enter]", ImVec2(120,0)) || enter_button)
+            {
+                static char raw_filename[1024];
+                snprintf(raw_filename, sizeof(raw_filename), filename, framegrab::suffix_counter);
+                framegrab::suffix_counter++;
+
+                framegrab_options_t opt = {0};
+                opt.filename = raw_filename;
+                opt.alpha_channel = alpha;
+                opt.draw_cursor = draw_cursor;
+                opt.draw_imgui = draw_imgui;
+                opt.video_frame_cap = frame_cap;
+                opt.drop_frames = drop_frames;
+                opt.raw_lz4 = lz4;
+                opt.raw_capacity_mb = capacity_mb;
+                framegrab::RecordRaw(opt);
+                CloseCurrentPopup();
+            }
+            SameLine();
+            ImGui::ShowHelpMarker("Press ESCAPE or CTRL+S to stop.");
+            SameLine();
+            if (Button("Cancel", ImVec2(120,0)))
+            {
+                CloseCurrentPopup();
+            }
+        }
+        else if (mode == mode_poster)
+        {
+            static int poster_width = 0;
+            static int poster_height = 0;
+            if (poster_width <= 0 || poster_height <= 0)
+            {
+                poster_width = 4*window::framebuffer_width;
+                poster_height = 4*window::framebuffer_height;
+            }
+            InputInt("Width", &poster_width);
+            InputInt("Height", &poster_height);
+            SameLine();
+            ImGui::ShowHelpMarker("Use the same aspect ratio as the window to get the same framing as on screen. Only one row of tiles is kept in memory, so very large sizes are fine.");
+            if (Button("Start [Enter]", ImVec2(120,0)) || enter_button)
+            {
+                if (poster_width > 0 && poster_height > 0)
+                {
+                    char poster_filename[1024];
+                    snprintf(poster_filename, sizeof(poster_filename), filename, framegrab::suffix_counter);
+                    framegrab::suffix_counter++;
+                    poster::Start(poster_filename, poster_width, poster_height, alpha);
+                }
+                CloseCurrentPopup();
+            }
+            SameLine();
+            if (Button("Cancel", ImVec2(120,0)))
+            {
+                CloseCurrentPopup();
+            }
+        }
 
         if (escape_button)
         {
@@ -603,6 +797,22 @@ static void ui::FramegrabDialog()
         }
         EndPopup();
     }
+
+    if (poster::active)
+    {
+        SetNextWindowPos(ImVec2(GetIO().DisplaySize.x*0.5f, GetIO().DisplaySize.y*0.5f), ImGuiCond_Always, ImVec2(0.5f, 0.5f));
+        Begin("##poster progress", NULL, ImGuiWindowFlags_NoTitleBar|ImGuiWindowFlags_AlwaysAutoResize|ImGuiWindowFlags_NoSavedSettings);
+        int num_tiles = poster::num_tiles_x*poster::num_tiles_y;
+        int tiles_done = poster::tile_y*poster::num_tiles_x + poster::tile_x;
+        Text("Rendering %dx%d poster: tile %d of %d", poster::width, poster::height, tiles_done + 1, num_tiles);
+        ProgressBar((float)tiles_done/num_tiles);
+        if (Button("Cancel [Esc]") || escape_button)
+        {
+            poster::Cancel();
+            ui::escape_eaten = true;
+        }
+        End();
+    }
 }
 
 static void ui::RulerNewFrame()
@@ -37,21 +37,39 @@
 #include "vdb.h"
 #include "matrix.h"
 #include "keys.h"
+#include "spsc.h"
+#include "trace.h"
 #include "settings.h"
 #include "mouse.h"
 #include "window.h"
+#include "gpu_timer.h"
+#include "frame_stats.h"
+#include "watch.h"
 #include "matrix_stack.h"
 #include "camera.h"
 #include "shader.h"
 #include "image.h"
 #include "framebuffer.h"
 #include "render_target.h"
+#include "frame_cache.h"
+#include "headless.h"
+#include "vdbcap.h"
+#include "vdbrec.h"
+#include "recorder.h"
 #include "framegrab.h"
+#include "remote.h"
+#include "history.h"
 #include "transform.h"
 #include "immediate.h"
 #include "immediate_util.h"
 #include "render_scaler.h"
+#include "poster.h"
 #include "log.h"
+#include "log_threads.h"
+#include "vdblog.h"
+#include "log_file.h"
+#include "log_plot.h"
+#include "profiler.h"
 #include "ui.h"
 #include "widgets.h"
 #include "hints.h"
@@ -89,6 +107,8 @@ namespace vdb
 
 bool vdbIsFirstFrame()
 {
+    if (watch::recording && !watch::passthrough)
+        return true; // see watch.h
     return vdb::is_first_frame;
 }
 
@@ -124,6 +144,26 @@ static frame_settings_t *GetFrameSettings()
 
 bool vdbBeginBreak(const char *label)
 {
+    if (!vdb::initialized)
+        remote::CheckEnvironment();
+
+    // the watched thread only records; the logs, the log file and the trace are left
+    // to the render thread (see watch.h)
+    if (watch::active && !watch::on_render_thread && !remote::connected)
+        return watch::BeginBreak(label);
+
+    trace::Flush();
+    if (!vdb::initialized)
+        trace::CheckEnvironment();
+    trace_scope_t trace_scope("vdbBeginBreak");
+    trace::Begin("Merge logs");
+    log_threads::ClaimOwner();
+    log_threads::Merge();
+    log_file::Flush();
+    trace::End();
+    if (remote::connected)
+        return remote::BeginBreak(label);
+
     static const char *skip_label = NULL;
     static const char *prev_label = NULL;
     static bool is_first_frame = true;
@@ -134,6 +174,8 @@ bool vdbBeginBreak(const char *label)
         return false;
     is_first_frame = false; // todo: first frame detection is janky.
                             // consider e.g. a for loop with single-stepping
+    if (vdb::is_first_frame)
+        profiler::Collect();
 
     if (!vdb::initialized)
     {
@@ -141,7 +183,13 @@ bool vdbBeginBreak(const char *label)
 
         settings.LoadOrDefault(VDB_SETTINGS_FILENAME);
         window_settings_t ws = settings.window;
-        window::Open(ws.x, ws.y, ws.width, ws.height);
+        headless::CheckEnvironment();
+        recorder::CheckEnvironment();
+        window::headless = headless::active;
+        if (headless::active)
+            window::Open(-1, -1, headless::width, headless::height);
+        else
+            window::Open(ws.x, ws.y, ws.width, ws.height);
         CheckGLError();
 
         ImGui::CreateContext();
@@ -215,10 +263,34 @@ bool vdbBeginBreak(const char *label)
 
     window::EnsureGLContextIsCurrent();
 
-    if (settings.can_idle && !ui::auto_step)
+    trace::Begin("Wait for events");
+    if (headless::active)
+    {
+        window::PollEvents();
+    }
+    else if (settings.can_idle && !ui::auto_step)
+    {
         window::WaitEvents();
+
+        // Nothing that affects the image happened while we were idle (e.g. the window
+        // was uncovered), so show the last frame again instead of drawing a new one.
+        while (!window::input_changed && !window::should_quit && frame_cache::Present())
+            window::WaitEvents();
+    }
     else
+    {
         window::PollEvents();
+    }
+    trace::End();
+    frame_cache::valid = false;
+
+    // in headless mode each break is rendered once, then we continue as if stepping
+    if (headless::active && headless::frame_done)
+    {
+        headless::frame_done = false;
+        is_first_frame = true;
+        return false;
+    }
 
     window::SetNumSettleFrames(3); // ImGui requires 2-3 frames for e.g. button clicks to settle
     // Subsequent functions in VDB may also require a minimum number of frames to settle,
@@ -240,12 +312,12 @@ bool vdbBeginBreak(const char *label)
     should_step_once |= vdb::want_step_once;
     if (ui::auto_step)
     {
-        static int t = 0;
-        t++;
-        if (t > settings.auto_step_delay_ms*60/1000)
+        static double last_step_time = 0.0;
+        double t = window::GetTime();
+        if (t - last_step_time >= settings.auto_step_delay_ms/1000.0)
         {
             should_step_once |= true;
-            t = 0;
+            last_step_time = t;
         }
     }
 
@@ -266,19 +338,35 @@ bool vdbBeginBreak(const char *label)
     }
     if (window::should_quit)
     {
+        if (framegrab::active)
+            framegrab::FinishFramegrab();
+        if (poster::active)
+            poster::Cancel();
         settings.Save(VDB_SETTINGS_FILENAME);
         window::Close();
+        if (watch::on_render_thread)
+        {
+            // leave the watched program running (see watch.h)
+            SDL_AtomicSet(&watch::viewer_closed, 1);
+            return false;
+        }
         exit(0);
     }
 
+    window::NewFrameClock();
+    if (headless::active)
+        headless::BeginFrame(label);
+
     transform::NewFrame();
     mouse::NewFrame();
     immediate_util::NewFrame();
     immediate::NewFrame();
 
+    trace::Begin("ImGui new frame");
     ImGui_ImplOpenGL3_NewFrame();
     ImGui_ImplSDL2_NewFrame(window::sdl_window);
     ImGui::NewFrame();
+    trace::End();
 
     widgets::NewFrame();
     glPixelStorei(GL_UNPACK_ALIGNMENT, 1); // Assuming user uploads images that are one-byte packed
@@ -297,13 +385,20 @@ bool vdbBeginBreak(const char *label)
     glDepthMask(GL_FALSE);
     glDisable(GL_DEPTH_TEST);
 
-    if (vdb::frame_settings->render_scaler.down > 0)
+    if (poster::active)
+    {
+        poster::BeginTile(); // replaces the render scaler while the poster renders
+    }
+    else if (!headless::active && (vdb::frame_settings->render_scaler.down > 0 || vdb::frame_settings->render_scaler.dynamic))
     {
         int n_down = vdb::frame_settings->render_scaler.down;
         int n_up = vdb::frame_settings->render_scaler.up;
         int w = window::framebuffer_width >> n_down;
         int h = window::framebuffer_height >> n_down;
-        render_scaler::Begin(w, h, n_up);
+        bool dynamic = vdb::frame_settings->render_scaler.dynamic;
+        if (dynamic)
+            render_scaler::GetDynamicSize(window::framebuffer_width, window::framebuffer_height, n_up, &w, &h);
+        render_scaler::Begin(w, h, n_up, vdb::frame_settings->render_scaler.reproject, dynamic);
         glEnable(GL_DEPTH_TEST);
         glDepthMask(GL_TRUE);
         glClearDepth(1.0f);
@@ -348,20 +443,57 @@ bool vdbBeginBreak(const char *label)
         vdbMultMatrix(vdbMatScale(1.0f/fs->grid.grid_scale, 1.0f/fs->grid.grid_scale, 1.0f/fs->grid.grid_scale).data);
     }
 
+    // the built-in cameras always read the mouse position, but only use it while a button is held
+    mouse::position_used = false;
+
     CheckGLError();
 
+    if (vdb::is_first_frame && !watch::active && (recorder::file || history::Enabled()))
+        recorder::BeginFrame(label);
+    history::BeginFrame(label, vdb::is_first_frame);
+
+    trace::BeginBlock(label);
     return true;
 }
 
 void vdbEndBreak()
 {
+    if (watch::recording && !watch::passthrough && !remote::connected)
+    {
+        watch::EndBreak();
+        return;
+    }
+
+    trace::EndBlock();
+    trace_scope_t trace_scope("vdbEndBreak");
+
+    if (recorder::capturing)
+    {
+        recorder::EndFrame();
+        if (history::Enabled())
+            history::Push(&recorder::frame);
+    }
+    if (history::swallowing)
+        history::EndFrame();
+
+    if (remote::connected && watch::recording)
+    {
+        remote::EndBreak();
+        return;
+    }
+
     frame_settings_t *fs = vdb::frame_settings;
 
     if (render_scaler::has_begun)
+    {
+        trace::Begin("Render scale composite");
         render_scaler::End();
+        trace::End();
+    }
 
     immediate::DefaultState();
 
+    trace::Begin("Grid");
     {
         bool background_is_bright = false;
         if (immediate::clear_color_was_set)
@@ -575,7 +707,24 @@ void vdbEndBreak()
         }
     }
 
+    trace::End();
+
+    if (poster::active)
+        poster::EndTile();
+
+    trace::Begin("Widgets");
     widgets::EndFrame();
+    trace::End();
+
+    if (headless::active)
+    {
+        ImGui::Render();
+        headless::EndFrame();
+        gpu_timer::EndFrame();
+        frame_stats::EndFrame();
+        CheckGLError();
+        return;
+    }
 
     if (framegrab::active)
     {
@@ -596,44 +745,63 @@ void vdbEndBreak()
 
         if (opt.draw_imgui)
         {
+            trace::Begin("ImGui render");
             ImGui::Render();
+            int timer = gpu_timer::Begin(GPU_TIMER_IMGUI);
             ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+            gpu_timer::End(timer);
+            trace::End();
         }
 
-        GLenum format = opt.alpha_channel ? GL_RGBA : GL_RGB;
-        int channels = opt.alpha_channel ? 4 : 3;
-        int width = window::framebuffer_width;
-        int height = window::framebuffer_height;
-        unsigned char *data = (unsigned char*)malloc(width*height*channels);
-        glPixelStorei(GL_PACK_ALIGNMENT, 1);
-        glReadBuffer(GL_BACK);
-        glReadPixels(0, 0, width, height, format, GL_UNSIGNED_BYTE, data);
+        trace::Begin("Framegrab readback");
+        framegrab::CaptureFrame(window::framebuffer_width, window::framebuffer_height);
+        trace::End();
 
         if (!opt.draw_imgui)
         {
+            trace::Begin("ImGui render");
             ImGui::Render();
+            int timer = gpu_timer::Begin(GPU_TIMER_IMGUI);
             ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+            gpu_timer::End(timer);
+            trace::End();
         }
 
-        framegrab::SaveFrame(data, width, height, channels, format);
-
-        free(data);
-
         window::DontWaitNextFrameEvents();
     }
     else
     {
+        trace::Begin("ImGui render");
         ui::MainMenuBar(vdb::frame_settings);
         ui::ShowLogWindows();
+        profiler::Window();
+        frame_stats::Overlay();
+        history::Timeline();
         ui::WindowSizeDialog();
         ui::FramegrabDialog();
         ui::ExitDialog();
         ui::RulerEndFrame();
         ui::SketchEndFrame();
         ImGui::Render();
+        int timer = gpu_timer::Begin(GPU_TIMER_IMGUI);
         ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+        gpu_timer::End(timer);
+        trace::End();
     }
 
-    window::SwapBuffers(1.0f/60.0f);
+    // Decide which events may wake vdb without changing the image (see frame_cache.h)
+    window::redraw_on_mouse_motion =
+        mouse::position_used ||
+        mouse::left.down || mouse::right.down || mouse::middle.down ||
+        ImGui::GetIO().WantCaptureMouse ||
+        ui::ruler_mode_active || ui::sketch_mode_active;
+    if (settings.can_idle && !ui::auto_step && window::WillWaitForEvents())
+        frame_cache::Store();
+
+    gpu_timer::EndFrame();
+    frame_stats::EndFrame();
+    trace::Begin("Swap");
+    window::SwapBuffers(settings.frame_rate_cap);
+    trace::End();
     CheckGLError();
 }
@@ -0,0 +1,200 @@
+// The .vdbcap container stores raw frames from framegrab's "Raw" capture mode.
+// It is designed to be written as fast as possible: the file is preallocated and
+// memory-mapped by vdb, and encoder threads copy (or LZ4-compress) each frame
+// straight into it. Use tools/vdbcap to convert a capture to images or video.
+//
+// Layout (all values little-endian):
+//
+//     vdbcap_header_t
+//     vdbcap_frame_t index[max_frames]
+//     frame data...
+//
+// Frames are stored in the order they finished encoding, so always go through the
+// index to read them in order. Frames that were dropped have size 0. Pixels are
+// 8-bit RGB or RGBA with rows from bottom to top, as returned by glReadPixels.
+//
+// This header has no dependencies on the rest of vdb so that tools can include it.
+
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+
+#define VDBCAP_MAGIC "VDBCAP1"
+#define VDBCAP_VERSION 1
+
+enum vdbcap_compression_
+{
+    VDBCAP_UNCOMPRESSED = 0,
+    VDBCAP_LZ4 = 1, // LZ4 block format (no frame header)
+};
+
+struct vdbcap_header_t
+{
+    char magic[8]; // VDBCAP_MAGIC
+    uint32_t version; // VDBCAP_VERSION
+    uint32_t width;
+    uint32_t height;
+    uint32_t channels; // 3 (RGB) or 4 (RGBA)
+    uint32_t max_frames; // number of entries in the index
+    uint32_t num_frames; // number of entries in use (including dropped frames)
+    uint64_t data_offset; // start of frame data (= end of index)
+    uint64_t data_end; // end of the last frame (the file is truncated to this size when closed)
+};
+
+struct vdbcap_frame_t
+{
+    uint64_t offset; // from start of file
+    uint32_t size; // bytes stored in the file (0 if the frame was dropped)
+    uint32_t compression; // VDBCAP_UNCOMPRESSED or VDBCAP_LZ4
+    double time; // seconds since recording started
+};
+
+// Minimal encoder and decoder for the LZ4 block format
+// (https://github.com/lz4/lz4/blob/dev/doc/lz4_Block_format.md). The encoder is a
+// greedy single-probe compressor: much simpler than the reference implementation and
+// a bit slower, but framegrab runs it on several threads.
+namespace lz4
+{
+    enum { HASH_BITS = 16, MIN_MATCH = 4, LAST_LITERALS = 5, MF_LIMIT = 12, MAX_OFFSET = 65535 };
+
+    static inline int CompressBound(int size)
+    {
+        return size + size/255 + 16;
+    }
+
+    static inline uint32_t Read32(const unsigned char *p)
+    {
+        uint32_t x;
+        memcpy(&x, p, 4);
+        return x;
+    }
+
+    static inline unsigned char *PutLength(unsigned char *op, int length)
+    {
+        while (length >= 255)
+        {
+            *op++ = 255;
+            length -= 255;
+        }
+        *op++ = (unsigned char)length;
+        return op;
+    }
+
+    static inline unsigned char *PutSequence(unsigned char *op, const unsigned char *literals, int num_literals, int match_length, int offset)
+    // match_length = 0 for the last sequence, which only has literals.
+    {
+        unsigned char *token = op++;
+        *token = (unsigned char)((num_literals >= 15 ? 15 : num_literals) << 4);
+        if (num_literals >= 15)
+            op = PutLength(op, num_literals - 15);
+        memcpy(op, literals, num_literals);
+        op += num_literals;
+        if (match_length > 0)
+        {
+            *op++ = (unsigned char)(offset & 0xff);
+            *op++ = (unsigned char)(offset >> 8);
+            int m = match_length - MIN_MATCH;
+            *token |= (unsigned char)(m >= 15 ? 15 : m);
+            if (m >= 15)
+                op = PutLength(op, m - 15);
+        }
+        return op;
+    }
+
+    // Returns the compressed size. dst must hold CompressBound(size) bytes.
+    static inline int Compress(const unsigned char *src, int size, unsigned char *dst)
+    {
+        unsigned char *op = dst;
+        int anchor = 0;
+        if (size > MF_LIMIT)
+        {
+            int *table = (int*)malloc(sizeof(int) << HASH_BITS);
+            if (!table)
+                return 0;
+            for (int i = 0; i < (1 << HASH_BITS); i++)
+                table[i] = -1;
+
+            int limit = size - MF_LIMIT; // last match must start before this
+            int match_limit = size - LAST_LITERALS; // and end before this
+            int i = 0;
+            while (i < limit)
+            {
+                uint32_t sequence = Read32(src + i);
+                uint32_t h = (sequence*2654435761u) >> (32 - HASH_BITS);
+                int candidate = table[h];
+                table[h] = i;
+                if (candidate < 0 || i - candidate > MAX_OFFSET || Read32(src + candidate) != sequence)
+                {
+                    // step faster through data that doesn't compress
+                    i += 1 + ((i - anchor) >> 6);
+                    continue;
+                }
+                int length = MIN_MATCH;
+                while (i + length < match_limit && src[candidate + length] == src[i + length])
+                    length++;
+                op = PutSequence(op, src + anchor, i - anchor, length, i - candidate);
+                i += length;
+                anchor = i;
+            }
+            free(table);
+        }
+        op = PutSequence(op, src + anchor, size - anchor, 0, 0);
+        return (int)(op - dst);
+    }
+
+    // Returns the decompressed size, or -1 if the input is malformed or doesn't fit in dst.
+    static inline int Decompress(const unsigned char *src, int size, unsigned char *dst, int capacity)
+    {
+        const unsigned char *ip = src;
+        const unsigned char *ip_end = src + size;
+        unsigned char *op = dst;
+        unsigned char *op_end = dst + capacity;
+        while (ip < ip_end)
+        {
+            int token = *ip++;
+            int num_literals = token >> 4;
+            if (num_literals == 15)
+            {
+                int b;
+                do
+                {
+                    if (ip >= ip_end) return -1;
+                    b = *ip++;
+                    num_literals += b;
+                } while (b == 255);
+            }
+            if (num_literals > ip_end - ip || num_literals > op_end - op)
+                return -1;
+            memcpy(op, ip, num_literals);
+            ip += num_literals;
+            op += num_literals;
+            if (ip == ip_end)
+                break; // last sequence has no match
+
+            if (ip_end - ip < 2) return -1;
+            int offset = ip[0] | (ip[1] << 8);
+            ip += 2;
+            if (offset == 0 || offset > op - dst)
+                return -1;
+            int match_length = (token & 15);
+            if (match_length == 15)
+            {
+                int b;
+                do
+                {
+                    if (ip >= ip_end) return -1;
+                    b = *ip++;
+                    match_length += b;
+                } while (b == 255);
+            }
+            match_length += MIN_MATCH;
+            if (match_length > op_end - op)
+                return -1;
+            const unsigned char *match = op - offset;
+            for (int i = 0; i < match_length; i++) // may overlap, so copy bytewise
+                op[i] = match[i];
+            op += match_length;
+        }
+        return (int)(op - dst);
+    }
+}
@@ -0,0 +1,85 @@
+// The .vdblog format stores the log tree (see log.h) in binary, with the values of
+// each log as contiguous arrays of floats, so that large logs can be written quickly
+// and read back without parsing (see vdbLogStreamToFile, vdbLogDump and vdbLogLoad).
+// It is written sequentially while the program runs and is usable up to the last
+// complete record if the program stops early.
+//
+// Layout (all values little-endian, all records 8-byte aligned):
+//
+//     vdblog_header_t
+//     records...
+//     vdblog_footer_t (only if the file was closed)
+//
+// Each record is a vdblog_record_t followed by 'size' bytes:
+//
+//     VDBLOG_NODE:  vdblog_node_t, then char label[label_length], zero padded
+//     VDBLOG_BLOCK: vdblog_block_t, then float values[count], zero padded
+//     VDBLOG_INDEX: vdblog_index_entry_t[], one per block in the file
+//
+// Nodes are written in the order they were created, each after its parent, so that
+// a reader can rebuild the tree with the same order of children. The root has id 0
+// and is not written. A block holds values 'first' through 'first + count - 1' of a
+// scalar or matrix log (matrix values are column-major, rows*columns per matrix).
+// A log that was written while the program ran has one block per flush; a gap
+// between blocks means that older samples were dropped (see VDB_LOG_MAX_SAMPLES).
+//
+// The index and footer are written when the file is closed, so that a reader can
+// find every block of a log without reading the whole file (e.g. after mmap).
+//
+// This header has no dependencies on the rest of vdb so that tools can include it.
+
+#include <stdint.h>
+
+#define VDBLOG_MAGIC "VDBLOG1"
+#define VDBLOG_VERSION 1
+#define VDBLOG_NO_LABEL 0xffffffff
+
+enum vdblog_record_type_
+{
+    VDBLOG_NODE = 1,
+    VDBLOG_BLOCK = 2,
+    VDBLOG_INDEX = 3,
+};
+
+struct vdblog_header_t
+{
+    char magic[8]; // VDBLOG_MAGIC
+    uint32_t version; // VDBLOG_VERSION
+    uint32_t reserved;
+};
+
+struct vdblog_record_t
+{
+    uint32_t type; // VDBLOG_NODE, VDBLOG_BLOCK or VDBLOG_INDEX
+    uint32_t size; // bytes following this header (a multiple of 8)
+};
+
+struct vdblog_node_t
+{
+    uint32_t id;
+    uint32_t parent;
+    uint32_t type; // log_type_group, log_type_scalar or log_type_matrix
+    uint32_t label_length; // or VDBLOG_NO_LABEL for unlabelled groups
+    int32_t rows, columns; // for matrix logs
+};
+
+struct vdblog_block_t
+{
+    uint32_t id;
+    uint32_t count;
+    uint64_t first;
+};
+
+struct vdblog_index_entry_t
+{
+    uint32_t id;
+    uint32_t count;
+    uint64_t first;
+    uint64_t offset; // of values[0], from the start of the file
+};
+
+struct vdblog_footer_t
+{
+    uint64_t index_offset; // of the VDBLOG_INDEX record
+    char magic[8]; // VDBLOG_MAGIC
+};
@@ -0,0 +1,66 @@
+// The .vdbrec container stores what breaks drew, as the command stream recorded by
+// watch.h, so that a long run can be inspected later without running it again (see
+// vdbRecordToFile and vdbPlayRecording, or tools/vdbreplay). It is written
+// sequentially, one break at a time, and is usable up to the last complete record if
+// the program stops early.
+//
+// Layout (all values little-endian):
+//
+//     vdbrec_header_t
+//     records...
+//
+// Each record is a vdbrec_record_t followed by 'size' bytes:
+//
+//     VDBREC_CHUNK: uint64 hash, then a piece of command stream
+//     VDBREC_FRAME: double time, uint32 label_length, char label[label_length],
+//                   then the command stream of one break
+//
+// Large pieces of a frame's command stream (vdbBegin/vdbEnd batches and images) are
+// stored once, as chunks, and frames refer to them with a VDBREC_OP_CHUNK op followed
+// by the uint64 hash of the chunk. A chunk is always written before the first frame
+// that refers to it.
+//
+// This header has no dependencies on the rest of vdb so that tools can include it.
+
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+
+#define VDBREC_MAGIC "VDBREC1"
+#define VDBREC_VERSION 1
+
+enum { VDBREC_OP_CHUNK = 0xff };
+
+enum vdbrec_record_type_
+{
+    VDBREC_FRAME = 1,
+    VDBREC_CHUNK = 2,
+};
+
+struct vdbrec_header_t
+{
+    char magic[8]; // VDBREC_MAGIC
+    uint32_t version; // VDBREC_VERSION
+    uint32_t reserved;
+};
+
+struct vdbrec_record_t
+{
+    uint32_t type; // VDBREC_FRAME or VDBREC_CHUNK
+    uint32_t size; // bytes following this header
+};
+
+namespace vdbrec
+{
+    // 64-bit FNV-1a. Never returns 0, so that 0 can mark empty hash table entries.
+    static inline uint64_t Hash(const unsigned char *data, size_t size)
+    {
+        uint64_t h = 14695981039346656037ull;
+        for (size_t i = 0; i < size; i++)
+        {
+            h ^= data[i];
+            h *= 1099511628211ull;
+        }
+        return h ? h : 1;
+    }
+}
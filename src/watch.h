@@ -0,0 +1,486 @@
+// In watch mode (see vdbWatch), breaks don't block the calling thread. Instead,
+// vdbBeginBreak returns true once, the drawing calls made inside the block are
+// recorded into a snapshot, and vdbEndBreak hands the snapshot to a render thread
+// that owns the window and the OpenGL context. The render thread runs the usual
+// vdb loop and replays the latest completed snapshot every frame, so the calling
+// thread only pays for recording.
+//
+// Snapshots are triple-buffered: the calling thread records into one buffer, the
+// render thread replays another, and the third holds the newest completed snapshot
+// until the render thread picks it up. Snapshots completed in between are dropped.
+//
+// Only calls that don't need the render thread's state are recorded: immediate
+// mode drawing (including lists and notes), images, render state, the matrix stack,
+// viewports and widgets. Other vdb functions (shaders, render targets, ImGui) must
+// not be called inside a watched block. Widgets return the value that the render
+// thread last saw, and vdbButton returns true once for every click. Queries, like the mouse position or
+// vdbGetMatrix, return what the render thread last saw. vdbIsFirstFrame is always
+// true, since the render thread may skip the snapshot that built a list. Images are
+// uploaded again every time a snapshot is replayed, so keep them small.
+//
+// The calling thread never touches vdb's other global state: vdbBeginBreak and
+// vdbEndBreak return before the log merge, the log file and the trace, which only run
+// on the render thread. The calling thread doesn't own the logs, so its vdbLog* calls
+// go into its log_threads.h buffer and are merged into the log tree by the render
+// thread at its next break, like logs from any other thread. Call vdbWatch,
+// vdbLogStreamToFile and vdbTraceToFile before the first watched break.
+//
+// The same command stream is used to record breaks to a file (see recorder.h). The
+// recorder sets 'passthrough', so that the recorded calls also run as usual.
+//
+// Closing the window stops the render thread; the watched blocks are then skipped.
+// Note that some platforms (e.g. macOS) only allow windows on the main thread.
+enum watch_op_
+{
+    WATCH_BEGIN_LINES = 1,
+    WATCH_BEGIN_POINTS,
+    WATCH_BEGIN_TRIANGLES,
+    WATCH_END,
+    WATCH_BEGIN_LIST,       // int slot
+    WATCH_DRAW_LIST,        // int slot
+    WATCH_VERTEX,           // float x,y,z,w
+    WATCH_COLOR,            // unsigned char r,g,b,a
+    WATCH_TEXEL,            // float u,v
+    WATCH_LINE_WIDTH,       // float width, int is_3D
+    WATCH_POINT_SIZE,       // float size, int is_3D
+    WATCH_POINT_SEGMENTS,   // int segments
+    WATCH_INVERSE_COLOR,    // int enable
+    WATCH_CLEAR_COLOR,      // float r,g,b,a
+    WATCH_CLEAR_DEPTH,      // float d
+    WATCH_CULL_FACE,        // int enable
+    WATCH_BLEND_NONE,
+    WATCH_BLEND_ADD,
+    WATCH_BLEND_ALPHA,
+    WATCH_DEPTH_FUNC_ALWAYS,
+    WATCH_DEPTH_FUNC_LESS,
+    WATCH_DEPTH_FUNC_LEQUAL,
+    WATCH_DEPTH_TEST,       // int enable
+    WATCH_DEPTH_WRITE,      // int enable
+    WATCH_PUSH_MATRIX,
+    WATCH_POP_MATRIX,
+    WATCH_PROJECTION,       // vdbMat4
+    WATCH_LOAD_MATRIX,      // vdbMat4
+    WATCH_MULT_MATRIX,      // vdbMat4
+    WATCH_PERSPECTIVE,      // float yfov, z_near, z_far, x_offset, y_offset
+    WATCH_VIEWPORTI,        // int left, bottom, width, height
+    WATCH_VIEWPORT,         // float left, bottom, width, height
+    WATCH_NOTE,             // float x, y, int length, char text[length]
+    WATCH_LOAD_IMAGE,       // int slot, width, height, channels, is_float, pixels[width*height*channels]
+    WATCH_DRAW_IMAGE,       // int slot, float x, y, w, h, int filter, wrap, vdbVec4 v_min, v_max
+    WATCH_BIND_IMAGE,       // int slot, filter, wrap, vdbVec4 v_min, v_max
+    WATCH_UNBIND_IMAGE,
+    WATCH_SLIDER_FLOAT,     // float vmin, vmax, vinit, int length, char name[length]
+    WATCH_SLIDER_INT,       // -||-
+    WATCH_CHECKBOX,         // -||- (vinit is 0 or 1)
+    WATCH_RADIO_BUTTON,     // -||-
+    WATCH_BUTTON,           // -||-
+};
+
+// Widget values seen by the side that replays the commands, by name.
+struct watch_widget_value_t
+{
+    char name[32];
+    float value; // 0 or 1 for checkboxes, radio buttons and buttons
+    int is_button;
+};
+
+struct watch_snapshot_t
+{
+    unsigned char *data; // sequence of [op:uint8][arguments]
+    size_t used;
+    size_t capacity;
+    const char *label;
+};
+
+void vdbLineWidth3D(float width); // defined in immediate.h (not in the public API)
+
+namespace watch
+{
+    static bool active;
+    static thread_local bool recording; // true on the calling thread inside a watched block
+    static thread_local bool passthrough; // recorded calls also run (used by the recorder)
+    static thread_local watch_snapshot_t *destination; // where recorded calls go
+    static thread_local bool on_render_thread;
+    static bool in_block;
+    static SDL_Thread *thread;
+    static SDL_mutex *mutex;
+    static SDL_atomic_t viewer_closed;
+    static watch_snapshot_t snapshots[3];
+    static int writing = 0; // owned by the calling thread
+    static int latest = 1; // newest completed snapshot (guarded by mutex)
+    static int reading = 2; // owned by the render thread
+    static bool latest_is_new; // (guarded by mutex)
+    enum { MAX_WIDGET_VALUES = 32 };
+    static watch_widget_value_t widget_values[MAX_WIDGET_VALUES]; // (guarded by mutex)
+    static int num_widget_values; // (guarded by mutex)
+
+    static watch_widget_value_t *FindWidgetValue(const char *name, bool add)
+    {
+        for (int i = 0; i < num_widget_values; i++)
+            if (strncmp(widget_values[i].name, name, sizeof(widget_values[i].name) - 1) == 0)
+                return widget_values + i;
+        if (!add || num_widget_values == MAX_WIDGET_VALUES)
+            return NULL;
+        watch_widget_value_t *w = widget_values + (num_widget_values++);
+        strncpy(w->name, name, sizeof(w->name) - 1);
+        w->name[sizeof(w->name) - 1] = '\0';
+        w->value = 0.0f;
+        w->is_button = 0;
+        return w;
+    }
+
+    // Button clicks are kept until the recording side has seen them (see GetWidgetValue).
+    static void SetWidgetValue(const char *name, float value, bool is_button)
+    {
+        if (is_button && value == 0.0f)
+            return;
+        if (mutex) SDL_LockMutex(mutex);
+        watch_widget_value_t *w = FindWidgetValue(name, true);
+        if (w) w->value = value;
+        if (w) w->is_button = is_button ? 1 : 0;
+        if (mutex) SDL_UnlockMutex(mutex);
+    }
+
+    static float GetWidgetValue(const char *name, float vinit, bool is_button)
+    {
+        float value = vinit;
+        if (mutex) SDL_LockMutex(mutex);
+        watch_widget_value_t *w = FindWidgetValue(name, false);
+        if (w)
+        {
+            value = w->value;
+            if (is_button)
+                w->value = 0.0f;
+        }
+        if (mutex) SDL_UnlockMutex(mutex);
+        return value;
+    }
+
+    // Widgets keep a pointer to their name, so replayed names must outlive the snapshot.
+    static const char *InternName(const char *name, int length)
+    {
+        enum { MAX_NAMES = 256 };
+        static char *names[MAX_NAMES];
+        static int num_names;
+        for (int i = 0; i < num_names; i++)
+            if ((int)strlen(names[i]) == length && memcmp(names[i], name, length) == 0)
+                return names[i];
+        char *result = (char*)malloc(length + 1);
+        assert(result);
+        memcpy(result, name, length);
+        result[length] = '\0';
+        if (num_names < MAX_NAMES)
+            names[num_names++] = result;
+        return result;
+    }
+
+    static unsigned char *Reserve(size_t size, watch_snapshot_t *s=NULL)
+    {
+        if (!s)
+            s = destination;
+        if (s->used + size > s->capacity)
+        {
+            size_t capacity = s->capacity ? s->capacity : 64*1024;
+            while (s->used + size > capacity)
+                capacity *= 2;
+            s->data = (unsigned char*)realloc(s->data, capacity);
+            assert(s->data && "Ran out of memory recording watched block");
+            s->capacity = capacity;
+        }
+        unsigned char *result = s->data + s->used;
+        s->used += size;
+        return result;
+    }
+
+    // Returns true if the caller should return without running the call.
+    static bool Record(int op, const void *args=NULL, size_t size=0)
+    {
+        unsigned char *p = Reserve(1 + size);
+        p[0] = (unsigned char)op;
+        if (size > 0)
+            memcpy(p + 1, args, size);
+        return !passthrough;
+    }
+
+    static bool RecordSize(int op, float size, bool is_3D) // line width or point size
+    {
+        unsigned char args[8];
+        int flag = is_3D ? 1 : 0;
+        memcpy(args + 0, &size, 4);
+        memcpy(args + 4, &flag, 4);
+        return Record(op, args, sizeof(args));
+    }
+
+    static bool RecordImage(int slot, const void *data, int width, int height, int channels, bool is_float)
+    {
+        int header[] = { slot, width, height, channels, is_float ? 1 : 0 };
+        size_t size = (size_t)width*height*channels*(is_float ? 4 : 1);
+        Record(WATCH_LOAD_IMAGE, header, sizeof(header));
+        memcpy(Reserve(size), data, size);
+        return !passthrough;
+    }
+
+    // Returns the widget's value, as last seen by the side that replays the commands.
+    static float RecordWidget(int op, const char *name, float vmin, float vmax, float vinit)
+    {
+        int length = (int)strlen(name);
+        unsigned char header[4*4];
+        memcpy(header + 0, &vmin, 4);
+        memcpy(header + 4, &vmax, 4);
+        memcpy(header + 8, &vinit, 4);
+        memcpy(header + 12, &length, 4);
+        Record(op, header, sizeof(header));
+        memcpy(Reserve(length), name, length);
+        return GetWidgetValue(name, vinit, op == WATCH_BUTTON);
+    }
+
+    static bool RecordNote(float x, float y, const char *fmt, va_list args)
+    {
+        char text[1024];
+        int length = vsnprintf(text, sizeof(text), fmt, args);
+        if (length < 0) length = 0;
+        if (length >= (int)sizeof(text)) length = (int)sizeof(text) - 1;
+        unsigned char header[3*4];
+        memcpy(header + 0, &x, 4);
+        memcpy(header + 4, &y, 4);
+        memcpy(header + 8, &length, 4);
+        Record(WATCH_NOTE, header, sizeof(header));
+        memcpy(Reserve(length), text, length);
+        return !passthrough;
+    }
+
+    // Size of the recorded call at p, including the op, or 0 if it doesn't fit before
+    // end or has a negative length or size (as in a corrupt recording).
+    static size_t OpSize(const unsigned char *p, const unsigned char *end)
+    {
+        size_t available = (size_t)(end - p);
+        size_t size = 1;
+        if (available < 1)
+            return 0;
+        switch (p[0])
+        {
+            case WATCH_BEGIN_LIST: case WATCH_DRAW_LIST: case WATCH_POINT_SEGMENTS:
+            case WATCH_INVERSE_COLOR: case WATCH_CLEAR_DEPTH: case WATCH_CULL_FACE:
+            case WATCH_DEPTH_TEST: case WATCH_DEPTH_WRITE: case WATCH_COLOR:
+                size = 1 + 4; break;
+            case WATCH_TEXEL: case WATCH_LINE_WIDTH: case WATCH_POINT_SIZE: size = 1 + 2*4; break;
+            case WATCH_VERTEX: case WATCH_CLEAR_COLOR: case WATCH_VIEWPORTI: case WATCH_VIEWPORT: size = 1 + 4*4; break;
+            case WATCH_PERSPECTIVE: size = 1 + 5*4; break;
+            case WATCH_PROJECTION: case WATCH_LOAD_MATRIX: case WATCH_MULT_MATRIX: size = 1 + sizeof(vdbMat4); break;
+            case WATCH_DRAW_IMAGE: size = 1 + 5*4 + 2*4 + 2*sizeof(vdbVec4); break;
+            case WATCH_BIND_IMAGE: size = 1 + 3*4 + 2*sizeof(vdbVec4); break;
+            case WATCH_NOTE:
+            {
+                int length;
+                if (available < 1 + 3*4)
+                    return 0;
+                memcpy(&length, p + 1 + 2*4, 4);
+                if (length < 0)
+                    return 0;
+                size = 1 + 3*4 + (size_t)length;
+            } break;
+            case WATCH_SLIDER_FLOAT: case WATCH_SLIDER_INT: case WATCH_CHECKBOX:
+            case WATCH_RADIO_BUTTON: case WATCH_BUTTON:
+            {
+                int length;
+                if (available < 1 + 4*4)
+                    return 0;
+                memcpy(&length, p + 1 + 3*4, 4);
+                if (length < 0)
+                    return 0;
+                size = 1 + 4*4 + (size_t)length;
+            } break;
+            case WATCH_LOAD_IMAGE:
+            {
+                int h[5];
+                if (available < 1 + sizeof(h))
+                    return 0;
+                memcpy(h, p + 1, sizeof(h));
+                if (h[1] < 0 || h[2] < 0 || h[3] < 0)
+                    return 0;
+                uint64_t pixels = (uint64_t)h[1]*(uint64_t)h[2]; // can't overflow
+                uint64_t bytes_per_pixel = (uint64_t)h[3]*(h[4] ? 4 : 1);
+                if (bytes_per_pixel > 0 && pixels > (uint64_t)available/bytes_per_pixel)
+                    return 0;
+                size = 1 + sizeof(h) + (size_t)(pixels*bytes_per_pixel);
+            } break;
+        }
+        return size <= available ? size : 0;
+    }
+
+    static void Replay(watch_snapshot_t *s)
+    {
+        #define READ(x) { memcpy(&(x), p, sizeof(x)); p += sizeof(x); }
+        const unsigned char *p = s->data;
+        const unsigned char *end = s->data + s->used;
+        while (p < end)
+        {
+            int op = *p++;
+            switch (op)
+            {
+                case WATCH_BEGIN_LINES:       vdbBeginLines(); break;
+                case WATCH_BEGIN_POINTS:      vdbBeginPoints(); break;
+                case WATCH_BEGIN_TRIANGLES:   vdbBeginTriangles(); break;
+                case WATCH_END:               vdbEnd(); break;
+                case WATCH_BEGIN_LIST:        { int slot; READ(slot); vdbBeginList(slot); } break;
+                case WATCH_DRAW_LIST:         { int slot; READ(slot); vdbDrawList(slot); } break;
+                case WATCH_VERTEX:            { float v[4]; READ(v); vdbVertex(v[0], v[1], v[2], v[3]); } break;
+                case WATCH_COLOR:             { unsigned char c[4]; READ(c); vdbColor4ub(c[0], c[1], c[2], c[3]); } break;
+                case WATCH_TEXEL:             { float t[2]; READ(t); vdbTexel(t[0], t[1]); } break;
+                case WATCH_LINE_WIDTH:        { float w; int is_3D; READ(w); READ(is_3D); if (is_3D) vdbLineWidth3D(w); else vdbLineWidth(w); } break;
+                case WATCH_POINT_SIZE:        { float s; int is_3D; READ(s); READ(is_3D); if (is_3D) vdbPointSize3D(s); else vdbPointSize(s); } break;
+                case WATCH_POINT_SEGMENTS:    { int n; READ(n); vdbPointSegments(n); } break;
+                case WATCH_INVERSE_COLOR:     { int e; READ(e); vdbInverseColor(e != 0); } break;
+                case WATCH_CLEAR_COLOR:       { float c[4]; READ(c); vdbClearColor(c[0], c[1], c[2], c[3]); } break;
+                case WATCH_CLEAR_DEPTH:       { float d; READ(d); vdbClearDepth(d); } break;
+                case WATCH_CULL_FACE:         { int e; READ(e); vdbCullFace(e != 0); } break;
+                case WATCH_BLEND_NONE:        vdbBlendNone(); break;
+                case WATCH_BLEND_ADD:         vdbBlendAdd(); break;
+                case WATCH_BLEND_ALPHA:       vdbBlendAlpha(); break;
+                case WATCH_DEPTH_FUNC_ALWAYS: vdbDepthFuncAlways(); break;
+                case WATCH_DEPTH_FUNC_LESS:   vdbDepthFuncLess(); break;
+                case WATCH_DEPTH_FUNC_LEQUAL: vdbDepthFuncLessOrEqual(); break;
+                case WATCH_DEPTH_TEST:        { int e; READ(e); vdbDepthTest(e != 0); } break;
+                case WATCH_DEPTH_WRITE:       { int e; READ(e); vdbDepthWrite(e != 0); } break;
+                case WATCH_PUSH_MATRIX:       vdbPushMatrix(); break;
+                case WATCH_POP_MATRIX:        vdbPopMatrix(); break;
+                case WATCH_PROJECTION:        { vdbMat4 m; READ(m); vdbProjection(m.data); } break;
+                case WATCH_LOAD_MATRIX:       { vdbMat4 m; READ(m); vdbLoadMatrix(m.data); } break;
+                case WATCH_MULT_MATRIX:       { vdbMat4 m; READ(m); vdbMultMatrix(m.data); } break;
+                case WATCH_PERSPECTIVE:       { float a[5]; READ(a); vdbPerspective(a[0], a[1], a[2], a[3], a[4]); } break;
+                case WATCH_VIEWPORTI:         { int v[4]; READ(v); vdbViewporti(v[0], v[1], v[2], v[3]); } break;
+                case WATCH_VIEWPORT:          { float v[4]; READ(v); vdbViewport(v[0], v[1], v[2], v[3]); } break;
+                case WATCH_NOTE:
+                {
+                    float x,y; int length;
+                    READ(x); READ(y); READ(length);
+                    vdbNote(x, y, "%.*s", length, (const char*)p);
+                    p += length;
+                } break;
+                case WATCH_LOAD_IMAGE:
+                {
+                    int slot,width,height,channels,is_float;
+                    READ(slot); READ(width); READ(height); READ(channels); READ(is_float);
+                    if (is_float) vdbLoadImageFloat32(slot, p, width, height, channels);
+                    else          vdbLoadImageUint8(slot, p, width, height, channels);
+                    p += (size_t)width*height*channels*(is_float ? 4 : 1);
+                } break;
+                case WATCH_DRAW_IMAGE:
+                {
+                    int slot,filter,wrap; float r[4]; vdbVec4 v_min,v_max;
+                    READ(slot); READ(r); READ(filter); READ(wrap); READ(v_min); READ(v_max);
+                    vdbDrawImage(slot, r[0], r[1], r[2], r[3], filter, wrap, v_min, v_max);
+                } break;
+                case WATCH_BIND_IMAGE:
+                {
+                    int slot,filter,wrap; vdbVec4 v_min,v_max;
+                    READ(slot); READ(filter); READ(wrap); READ(v_min); READ(v_max);
+                    vdbBindImage(slot, filter, wrap, v_min, v_max);
+                } break;
+                case WATCH_UNBIND_IMAGE: vdbUnbindImage(); break;
+                case WATCH_SLIDER_FLOAT: case WATCH_SLIDER_INT: case WATCH_CHECKBOX:
+                case WATCH_RADIO_BUTTON: case WATCH_BUTTON:
+                {
+                    float vmin,vmax,vinit; int length;
+                    READ(vmin); READ(vmax); READ(vinit); READ(length);
+                    const char *name = InternName((const char*)p, length);
+                    p += length;
+                    float value = 0.0f;
+                    if      (op == WATCH_SLIDER_FLOAT) value = vdbSliderFloat(name, vmin, vmax, vinit);
+                    else if (op == WATCH_SLIDER_INT)   value = (float)vdbSliderInt(name, (int)vmin, (int)vmax, (int)vinit);
+                    else if (op == WATCH_CHECKBOX)     value = vdbCheckbox(name, vinit != 0.0f) ? 1.0f : 0.0f;
+                    else if (op == WATCH_RADIO_BUTTON) value = vdbRadioButton(name) ? 1.0f : 0.0f;
+                    else if (op == WATCH_BUTTON)       value = vdbButton(name) ? 1.0f : 0.0f;
+                    SetWidgetValue(name, value, op == WATCH_BUTTON);
+                } break;
+                default: assert(false && "Corrupt watch snapshot"); return;
+            }
+        }
+        #undef READ
+    }
+
+    static int RenderThread(void *)
+    {
+        on_render_thread = true;
+        const char *label = NULL;
+        while (!SDL_AtomicGet(&viewer_closed))
+        {
+            if (!label)
+            {
+                // wait for the first snapshot, so that the window gets its label's settings
+                SDL_LockMutex(mutex);
+                label = latest_is_new ? snapshots[latest].label : NULL;
+                SDL_UnlockMutex(mutex);
+                if (!label)
+                {
+                    SDL_Delay(1);
+                    continue;
+                }
+            }
+            if (vdbBeginBreak(label))
+            {
+                SDL_LockMutex(mutex);
+                if (latest_is_new)
+                {
+                    int temp = reading;
+                    reading = latest;
+                    latest = temp;
+                    latest_is_new = false;
+                }
+                SDL_UnlockMutex(mutex);
+                Replay(snapshots + reading);
+                label = snapshots[reading].label;
+                vdbEndBreak();
+            }
+        }
+        return 0;
+    }
+
+    // Called instead of the usual vdbBeginBreak on the calling thread.
+    static bool BeginBreak(const char *label)
+    {
+        if (in_block)
+        {
+            in_block = false; // the block has run once, let the user's loop continue
+            return false;
+        }
+        if (SDL_AtomicGet(&viewer_closed))
+            return false;
+        if (!thread)
+        {
+            mutex = SDL_CreateMutex();
+            assert(mutex);
+            thread = SDL_CreateThread(RenderThread, "vdb render thread", NULL);
+            assert(thread);
+            SDL_DetachThread(thread);
+        }
+        snapshots[writing].used = 0;
+        snapshots[writing].label = label;
+        in_block = true;
+        recording = true;
+        passthrough = false;
+        destination = snapshots + writing;
+        return true;
+    }
+
+    static void EndBreak()
+    {
+        recording = false;
+        SDL_LockMutex(mutex);
+        int temp = latest;
+        latest = writing;
+        writing = temp;
+        latest_is_new = true;
+        SDL_UnlockMutex(mutex);
+
+        // wake up the render thread if it's waiting for events
+        SDL_Event event = {0};
+        event.type = SDL_USEREVENT;
+        SDL_PushEvent(&event);
+    }
+}
+
+void vdbWatch(bool enabled)
+{
+    watch::active = enabled;
+}
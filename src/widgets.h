@@ -79,6 +79,7 @@ namespace widgets
 
 float vdbSliderFloat(const char *name, float vmin, float vmax, float vinit)
 {
+    if (watch::recording && !watch::passthrough && !history::swallowing) return watch::RecordWidget(WATCH_SLIDER_FLOAT, name, vmin, vmax, vinit);
     using namespace widgets;
     widget_t *var = vars + (var_index++);
     if (vdbIsFirstFrame() && vdbIsDifferentLabel()) // todo: better way to preserve variables for same-label windows
@@ -93,6 +94,7 @@ float vdbSliderFloat(const char *name, float vmin, float vmax, float vinit)
 }
 int vdbSliderInt(const char *name, int vmin, int vmax, int vinit)
 {
+    if (watch::recording && !watch::passthrough && !history::swallowing) return (int)watch::RecordWidget(WATCH_SLIDER_INT, name, (float)vmin, (float)vmax, (float)vinit);
     using namespace widgets;
     widget_t *var = vars + (var_index++);
     if (vdbIsFirstFrame() & vdbIsDifferentLabel())
@@ -107,6 +109,7 @@ int vdbSliderInt(const char *name, int vmin, int vmax, int vinit)
 }
 bool vdbCheckbox(const char *name, bool init)
 {
+    if (watch::recording && !watch::passthrough && !history::swallowing) return watch::RecordWidget(WATCH_CHECKBOX, name, 0.0f, 1.0f, init ? 1.0f : 0.0f) != 0.0f;
     using namespace widgets;
     widget_t *var = vars + (var_index++);
     if (vdbIsFirstFrame() & vdbIsDifferentLabel())
@@ -119,6 +122,7 @@ bool vdbCheckbox(const char *name, bool init)
 }
 bool vdbRadioButton(const char *name)
 {
+    if (watch::recording && !watch::passthrough && !history::swallowing) return watch::RecordWidget(WATCH_RADIO_BUTTON, name, 0.0f, 1.0f, 0.0f) != 0.0f;
     using namespace widgets;
     widget_t *var = vars + (var_index++);
     if (vdbIsFirstFrame() & vdbIsDifferentLabel())
@@ -131,6 +135,7 @@ bool vdbRadioButton(const char *name)
 }
 bool vdbButton(const char *name)
 {
+    if (watch::recording && !watch::passthrough && !history::swallowing) return watch::RecordWidget(WATCH_BUTTON, name, 0.0f, 1.0f, 0.0f) != 0.0f;
     using namespace widgets;
     widget_t *var = vars + (var_index++);
     if (vdbIsFirstFrame() & vdbIsDifferentLabel())
@@ -23,6 +23,7 @@ void PostGLCallback(const char *name, void *funcptr, int len_args, ...) {
 namespace window
 {
     static bool vsynced;
+    static bool headless; // no visible window (see headless.h)
     static SDL_Window *sdl_window;
     static SDL_GLContext sdl_gl_context;
 
@@ -41,6 +42,15 @@ namespace window
 
     static bool dont_wait_next_frame_events;
 
+    // Frame clock (see vdbGetFrameDelta and vdbGetTime)
+    static Uint64 clock_start;
+    static Uint64 clock_frame; // when the current frame started
+    static Uint64 clock_last_swap;
+    static float frame_delta = 1.0f/60.0f;
+
+    static bool input_changed; // an event since BeforeEvents could change what vdb draws
+    static bool redraw_on_mouse_motion = true; // set by vdb at the end of each frame
+
     static void DetachGLContext()
     {
         assert(sdl_window);
@@ -94,13 +104,35 @@ namespace window
         #endif
     }
 
+    static void SetVSync(bool enabled)
+    {
+        SDL_GL_SetSwapInterval(enabled ? 1 : 0);
+        vsynced = enabled && (SDL_GL_GetSwapInterval() == 1);
+    }
+
     static void Open(int x, int y, int width, int height)
     {
         #ifdef _WIN32
         SetProcessDpiAwareness(PROCESS_PER_MONITOR_DPI_AWARE);
         #endif
 
-        if (SDL_Init(SDL_INIT_EVERYTHING) != 0)
+        Uint32 subsystems = SDL_INIT_EVERYTHING;
+        if (headless)
+        {
+            // Machines without a display may not have audio or input devices either.
+            // The offscreen driver needs SDL 2.0.12 or newer; if it's unavailable we
+            // retry with the default driver (unless the user chose one with SDL_VIDEODRIVER).
+            subsystems = SDL_INIT_VIDEO|SDL_INIT_TIMER|SDL_INIT_EVENTS;
+            SDL_setenv("SDL_VIDEODRIVER", "offscreen", 0);
+            if (SDL_Init(subsystems) != 0)
+            {
+                printf("SDL offscreen video driver is not available (%s), using a hidden window\n", SDL_GetError());
+                SDL_Quit();
+                SDL_setenv("SDL_VIDEODRIVER", "", 1);
+            }
+        }
+
+        if (!SDL_WasInit(SDL_INIT_VIDEO) && SDL_Init(subsystems) != 0)
         {
             printf("SDL_Init failed: %s\n", SDL_GetError());
             assert(false);
@@ -132,6 +164,7 @@ namespace window
             (y < 0) ? SDL_WINDOWPOS_CENTERED : y,
             width,
             height,
+            headless ? (SDL_WINDOW_OPENGL | SDL_WINDOW_HIDDEN) :
             SDL_WINDOW_OPENGL | SDL_WINDOW_RESIZABLE | SDL_WINDOW_HIDDEN | SDL_WINDOW_ALLOW_HIGHDPI);
 
         assert(sdl_window);
@@ -151,7 +184,8 @@ namespace window
                 SDL_SetWindowIcon(sdl_window, icon);
         }
 
-        SDL_ShowWindow(sdl_window);
+        if (!headless)
+            SDL_ShowWindow(sdl_window);
 
         SDL_GL_LoadLibrary(NULL); // GLAD will do the loading for us after creating context
         sdl_gl_context = SDL_GL_CreateContext(sdl_window);
@@ -163,23 +197,78 @@ namespace window
         glad_set_post_callback(PostGLCallback);
         #endif
 
-        SDL_GL_SetSwapInterval(1);
-        vsynced = (SDL_GL_GetSwapInterval() == 1);
+        SetVSync(!headless && settings.vsync);
+    }
+
+    // Call once at the start of each rendered frame.
+    static void NewFrameClock()
+    {
+        Uint64 now = SDL_GetPerformanceCounter();
+        if (!clock_start)
+        {
+            clock_start = now;
+        }
+        else
+        {
+            // clamped so that e.g. keyboard movement doesn't jump after vdb has been idle
+            double dt = (double)(now - clock_frame)/SDL_GetPerformanceFrequency();
+            frame_delta = (float)(dt < 0.1 ? dt : 0.1);
+        }
+        clock_frame = now;
+    }
+
+    static double GetTime()
+    {
+        return (double)(clock_frame - clock_start)/SDL_GetPerformanceFrequency();
     }
 
-    static void SwapBuffers(float dt)
+    // frame_rate_cap: maximum frames per second, 0 to use the display's refresh
+    // rate when vsync is off or unavailable, or -1 for no limit.
+    static void SwapBuffers(int frame_rate_cap)
     {
         SDL_GL_SwapWindow(sdl_window);
-        if (!vsynced && dt < 1.0f/60.0f)
+
+        int fps = frame_rate_cap;
+        if (fps == 0 && !vsynced)
         {
-            float sleep_s = (1.0f/60.0f) - dt;
-            Uint32 sleep_ms = (Uint32)(sleep_s*1000.0f);
-            SDL_Delay(sleep_ms);
+            SDL_DisplayMode mode;
+            if (SDL_GetWindowDisplayMode(sdl_window, &mode) == 0 && mode.refresh_rate > 0)
+                fps = mode.refresh_rate;
+            else
+                fps = 60;
         }
+
+        Uint64 now = SDL_GetPerformanceCounter();
+        if (fps > 0 && clock_last_swap)
+        {
+            Uint64 frequency = SDL_GetPerformanceFrequency();
+            Uint64 deadline = clock_last_swap + frequency/fps;
+            if (now < deadline)
+            {
+                // SDL_Delay may oversleep by a millisecond or so. That jitter is accepted,
+                // except for high caps without vsync, where it is a large part of a frame
+                // and the last millisecond is spent spinning instead.
+                bool spin = !vsynced && fps > 120;
+                Uint64 spin_ticks = spin ? frequency/1000 : 0;
+                double remaining_ms = 1000.0*(double)(deadline - now)/frequency;
+                if (remaining_ms > 2.0)
+                    SDL_Delay((Uint32)(remaining_ms - 1.0));
+                now = SDL_GetPerformanceCounter();
+                while (now + spin_ticks < deadline)
+                {
+                    SDL_Delay(1);
+                    now = SDL_GetPerformanceCounter();
+                }
+                while (now < deadline)
+                    now = SDL_GetPerformanceCounter();
+            }
+        }
+        clock_last_swap = now;
     }
 
     static void BeforeEvents()
     {
+        input_changed = false;
         mouse::wheel = 0.0f;
         for (int i = 0; i < SDL_NUM_SCANCODES; i++)
         {
@@ -207,9 +296,51 @@ namespace window
         settings.window.y = window_y;
     }
 
+    // Whether (x,y) is over an ImGui window that was drawn in the last frame, including
+    // its resize borders. ImGui only updates its hovered window (and WantCaptureMouse)
+    // in NewFrame, so this is what tells that the mouse has just moved onto a window.
+    static bool IsOverImGuiWindow(int x, int y)
+    {
+        ImGuiContext &g = *GImGui;
+        ImVec2 p((float)x, (float)y);
+        for (int i = 0; i < g.Windows.Size; i++)
+        {
+            ImGuiWindow *w = g.Windows[i];
+            if (!w->Active || w->Hidden || (w->Flags & ImGuiWindowFlags_NoMouseInputs))
+                continue;
+            ImRect r = w->OuterRectClipped;
+            r.Expand(4.0f);
+            if (r.Contains(p))
+                return true;
+        }
+        return false;
+    }
+
+    // Events that can't change what vdb draws. Mouse motion only counts if the last
+    // frame didn't depend on the mouse position (see redraw_on_mouse_motion), or if the
+    // mouse moved onto an ImGui window, which highlights what is under it.
+    static bool IsPassiveEvent(const SDL_Event *event)
+    {
+        if (event->type == SDL_MOUSEMOTION)
+            return !redraw_on_mouse_motion && !IsOverImGuiWindow(event->motion.x, event->motion.y);
+        if (event->type == SDL_WINDOWEVENT)
+        {
+            Uint8 e = event->window.event;
+            if (e == SDL_WINDOWEVENT_ENTER || e == SDL_WINDOWEVENT_LEAVE)
+                return !redraw_on_mouse_motion;
+            return e == SDL_WINDOWEVENT_SHOWN || e == SDL_WINDOWEVENT_EXPOSED || e == SDL_WINDOWEVENT_MOVED;
+        }
+        return event->type == SDL_CLIPBOARDUPDATE ||
+               event->type == SDL_KEYMAPCHANGED ||
+               event->type == SDL_AUDIODEVICEADDED ||
+               event->type == SDL_AUDIODEVICEREMOVED;
+    }
+
     static void ProcessEvent(const SDL_Event *event)
     {
         ImGui_ImplSDL2_ProcessEvent(event);
+        if (!IsPassiveEvent(event))
+            input_changed = true;
         if (event->type == SDL_QUIT)
         {
             should_quit = true;
@@ -278,9 +409,16 @@ namespace window
             settle_frames = frames;
     }
 
+    static int idle_frames = 0; // frames rendered since the last event (while waiting for events)
+
+    // True if the next call to WaitEvents will block (unless settle frames are added).
+    static bool WillWaitForEvents()
+    {
+        return !dont_wait_next_frame_events && idle_frames >= settle_frames;
+    }
+
     static void WaitEvents()
     {
-        static int idle_frames = 0;
         if (dont_wait_next_frame_events || idle_frames < settle_frames)
         {
             idle_frames++;
@@ -289,11 +427,10 @@ namespace window
             BeforeEvents();
             SDL_Event event;
             while (SDL_PollEvent(&event))
-            {
                 ProcessEvent(&event);
-                idle_frames = 0;
-            }
             AfterEvents();
+            if (input_changed)
+                idle_frames = 0;
         }
         else
         {
@@ -305,7 +442,45 @@ namespace window
                 ProcessEvent(&event);
             } while (SDL_PollEvent(&event));
             AfterEvents();
-            idle_frames = 0;
+            if (input_changed)
+                idle_frames = 0;
+        }
+    }
+}
+
+// Timer queries (GL 3.3 or GL_ARB_timer_query), used by dynamic resolution (see
+// render_scaler.h) and GPU timing (see gpu_timer.h). The GL 3.1 loader doesn't have
+// the timestamp functions, so they are loaded here the first time Supported is called.
+#ifndef GL_TIME_ELAPSED
+#define GL_TIME_ELAPSED 0x88BF
+#endif
+#ifndef GL_TIMESTAMP
+#define GL_TIMESTAMP 0x8E28
+#endif
+namespace timer_query
+{
+    typedef void (APIENTRYP query_counter_t)(GLuint, GLenum);
+    typedef void (APIENTRYP get_query_object_ui64v_t)(GLuint, GLenum, GLuint64*);
+    static query_counter_t QueryCounter;
+    static get_query_object_ui64v_t GetQueryObjectui64v;
+    static int supported = -1; // -1: not checked yet
+
+    static bool Supported()
+    {
+        if (supported < 0)
+        {
+            GLint major = 0, minor = 0;
+            glGetIntegerv(GL_MAJOR_VERSION, &major);
+            glGetIntegerv(GL_MINOR_VERSION, &minor);
+            supported = (major > 3 || (major == 3 && minor >= 3) || SDL_GL_ExtensionSupported("GL_ARB_timer_query")) ? 1 : 0;
+            if (supported)
+            {
+                QueryCounter = (query_counter_t)SDL_GL_GetProcAddress("glQueryCounter");
+                GetQueryObjectui64v = (get_query_object_ui64v_t)SDL_GL_GetProcAddress("glGetQueryObjectui64v");
+                if (!QueryCounter || !GetQueryObjectui64v)
+                    supported = 0;
+            }
         }
+        return supported == 1;
     }
 }
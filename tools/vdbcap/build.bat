@@ -0,0 +1,4 @@
+@REM Build for Visual Studio compiler.
+@REM Run your copy of vcvars32.bat or vcvarsall.bat to setup command-line compiler.
+set INCLUDES=/I..\..\src /I..\..\include\vdb
+cl /nologo /O2 /MD %INCLUDES% vdbcap.cpp /link /subsystem:console
@@ -0,0 +1,199 @@
+// Converts a .vdbcap file (recorded with the "Raw" mode of vdb's screenshot dialog)
+// to an image sequence or a video.
+//
+//   vdbcap capture.vdbcap                     print information about the capture
+//   vdbcap capture.vdbcap frame%04d.png       write images (.png, .bmp or .tga)
+//   vdbcap capture.vdbcap video.mp4 [-r 60]   pipe frames to ffmpeg (any other extension)
+//
+// Dropped frames are skipped when writing images (leaving a gap in the numbering),
+// and replaced by the previous frame when writing video to keep the timing intact.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "vdbcap.h"
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb_image_write.h"
+
+#ifdef _MSC_VER
+#define popen _popen
+#define pclose _pclose
+#define fseek64 _fseeki64
+#else
+#define fseek64 fseeko
+#endif
+
+#ifdef _WIN32
+#define POPEN_WRITE_MODE "wb"
+#else
+#define POPEN_WRITE_MODE "w"
+#endif
+
+static bool HasExtension(const char *filename, const char *ext)
+{
+    size_t n = strlen(filename);
+    size_t m = strlen(ext);
+    return n >= m && strcmp(filename + n - m, ext) == 0;
+}
+
+static bool ReadFrame(FILE *f, vdbcap_frame_t *frame, unsigned char *compressed, unsigned char *pixels, int frame_size)
+{
+    if (fseek64(f, frame->offset, SEEK_SET) != 0)
+        return false;
+    if (frame->compression == VDBCAP_UNCOMPRESSED)
+        return frame->size == (uint32_t)frame_size && fread(pixels, 1, frame_size, f) == (size_t)frame_size;
+    if (frame->compression == VDBCAP_LZ4)
+    {
+        if (frame->size > (uint32_t)lz4::CompressBound(frame_size) || fread(compressed, 1, frame->size, f) != frame->size)
+            return false;
+        return lz4::Decompress(compressed, (int)frame->size, pixels, frame_size) == frame_size;
+    }
+    return false;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        printf("usage: %s input.vdbcap [output] [-r fps]\n", argv[0]);
+        printf("  output: image filename with %%d for the frame number (.png, .bmp, .tga),\n");
+        printf("          or a video filename passed to ffmpeg (e.g. .mp4). Omit to print info.\n");
+        return 1;
+    }
+    const char *input = argv[1];
+    const char *output = NULL;
+    float fps = 60.0f;
+    for (int i = 2; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) fps = (float)atof(argv[++i]);
+        else output = argv[i];
+    }
+
+    FILE *f = fopen(input, "rb");
+    if (!f)
+    {
+        fprintf(stderr, "Failed to open %s\n", input);
+        return 1;
+    }
+
+    vdbcap_header_t header;
+    if (fread(&header, sizeof(header), 1, f) != 1 ||
+        memcmp(header.magic, VDBCAP_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != VDBCAP_VERSION ||
+        (header.channels != 3 && header.channels != 4) ||
+        header.num_frames > header.max_frames)
+    {
+        fprintf(stderr, "%s is not a valid .vdbcap file (version %d)\n", input, VDBCAP_VERSION);
+        fclose(f);
+        return 1;
+    }
+
+    int num_frames = (int)header.num_frames;
+    vdbcap_frame_t *index = (vdbcap_frame_t*)calloc(num_frames + 1, sizeof(vdbcap_frame_t));
+    if (fread(index, sizeof(vdbcap_frame_t), num_frames, f) != (size_t)num_frames)
+    {
+        fprintf(stderr, "%s is truncated\n", input);
+        fclose(f);
+        return 1;
+    }
+
+    int width = (int)header.width;
+    int height = (int)header.height;
+    int channels = (int)header.channels;
+    int frame_size = width*height*channels;
+
+    if (!output)
+    {
+        int num_dropped = 0;
+        double stored = 0.0;
+        for (int i = 0; i < num_frames; i++)
+        {
+            if (index[i].size == 0) num_dropped++;
+            stored += index[i].size;
+        }
+        double duration = num_frames > 1 ? index[num_frames-1].time - index[0].time : 0.0;
+        printf("%s: %dx%d %s, %d frames (%d dropped)\n", input, width, height, channels == 4 ? "RGBA" : "RGB", num_frames, num_dropped);
+        if (duration > 0.0)
+            printf("duration %.2f s (%.1f frames per second)\n", duration, (num_frames-1)/duration);
+        if (stored > 0.0)
+            printf("%.1f MB stored (%.1fx compression)\n", stored/(1024.0*1024.0), (double)frame_size*(num_frames-num_dropped)/stored);
+        fclose(f);
+        return 0;
+    }
+
+    bool to_images = HasExtension(output, ".png") || HasExtension(output, ".bmp") || HasExtension(output, ".tga");
+    FILE *pipe = NULL;
+    if (!to_images)
+    {
+        char cmd[2048];
+        snprintf(cmd, sizeof(cmd),
+                 "ffmpeg -r %f -f rawvideo -pix_fmt %s -s %dx%d -i - "
+                 "-threads 0 -y -c:v libx264 -preset fast -crf 21 -pix_fmt yuv420p -vf vflip \"%s\"",
+                 fps, channels == 4 ? "rgba" : "rgb24", width, height, output);
+        pipe = popen(cmd, POPEN_WRITE_MODE);
+        if (!pipe)
+        {
+            fprintf(stderr, "Failed to start ffmpeg: %s\n", cmd);
+            fclose(f);
+            return 1;
+        }
+    }
+
+    unsigned char *pixels = (unsigned char*)malloc(frame_size);
+    unsigned char *compressed = (unsigned char*)malloc(lz4::CompressBound(frame_size));
+    assert(pixels && compressed);
+    stbi_flip_vertically_on_write(1); // rows are stored bottom-up
+    bool have_frame = false;
+    int num_written = 0;
+    int result = 0;
+    for (int i = 0; i < num_frames; i++)
+    {
+        bool ok = index[i].size > 0 && ReadFrame(f, index + i, compressed, pixels, frame_size);
+        if (index[i].size > 0 && !ok)
+            fprintf(stderr, "Frame %d is corrupt, skipping\n", i);
+
+        if (to_images)
+        {
+            if (!ok)
+                continue;
+            char filename[1024];
+            snprintf(filename, sizeof(filename), output, i);
+            bool saved = false;
+            if      (HasExtension(output, ".png")) saved = stbi_write_png(filename, width, height, channels, pixels, width*channels) != 0;
+            else if (HasExtension(output, ".bmp")) saved = stbi_write_bmp(filename, width, height, channels, pixels) != 0;
+            else                                   saved = stbi_write_tga(filename, width, height, channels, pixels) != 0;
+            if (!saved)
+            {
+                fprintf(stderr, "Failed to write %s\n", filename);
+                result = 1;
+                break;
+            }
+            num_written++;
+        }
+        else
+        {
+            have_frame |= ok;
+            if (!have_frame)
+                continue;
+            if (fwrite(pixels, 1, frame_size, pipe) != (size_t)frame_size)
+            {
+                fprintf(stderr, "ffmpeg stopped accepting frames (see its output above)\n");
+                result = 1;
+                break;
+            }
+            num_written++;
+        }
+        if (i % 100 == 99)
+            printf("%d/%d frames...\n", i + 1, num_frames);
+    }
+    if (pipe)
+        pclose(pipe);
+    printf("Wrote %d frames to %s\n", num_written, output);
+
+    free(compressed);
+    free(pixels);
+    free(index);
+    fclose(f);
+    return result;
+}
@@ -0,0 +1,73 @@
+// Shows a .vdbrec file recorded with vdbRecordToFile (or VDB_RECORD=<filename>), so
+// that an expensive run can be inspected without running it again.
+//
+//   vdbreplay recording.vdbrec      open the recording in vdb (F10 steps, the slider scrubs)
+//   vdbreplay -i recording.vdbrec   print information about the recording
+#include <stdio.h>
+#include <string.h>
+#include <vdb.h>
+#include "vdbrec.h"
+
+static int PrintInfo(const char *input)
+{
+    FILE *f = fopen(input, "rb");
+    if (!f)
+    {
+        fprintf(stderr, "Failed to open %s\n", input);
+        return 1;
+    }
+    vdbrec_header_t header;
+    if (fread(&header, sizeof(header), 1, f) != 1 ||
+        memcmp(header.magic, VDBREC_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != VDBREC_VERSION)
+    {
+        fprintf(stderr, "%s is not a valid .vdbrec file (version %d)\n", input, VDBREC_VERSION);
+        fclose(f);
+        return 1;
+    }
+
+    int num_frames = 0;
+    int num_chunks = 0;
+    double frame_bytes = 0.0;
+    double chunk_bytes = 0.0;
+    double last_time = 0.0;
+    vdbrec_record_t record;
+    while (fread(&record, sizeof(record), 1, f) == 1)
+    {
+        if (record.type == VDBREC_FRAME)
+        {
+            double time;
+            if (record.size < sizeof(time) || fread(&time, sizeof(time), 1, f) != 1)
+                break;
+            record.size -= sizeof(time);
+            last_time = time;
+            frame_bytes += record.size;
+            num_frames++;
+        }
+        else if (record.type == VDBREC_CHUNK)
+        {
+            chunk_bytes += record.size;
+            num_chunks++;
+        }
+        if (fseek(f, record.size, SEEK_CUR) != 0)
+            break;
+    }
+    fclose(f);
+
+    printf("%s: %d frames over %.2f s\n", input, num_frames, last_time);
+    printf("%.1f MB in frames, %.1f MB in %d shared chunks\n", frame_bytes/(1024.0*1024.0), chunk_bytes/(1024.0*1024.0), num_chunks);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc == 3 && strcmp(argv[1], "-i") == 0)
+        return PrintInfo(argv[2]);
+    if (argc != 2)
+    {
+        printf("usage: %s [-i] input.vdbrec\n", argv[0]);
+        printf("  -i: print information about the recording instead of showing it\n");
+        return 1;
+    }
+    return vdbPlayRecording(argv[1]) ? 0 : 1;
+}
@@ -0,0 +1,20 @@
+// Shows the breaks of a program running in vdb's client mode (see vdbConnect), so
+// that the window, OpenGL, SDL and ImGui don't run inside the program being debugged.
+//
+//   vdb-viewer <name>    start this first, then run the program with VDB_CONNECT=<name>
+//                        (or call vdbConnect("<name>") before its first break)
+//
+// Linux and macOS only.
+#include <stdio.h>
+#include <vdb.h>
+
+int main(int argc, char **argv)
+{
+    if (argc != 2)
+    {
+        printf("usage: %s name\n", argv[0]);
+        printf("  name: shared by the viewer and the client, e.g. the program's name\n");
+        return 1;
+    }
+    return vdbRunViewer(argv[1]) ? 0 : 1;
+}